@@ -2,17 +2,23 @@ package main
 
 import (
 	"bufio"
+	"encoding/binary"
+	"encoding/hex"
 	"encoding/json"
 	"errors"
+	"flag"
+	"fmt"
 	"io"
 	"log"
 	"math"
 	"net/http"
 	"os"
 	"os/exec"
+	"path/filepath"
 	"strconv"
 	"strings"
 	"sync"
+	"sync/atomic"
 	"time"
 
 	"github.com/golang-jwt/jwt/v5"
@@ -33,106 +39,587 @@ type ResponsePayload struct {
 // --- NEW STRUCT for Attestation Response ---
 type AttestationResponse struct {
 	EvidenceHex string `json:"evidence_hex,omitempty"`
+	// Custom claims bound into the quote: a 32-byte nonce and the expiry as
+	// little-endian Unix seconds. The quote's report data is their SHA-256.
+	ClaimsHex   string `json:"claims_hex,omitempty"`
+	GeneratedAt string `json:"generated_at,omitempty"`
+	ExpiresAt   string `json:"expires_at,omitempty"`
 	Error       string `json:"error,omitempty"`
 }
 
-// --- Sentiment Analysis Logic (Unchanged) ---
+// --- Sentiment Analysis Logic ---
 
 // Pre-computed embeddings for reference sentences.
 var positiveReferenceEmbedding = []float32{0.006, 0.022, 0.057, 0.026, 0.012, 0.031, 0.006, 0.014, -0.002, 0.013, 0.009, 0.000, -0.025, -0.010, -0.004, 0.010, 0.013, 0.035, 0.004, 0.053, 0.009, -0.012, -0.058, 0.022, 0.010, 0.003, -0.019, 0.057, -0.031, -0.019, 0.030, 0.005, -0.005, -0.066, 0.040, -0.015, 0.011, 0.012, -0.036, -0.026, -0.027, -0.031, 0.025, -0.005, -0.032, 0.012, -0.015, 0.026, -0.011, 0.009, -0.073, 0.019, -0.033, 0.001, 0.050, 0.020, -0.004, -0.022, 0.016, 0.023, -0.000, -0.008, 0.020, 0.000, 0.013, -0.006, -0.028, -0.018, -0.033, 0.009, -0.023, -0.035, -0.020, -0.046, 0.033, -0.025, -0.044, -0.003, 0.043, 0.045, 0.006, -0.020, 0.045, 0.076, -0.006, 0.017, -0.022, 0.004, -0.043, 0.021, -0.040, -0.004, 0.101, 0.002, 0.015, -0.034, 0.024, 0.001, 0.032, 0.029, -0.009, -0.055, 0.009, -0.061, -0.034, -0.037, -0.037, -0.004, 0.027, 0.050, -0.001, 0.027, -0.028, 0.009, -0.043, 0.104, 0.053, 0.018, -0.029, 0.006, 0.008, 0.027, 0.040, 0.075, -0.003, -0.000, -0.027, 0.009, -0.037, -0.023, 0.036, 0.072, -0.013, -0.048, -0.012, -0.003, 0.003, -0.074, 0.055, -0.058, -0.012, -0.015, 0.004, -0.017, 0.054, -0.010, -0.041, -0.035, 0.008, -0.003, -0.016, 0.020, 0.024, -0.015, -0.016, 0.040, -0.032, 0.050, -0.015, -0.012, 0.008, -0.029, 0.009, 0.003, -0.004, 0.015, 0.029, 0.013, 0.011, 0.024, -0.057, -0.040, 0.046, 0.030, 0.023, 0.021, 0.071, -0.011, -0.001, 0.011, -0.065, -0.002, -0.027, 0.055, -0.011, 0.007, 0.035, -0.007, 0.033, -0.066, -0.087, -0.050, 0.024, 0.012, 0.020, -0.005, -0.022, -0.026, 0.007, 0.023, -0.012, 0.028, 0.035, -0.097, -0.038, 0.047, 0.035, -0.049, -0.054, 0.002, -0.054, 0.018, 0.072, -0.013, -0.029, 0.027, 0.013, -0.038, 0.009, 0.003, 0.039, -0.008, -0.074, 0.029, 0.029, 0.063, 0.050, -0.030, 0.036, 0.049, -0.044, -0.061, -0.029, 0.042, -0.012, 0.076, 0.061, -0.018, 0.063, -0.007, -0.017, 0.058, 0.026, 0.048, -0.005, 0.026, -0.016, 0.001, -0.041, -0.008, 0.076, -0.013, 0.044, 0.018, 0.030, -0.063, 0.050, -0.034, 0.045, 0.034, 0.008, 0.007, 0.059, 0.033, 0.008, -0.067, -0.044, 0.011, -0.012, -0.008, 0.034, -0.032, -0.005, 0.024, 0.040, -0.033, 0.050, -0.001, -0.051, -0.068, 0.050, 0.071, 0.039, 0.001, 0.071, -0.071, -0.047, -0.026, -0.047, 0.037, 0.065, 0.023, -0.050, 0.002, -0.025, 0.022, -0.001, 0.011, -0.010, -0.030, 0.040, -0.070, -0.051, 0.034, 0.047, -0.014, 0.039, -0.067, -0.296, 0.022, 0.004, -0.020, 0.031, -0.040, -0.009, -0.012, -0.033, 0.029, 0.034, 0.046, 0.047, 0.005, 0.013, 0.030, -0.015, 0.042, -0.007, -0.007, -0.001, -0.027, 0.007, -0.004, -0.022, 0.006, -0.054, -0.000, -0.039, -0.023, -0.009, -0.037, -0.019, -0.020, 0.017, 0.027, 0.011, -0.010, -0.018, -0.044, -0.008, -0.036, -0.002, -0.017, 0.063, 0.043, 0.016, -0.035, -0.034, 0.035, -0.016, -0.025, -0.005, 0.017, -0.004, 0.025, 0.014, 0.019, 0.003, 0.042, -0.023, -0.020, -0.034, -0.003, 0.022, -0.065, -0.005, -0.040, 0.056, 0.028, 0.039, 0.001, 0.018, -0.043, -0.032, 0.035, -0.007, -0.005, -0.009, 0.053, -0.039, -0.010, -0.007, 0.022, -0.049, -0.022, -0.022, -0.021, -0.001, -0.009, 0.045, -0.030, -0.000, -0.011, 0.044, -0.004, -0.036, -0.021, 0.022, -0.069, 0.060, -0.001, 0.032, -0.011, 0.048, -0.008, -0.012, -0.016, 0.082, 0.028, -0.047, 0.012, 0.010, -0.027, 0.051, -0.017, 0.049, 0.042, -0.032, -0.010, -0.000, 0.037, -0.034, 0.023, -0.072, -0.005, 0.015, 0.035, -0.019, 0.007, -0.019, -0.032, -0.041, -0.030, 0.036, 0.037, -0.036, -0.073, -0.000, 0.009, 0.027, -0.027, -0.004, 0.012, 0.017, 0.008, -0.011, -0.020, -0.062, 0.044, -0.034, -0.040, -0.043, -0.023, 0.029, 0.013, 0.011, 0.052, 0.016, -0.046, -0.028, -0.033, -0.069, -0.002, 0.039, 0.077, -0.022, -0.065, 0.011, 0.033, 0.041, -0.045, -0.025, -0.003, -0.055, 0.011, 0.003, 0.040, 0.041, -0.016, -0.024, -0.014, -0.006, 0.012, 0.057, 0.021, -0.007, -0.055, -0.039, 0.055, -0.009, 0.058, -0.016, -0.042, -0.049, -0.100, -0.017, 0.008, -0.050, -0.004, -0.005, -0.032, -0.072, 0.033, -0.020, -0.081, 0.029, 0.009, 0.046, 0.008, -0.006, 0.006, 0.025, -0.017, -0.077, 0.014, 0.014, -0.025, 0.009, -0.059, 0.036, -0.087, -0.038, 0.000, -0.026, 0.006, 0.025, 0.019, 0.003, -0.042, 0.083, -0.022, 0.055, 0.064, -0.033, 0.037, -0.049, -0.015, -0.012, 0.039, 0.014, -0.008, -0.022, 0.018, -0.014, -0.014, 0.025, -0.052, -0.046, 0.035, -0.013, 0.029, -0.045, 0.001, 0.008, 0.001, -0.011, 0.022, -0.088, 0.015, -0.005, -0.018, 0.002, 0.035, 0.016, 0.005, 0.026, -0.039, 0.015, -0.013, 0.059, -0.032, -0.013, 0.030, 0.030, 0.012, -0.005, 0.025, 0.043, -0.018, 0.017, 0.031, 0.054, 0.062, 0.030, -0.039, 0.031, -0.054, -0.024, 0.005, -0.032, 0.048, 0.014, -0.004, -0.038, 0.022, 0.081, 0.021, -0.030, 0.025, -0.014, 0.000, -0.000, 0.005, -0.033, 0.004, 0.022, -0.018, -0.016, 0.022, 0.028, -0.069, 0.043, 0.049, 0.004, -0.013, 0.039, -0.023, 0.018, 0.006, 0.025, -0.031, 0.012, -0.024, 0.014, 0.016, -0.020, 0.017, 0.008, 0.017, 0.005, 0.037, -0.005, 0.034, -0.016, -0.049, -0.027, -0.007, -0.034, 0.049, -0.029, 0.011, 0.017, 0.047, -0.028, 0.016, 0.010, -0.038, 0.028, -0.007, 0.012, -0.009, 0.017, -0.015, 0.024, -0.046, 0.038, -0.027, -0.041, 0.007, 0.003, -0.025, 0.071, -0.036, -0.015, -0.027, 0.025, 0.006, -0.014, 0.059, -0.002, 0.007, -0.015, 0.032, 0.001, -0.000, -0.040, -0.032, 0.029, 0.064, -0.038, 0.038, -0.006, -0.028, -0.049, -0.005, -0.036, -0.006, -0.012, -0.039, 0.033, -0.027, -0.018, -0.034, 0.002, -0.009, 0.069, 0.029, -0.027, 0.047, 0.043, 0.053, -0.084, -0.016, 0.036, 0.051, 0.007, -0.018, -0.054, 0.012, -0.006, 0.033, -0.026, 0.009, -0.048, 0.011, 0.008, 0.034, -0.017, -0.042, -0.023, 0.011, 0.014, 0.013, -0.013, 0.080, -0.009, -0.029, -0.044, 0.085, 0.037, 0.008, -0.026, -0.031, -0.057, -0.101, -0.033, -0.036, 0.006, -0.038, 0.039, -0.053, 0.024, -0.005, -0.038, -0.041, -0.026, -0.021, -0.081, -0.057, -0.021, -0.026, 0.045, -0.002, 0.042, -0.019, 0.017, -0.005, 0.015, 0.021}
 var negativeReferenceEmbedding = []float32{0.022, 0.025, 0.025, -0.054, 0.041, -0.018, 0.005, 0.010, 0.026, 0.003, -0.019, 0.007, -0.051, 0.037, -0.005, 0.053, 0.034, -0.021, 0.037, -0.003, 0.010, 0.049, -0.015, -0.040, -0.006, 0.027, 0.029, 0.044, -0.041, -0.017, 0.060, -0.011, 0.028, 0.002, 0.043, -0.007, -0.055, -0.006, -0.037, -0.020, -0.032, -0.005, -0.031, -0.031, -0.062, 0.032, -0.002, -0.019, -0.030, -0.025, -0.057, -0.024, 0.079, -0.026, -0.032, -0.019, 0.007, -0.090, -0.005, 0.048, 0.022, 0.018, -0.005, -0.005, 0.008, 0.001, -0.009, 0.047, -0.039, -0.011, -0.020, -0.016, -0.011, 0.027, 0.019, -0.063, -0.004, 0.041, 0.026, 0.055, 0.021, 0.029, 0.035, 0.052, -0.043, -0.022, -0.010, -0.001, 0.002, 0.060, -0.038, 0.016, 0.073, 0.005, 0.020, -0.049, 0.041, -0.012, 0.008, 0.025, -0.016, -0.040, 0.020, 0.023, -0.015, 0.005, 0.010, 0.039, 0.004, -0.029, 0.014, 0.037, -0.036, -0.050, -0.049, 0.039, 0.032, -0.015, 0.010, -0.023, 0.024, -0.032, -0.018, 0.088, 0.022, 0.056, 0.018, 0.015, 0.038, -0.031, 0.034, 0.064, 0.006, -0.035, -0.017, 0.008, -0.012, -0.004, 0.063, 0.029, 0.000, -0.066, -0.071, -0.012, -0.016, -0.047, -0.018, -0.021, 0.037, 0.045, -0.026, 0.006, 0.013, -0.078, 0.004, 0.026, -0.001, -0.013, -0.029, 0.052, 0.005, 0.002, 0.001, 0.032, -0.002, 0.009, 0.001, 0.032, -0.015, -0.034, -0.065, -0.014, -0.002, 0.015, -0.012, -0.006, 0.097, -0.005, -0.007, 0.010, -0.061, 0.006, -0.001, 0.035, -0.042, 0.022, 0.040, -0.057, -0.029, 0.051, -0.062, -0.060, 0.017, -0.012, 0.047, -0.030, -0.090, -0.025, 0.071, 0.061, -0.053, 0.035, 0.028, -0.013, -0.039, 0.023, 0.013, -0.049, -0.002, 0.015, -0.007, 0.003, 0.108, -0.001, 0.031, 0.035, 0.055, 0.020, 0.024, 0.003, -0.045, -0.007, -0.011, 0.015, -0.016, 0.065, 0.024, -0.034, 0.025, -0.060, -0.019, -0.048, -0.022, -0.002, 0.003, 0.053, 0.000, -0.029, 0.024, -0.013, -0.007, 0.040, -0.017, 0.047, -0.031, 0.008, -0.071, -0.031, 0.004, -0.013, 0.003, -0.008, 0.013, -0.023, -0.028, -0.036, -0.012, 0.016, 0.039, 0.047, 0.020, 0.033, -0.036, -0.028, -0.054, -0.066, -0.076, 0.071, -0.060, 0.045, 0.008, -0.019, 0.032, 0.041, 0.027, -0.043, 0.019, -0.013, -0.011, -0.024, -0.036, 0.015, -0.008, -0.051, 0.058, -0.049, 0.080, 0.031, 0.004, -0.031, 0.055, 0.035, -0.031, -0.009, 0.018, -0.025, -0.012, 0.035, 0.022, 0.023, 0.013, 0.002, 0.010, 0.031, -0.010, -0.037, 0.031, -0.060, -0.230, 0.047, 0.012, -0.005, 0.039, -0.034, 0.031, -0.035, -0.075, -0.005, -0.027, 0.062, -0.016, 0.022, -0.006, -0.022, -0.038, -0.023, 0.001, 0.021, -0.010, -0.019, 0.020, -0.005, 0.017, 0.074, 0.050, -0.002, -0.009, -0.000, 0.029, -0.033, 0.020, 0.035, 0.027, -0.002, 0.020, -0.011, -0.012, -0.018, -0.041, -0.069, 0.046, 0.010, 0.012, 0.026, 0.041, -0.060, -0.008, 0.057, 0.010, -0.085, -0.040, -0.016, 0.009, -0.021, -0.017, -0.008, -0.058, 0.005, -0.038, 0.008, -0.057, 0.022, 0.054, -0.005, 0.019, -0.067, 0.050, -0.034, 0.026, -0.052, 0.055, -0.052, -0.051, 0.008, -0.054, 0.052, -0.019, -0.026, -0.098, -0.040, 0.033, 0.010, 0.039, 0.010, 0.023, 0.029, 0.045, -0.008, 0.040, -0.011, 0.001, -0.054, 0.011, 0.110, 0.021, -0.026, -0.004, 0.012, 0.086, -0.023, 0.048, -0.017, 0.031, 0.002, -0.008, -0.011, -0.022, 0.017, 0.027, 0.038, 0.030, -0.029, -0.063, -0.004, -0.007, 0.022, -0.008, -0.009, 0.037, 0.018, -0.017, 0.014, -0.039, 0.039, 0.011, 0.053, -0.000, -0.023, -0.001, 0.017, -0.004, -0.039, -0.013, -0.003, -0.014, -0.030, -0.018, -0.026, 0.050, 0.008, -0.005, 0.006, -0.018, 0.051, 0.011, -0.061, -0.025, 0.000, -0.041, -0.066, -0.065, -0.040, -0.011, 0.037, -0.017, -0.007, 0.004, -0.058, -0.067, -0.022, -0.031, -0.059, 0.028, 0.019, -0.016, 0.025, 0.012, 0.026, 0.004, 0.021, 0.002, 0.029, -0.005, -0.012, -0.017, 0.017, 0.019, 0.020, -0.030, 0.040, 0.013, -0.033, 0.070, -0.015, 0.002, 0.013, 0.044, -0.031, -0.047, -0.006, 0.084, 0.036, -0.024, -0.092, 0.030, 0.041, -0.039, 0.017, 0.048, 0.074, -0.037, -0.009, -0.003, -0.006, 0.004, -0.016, -0.002, 0.010, -0.019, -0.018, -0.042, -0.026, -0.046, -0.014, 0.014, -0.060, 0.045, 0.001, -0.009, -0.002, -0.016, 0.030, 0.002, 0.056, 0.012, -0.012, 0.026, -0.086, 0.066, 0.013, -0.007, -0.002, -0.019, -0.032, -0.045, 0.024, 0.004, 0.056, 0.027, -0.010, -0.003, -0.026, 0.008, 0.032, 0.038, -0.053, -0.006, 0.022, -0.005, -0.027, -0.023, -0.008, 0.057, -0.054, 0.005, -0.018, -0.054, 0.012, 0.029, 0.018, -0.043, 0.038, 0.006, 0.079, 0.043, -0.027, -0.022, 0.046, -0.039, -0.020, 0.005, 0.016, -0.017, -0.003, -0.014, -0.032, 0.003, -0.082, 0.000, -0.028, -0.017, 0.010, 0.000, 0.014, 0.048, -0.050, -0.043, -0.054, 0.007, 0.003, 0.070, 0.020, -0.036, 0.028, 0.055, 0.023, -0.004, 0.007, -0.041, 0.016, -0.002, 0.032, 0.003, 0.004, -0.003, -0.004, 0.026, 0.033, -0.000, -0.037, 0.068, -0.037, -0.026, 0.063, -0.011, -0.012, -0.020, -0.074, 0.004, -0.019, 0.007, 0.033, -0.033, 0.019, 0.000, 0.031, 0.065, 0.046, 0.051, 0.047, -0.072, 0.063, -0.014, -0.048, 0.006, -0.034, 0.001, 0.009, -0.073, 0.003, -0.012, 0.052, 0.004, 0.008, 0.016, -0.027, -0.003, -0.015, -0.010, 0.062, 0.068, -0.017, 0.016, -0.012, 0.021, 0.044, -0.050, 0.030, -0.021, -0.098, 0.007, 0.032, -0.020, -0.003, 0.078, -0.015, -0.020, -0.039, -0.071, 0.037, -0.037, -0.050, -0.047, 0.018, 0.019, -0.019, -0.037, 0.051, -0.021, 0.011, -0.010, -0.030, -0.019, -0.066, 0.032, -0.005, 0.041, -0.051, -0.013, -0.009, -0.014, -0.025, -0.005, -0.019, 0.031, -0.008, -0.001, 0.048, 0.080, 0.025, -0.051, 0.040, 0.009, 0.052, 0.008, -0.047, -0.074, 0.041, 0.022, 0.003, -0.040, 0.057, 0.032, 0.016, 0.054, 0.014, -0.039, -0.035, -0.009, -0.057, -0.016, 0.021, -0.002, 0.056, 0.028, -0.038, 0.004, -0.013, 0.029, -0.021, -0.019, -0.016, -0.052, -0.041, 0.004, -0.022, 0.011, -0.055, 0.015, -0.037, -0.038, 0.015, 0.014, 0.025, -0.054, -0.024, 0.029, -0.009, 0.049, -0.001, -0.022, -0.021, 0.017, -0.054, -0.006, 0.020, 0.008, 0.082}
 
-func cosineSimilarity(a, b []float32) float64 {
-	var dotProduct, aMag, bMag float64
-	for i := 0; i < len(a); i++ {
-		dotProduct += float64(a[i] * b[i])
-		aMag += float64(a[i] * a[i])
-		bMag += float64(b[i] * b[i])
-	}
-	if aMag == 0 || bMag == 0 {
-		return 0.0
+// sentimentLabels names the rows of the classifier head written by
+// writeSentimentHead, in order.
+var sentimentLabels = []string{"Positive", "Negative"}
+
+// classifierHeadHeaderSize is sizeof(ClassifierHeadHeader).
+const classifierHeadHeaderSize = 24
+
+// writeSentimentHead writes the reference embeddings as a cosine classifier
+// head (common/classifier_head.h), so the worker can label requests in the
+// enclave and answer with two scores instead of the embedding.
+func writeSentimentHead(path string) error {
+	rows := [][]float32{positiveReferenceEmbedding, negativeReferenceEmbedding}
+	dim := len(rows[0])
+	buf := make([]byte, classifierHeadHeaderSize+len(rows)*dim*4)
+	copy(buf[0:], "MLPOCHD1")
+	binary.LittleEndian.PutUint32(buf[8:], 0) // kHeadCosine
+	binary.LittleEndian.PutUint32(buf[12:], uint32(len(rows)))
+	binary.LittleEndian.PutUint32(buf[16:], uint32(dim))
+	offset := classifierHeadHeaderSize
+	for _, row := range rows {
+		if len(row) != dim {
+			return errors.New("reference embeddings differ in length")
+		}
+		for _, v := range row {
+			binary.LittleEndian.PutUint32(buf[offset:], math.Float32bits(v))
+			offset += 4
+		}
 	}
-	return dotProduct / (math.Sqrt(aMag) * math.Sqrt(bMag))
+	return os.WriteFile(path, buf, 0o644)
+}
+
+// --- C++ Worker Management ---
+
+// workerResult is what the response reader hands to a waiting request.
+type workerResult struct {
+	embeddings []float32
+	// Payload of a stats frame.
+	text string
+	// Warm enclave instances reported by a readiness frame.
+	ready uint32
+	// Payload of an attestation frame.
+	attestation *attestationEvidence
+	// Opaque payload of a secure channel frame, or an embedding encoded as
+	// dtype when it is not float32.
+	bytes []byte
+	dtype uint16
+	// Best label and per-label scores of a classification frame.
+	label  uint32
+	scores []float32
+	// Worker status (oe_result_t) of a failed request.
+	status uint32
+	err    error
+}
+
+// attestationEvidence is one generation of the worker's cached evidence.
+type attestationEvidence struct {
+	generated time.Time
+	expires   time.Time
+	claims    []byte
+	evidence  []byte
 }
 
-// --- C++ Worker Management (Unchanged) ---
-var inferenceMutex sync.Mutex
+// workerConn is one running worker. Only pipe writers take writeMutex, and
+// pendingMutex is never held across I/O, so the response reader can always
+// hand a response on: a writer blocked on a full pipe or ring cannot stop
+// the worker's output from draining and freeing its queues.
+type workerConn struct {
+	cmd   *exec.Cmd
+	stdin io.WriteCloser
+	// requests is where request frames go: stdin, or the request ring
+	// with WORKER_TRANSPORT=shm.
+	requests io.Writer
+	// writeMutex serialises frames on the stdin pipe, where a large write
+	// may interleave with another. The request ring reserves space for
+	// each writer itself, so shm writers take no lock; nil then.
+	writeMutex *sync.Mutex
+	// writers counts writes in progress, so the segment is not unmapped
+	// under them. It is only added to under workerMutex while the conn is
+	// current.
+	writers sync.WaitGroup
+	done    chan struct{}
+	// pending maps request IDs in flight to their callers. Responses are
+	// matched by ID, so many requests can be in flight on one worker.
+	pendingMutex sync.Mutex
+	pending      map[uint64]chan workerResult
+}
+
+// workerMutex guards worker, the running worker or nil, and is held only
+// to start one or look it up, never across I/O.
+var workerMutex sync.Mutex
 var (
-	workerCmd    *exec.Cmd
-	workerStdin  io.WriteCloser
-	workerStdout *bufio.Reader
+	worker        *workerConn
+	nextRequestID atomic.Uint64
 )
 
+// modelVariant selects the weights the worker loads (--model-variant: f16,
+// q8_0 or q4_k). Empty means the shipped f16 model.
+var modelVariant = strings.TrimSpace(os.Getenv("MODEL_VARIANT"))
+
+// workerInstances is how many warm enclave instances the worker's supervisor
+// keeps (--supervisor N). A crashed instance's requests move to another one
+// while it is replaced in the background, so users never wait for enclave
+// creation. 0 runs a single worker without a supervisor.
+var workerInstances = envInt("WORKER_INSTANCES", 2)
+
+// workerNUMA places the supervisor's instances on the host's NUMA nodes
+// (--numa), each pinned with its memory on its node. With WORKER_INSTANCES
+// unset there is one instance per node.
+var workerNUMA = strings.TrimSpace(os.Getenv("WORKER_NUMA")) == "1"
+
+// workerSharedMemory passes frames to the worker through a shared-memory
+// segment (--transport=shm) instead of its stdin and stdout, so a request
+// costs two copies and no system call while the worker is busy. stdin
+// stays open only to tell the worker when to exit.
+var workerSharedMemory = strings.TrimSpace(os.Getenv("WORKER_TRANSPORT")) == "shm"
+
+// workerShmRingMB is the size of each of the segment's two rings; a frame
+// may take up to half of one.
+var workerShmRingMB = envInt("WORKER_SHM_RING_MB", 16)
+
+// workerStartupProfile makes the worker log a breakdown of its cold start
+// and an enclave heap size for the build (--startup-profile).
+var workerStartupProfile = strings.TrimSpace(os.Getenv("WORKER_STARTUP_PROFILE")) == "1"
+
+// envInt reads a non-negative integer setting, falling back to def when it
+// is unset or invalid.
+func envInt(name string, def int) int {
+	value, err := strconv.Atoi(strings.TrimSpace(os.Getenv(name)))
+	if err != nil || value < 0 {
+		return def
+	}
+	return value
+}
+
+// inferenceTimeout bounds how long a request waits for its response.
+const inferenceTimeout = 10 * time.Second
+
 // startWorker launches the C++ inference process once and keeps stdin/stdout pipes open.
-// If the worker exits, the goroutine below resets the globals so the next call
-// to runInference starts a new worker. This way the backend self-heals if the
-// C++ process crashes.
+// Callers must hold workerMutex.
 func startWorker() error {
 	hostAppPath := "./ml_host_prod_go"
 	modelPath := "./model/bert.bin"
 	enclavePath := "./enclave/enclave_prod.signed.so"
 
-	workerCmd = exec.Command(hostAppPath, modelPath, enclavePath, "--use-stdin")
-	var err error
-	workerStdin, err = workerCmd.StdinPipe()
-	if err != nil {
+	tokenizerDir := "./tokenizer"
+	headPath := filepath.Join(os.TempDir(), "ml-sentiment-head.bin")
+	if err := writeSentimentHead(headPath); err != nil {
 		return err
 	}
-	stdoutPipe, err := workerCmd.StdoutPipe()
-	if err != nil {
+
+	args := []string{modelPath, enclavePath, "--use-stdin", "--model-by-ref", "--protocol=binary",
+		"--tokenizer-dir", tokenizerDir, "--head", headPath}
+	if modelVariant != "" {
+		args = append(args, "--model-variant", modelVariant)
+	}
+	if workerStartupProfile {
+		args = append(args, "--startup-profile")
+	}
+	if workerNUMA {
+		args = append(args, "--numa")
+		if os.Getenv("WORKER_INSTANCES") != "" && workerInstances > 0 {
+			args = append(args, "--supervisor", strconv.Itoa(workerInstances))
+		}
+	} else if workerInstances > 0 {
+		args = append(args, "--supervisor", strconv.Itoa(workerInstances))
+	}
+	var segment *shmSegment
+	if workerSharedMemory {
+		var err error
+		segment, err = newShmSegment(uint64(workerShmRingMB) << 20)
+		if err != nil {
+			return err
+		}
+		// ExtraFiles start at fd 3.
+		args = append(args, "--transport=shm", "--shm-fd", "3")
+	}
+	workerStarts.Add(1)
+	cmd := exec.Command(hostAppPath, args...)
+	if segment != nil {
+		cmd.ExtraFiles = []*os.File{segment.file}
+	}
+	fail := func(err error) error {
+		if segment != nil {
+			segment.unmap()
+		}
 		return err
 	}
-	stderrPipe, err := workerCmd.StderrPipe()
+	stdin, err := cmd.StdinPipe()
 	if err != nil {
-		return err
+		return fail(err)
 	}
-	workerStdout = bufio.NewReader(stdoutPipe)
-	if err := workerCmd.Start(); err != nil {
-		return err
+	stdoutPipe, err := cmd.StdoutPipe()
+	if err != nil {
+		return fail(err)
+	}
+	stderrPipe, err := cmd.StderrPipe()
+	if err != nil {
+		return fail(err)
+	}
+	if err := cmd.Start(); err != nil {
+		return fail(err)
 	}
 
+	conn := &workerConn{cmd: cmd, stdin: stdin, requests: stdin, done: make(chan struct{}),
+		pending: map[uint64]chan workerResult{}}
+	var responses io.Reader = bufio.NewReader(stdoutPipe)
+	if segment != nil {
+		segment.closeFile()
+		responses = segment.responses
+		conn.requests = segment.requests
+	} else {
+		conn.writeMutex = &sync.Mutex{}
+	}
 	go func() {
 		scanner := bufio.NewScanner(stderrPipe)
 		for scanner.Scan() {
 			log.Printf("[worker stderr] %s", scanner.Text())
 		}
+		// stderr ends when the worker exits. A pipe would end with it; the
+		// response ring has to be closed, or a crashed worker's reader
+		// would wait for ever.
+		if segment != nil {
+			segment.responses.close()
+		}
 	}()
 
-	go func(cmd *exec.Cmd, stdin io.WriteCloser, stdout io.ReadCloser) {
-		if err := cmd.Wait(); err != nil {
-			log.Printf("worker exited: %v", err)
+	worker = conn
+	go readWorkerResponses(conn, responses, segment)
+	return nil
+}
+
+// stopWorker closes the worker's stdin, which makes it finish the requests
+// in flight and exit, and waits until it is gone. Callers must not hold
+// workerMutex.
+func stopWorker() {
+	workerMutex.Lock()
+	conn := worker
+	workerMutex.Unlock()
+	if conn == nil {
+		return
+	}
+	conn.stdin.Close()
+	<-conn.done
+}
+
+// readWorkerResponses hands each response frame to the request waiting for
+// it. When the worker's output ends, every outstanding request fails and
+// worker is reset so the next call to runInference starts a new worker.
+// Enclave crashes are handled by the worker's supervisor; this is the last
+// resort if the worker process itself goes away.
+func readWorkerResponses(conn *workerConn, responses io.Reader, segment *shmSegment) {
+	var readErr error
+	for {
+		id, result, err := readResponseFrame(responses)
+		if err != nil {
+			readErr = err
+			break
 		}
-		stdin.Close()
-		stdout.Close()
-		inferenceMutex.Lock()
-		workerCmd = nil
-		workerStdin = nil
-		workerStdout = nil
-		inferenceMutex.Unlock()
-	}(workerCmd, workerStdin, stdoutPipe)
+		conn.pendingMutex.Lock()
+		ch, ok := conn.pending[id]
+		delete(conn.pending, id)
+		conn.pendingMutex.Unlock()
+		if ok {
+			// Buffered, so this never waits for the caller.
+			ch <- result
+		} else {
+			log.Printf("worker answered unknown request %d", id)
+		}
+	}
 
-	return nil
+	conn.stdin.Close()
+	if segment != nil {
+		// Fails a writer waiting for space the worker will never free.
+		segment.requests.close()
+	}
+	if err := conn.cmd.Wait(); err != nil {
+		log.Printf("worker exited: %v", err)
+	}
+	workerMutex.Lock()
+	if worker == conn {
+		worker = nil
+	}
+	workerMutex.Unlock()
+	// No writer can join once conn is not current, and those still in the
+	// ring see it closed.
+	conn.writers.Wait()
+	if segment != nil {
+		segment.unmap()
+	}
+	conn.pendingMutex.Lock()
+	for id, ch := range conn.pending {
+		ch <- workerResult{err: fmt.Errorf("worker exited: %v", readErr)}
+		delete(conn.pending, id)
+	}
+	conn.pendingMutex.Unlock()
+	close(conn.done)
+}
+
+// Binary worker protocol (see host/worker_protocol.h). Each frame is a
+// little-endian uint32 length followed by a fixed header and the payload.
+const (
+	frameInferTokens      = 1
+	frameInferText        = 2
+	frameStats            = 3
+	frameReady            = 4
+	frameAttest           = 5
+	frameChannelOpen      = 6
+	frameInferSecure      = 7
+	frameChannelClose     = 8
+	requestHeaderSize     = 16
+	responseHeaderSize    = 20
+	dtypeF32              = 0
+	dtypeF16              = 1
+	dtypeText             = 2
+	dtypeBytes            = 3
+	dtypeI8               = 4
+	dtypeScores           = 5
+	flagOutputOptions     = 1 << 1
+	flagClassify          = 1 << 2
+	outputOptionsSize     = 8
+	attestHeaderSize      = 24
+	channelHeaderSize     = 16
+	channelPublicKeySize  = 65
+	maxRequestFrameBytes  = 16 << 20
+	maxResponseFrameBytes = 16 << 20
+)
+
+// oeInvalidParameter is OE_INVALID_PARAMETER: for embedding requests, the
+// output options do not fit the model (dims larger than its embedding).
+const oeInvalidParameter = 3
+
+// oeNotFound is OE_NOT_FOUND: for secure frames, the channel is gone and the
+// client has to open a new one.
+const oeNotFound = 9
+
+// requestFrameLimit is the longest request frame, after its length
+// prefix, that the transport takes: the protocol's maximum, or what fits in
+// half a shared-memory ring with WORKER_TRANSPORT=shm. Longer inputs are
+// refused with 413 before they reach the worker.
+func requestFrameLimit() int {
+	if !workerSharedMemory {
+		return maxRequestFrameBytes
+	}
+	return min(maxRequestFrameBytes, int(shmMaxFrameBytes(shmRingCapacity(uint64(workerShmRingMB)<<20)))-4)
+}
+
+// encodeTextFrame wraps raw UTF-8 text; the worker tokenizes it with the
+// vocabulary it was started with.
+func encodeTextFrame(requestID uint64, text string) []byte {
+	return encodeTextFrameWithFlags(requestID, text, 0)
+}
+
+// encodeClassifyFrame asks for the classifier head's label and scores for
+// text instead of its embedding.
+func encodeClassifyFrame(requestID uint64, text string) []byte {
+	return encodeTextFrameWithFlags(requestID, text, flagClassify)
+}
+
+func encodeTextFrameWithFlags(requestID uint64, text string, flags uint16) []byte {
+	frame := make([]byte, 4+requestHeaderSize+len(text))
+	binary.LittleEndian.PutUint32(frame[0:], uint32(requestHeaderSize+len(text)))
+	binary.LittleEndian.PutUint64(frame[4:], requestID)
+	binary.LittleEndian.PutUint16(frame[12:], frameInferText)
+	binary.LittleEndian.PutUint16(frame[14:], flags)
+	binary.LittleEndian.PutUint32(frame[16:], uint32(len(text)))
+	copy(frame[20:], text)
+	return frame
+}
+
+// outputOptions mirrors the worker's WireOutputOptions: the dtype of the
+// returned embedding, the pooling mode, how many leading values to keep (0
+// keeps all) and whether to L2-normalise them after truncation.
+type outputOptions struct {
+	dtype     uint16
+	pooling   uint16
+	dims      uint16
+	normalize bool
+}
+
+// encodeTextFrameWithOptions is encodeTextFrame with an output options block
+// leading the payload.
+func encodeTextFrameWithOptions(requestID uint64, text string, opts outputOptions) []byte {
+	payloadSize := outputOptionsSize + len(text)
+	frame := make([]byte, 4+requestHeaderSize+payloadSize)
+	binary.LittleEndian.PutUint32(frame[0:], uint32(requestHeaderSize+payloadSize))
+	binary.LittleEndian.PutUint64(frame[4:], requestID)
+	binary.LittleEndian.PutUint16(frame[12:], frameInferText)
+	binary.LittleEndian.PutUint16(frame[14:], flagOutputOptions)
+	binary.LittleEndian.PutUint32(frame[16:], uint32(len(text)))
+	binary.LittleEndian.PutUint16(frame[20:], opts.dtype)
+	binary.LittleEndian.PutUint16(frame[22:], opts.pooling)
+	binary.LittleEndian.PutUint16(frame[24:], opts.dims)
+	if opts.normalize {
+		binary.LittleEndian.PutUint16(frame[26:], 1)
+	}
+	copy(frame[28:], text)
+	return frame
+}
+
+// encodeStatsFrame asks the worker for its metrics in Prometheus text format.
+func encodeStatsFrame(requestID uint64) []byte {
+	return encodeEmptyFrame(requestID, frameStats)
+}
+
+// encodeReadyFrame asks the worker how many enclave instances can serve
+// requests.
+func encodeReadyFrame(requestID uint64) []byte {
+	return encodeEmptyFrame(requestID, frameReady)
+}
+
+// encodeAttestFrame asks the worker for its cached attestation evidence.
+func encodeAttestFrame(requestID uint64) []byte {
+	return encodeEmptyFrame(requestID, frameAttest)
+}
+
+// encodeBytesFrame wraps an opaque payload, as secure channel frames carry.
+func encodeBytesFrame(requestID uint64, frameType uint16, payload []byte) []byte {
+	frame := make([]byte, 4+requestHeaderSize+len(payload))
+	binary.LittleEndian.PutUint32(frame[0:], uint32(requestHeaderSize+len(payload)))
+	binary.LittleEndian.PutUint64(frame[4:], requestID)
+	binary.LittleEndian.PutUint16(frame[12:], frameType)
+	binary.LittleEndian.PutUint32(frame[16:], uint32(len(payload)))
+	copy(frame[20:], payload)
+	return frame
+}
+
+func encodeEmptyFrame(requestID uint64, frameType uint16) []byte {
+	frame := make([]byte, 4+requestHeaderSize)
+	binary.LittleEndian.PutUint32(frame[0:], requestHeaderSize)
+	binary.LittleEndian.PutUint64(frame[4:], requestID)
+	binary.LittleEndian.PutUint16(frame[12:], frameType)
+	return frame
+}
+
+// readResponseFrame reads one response frame. A non-nil error means the
+// stream itself is broken; a failed request is reported in the result.
+func readResponseFrame(r io.Reader) (uint64, workerResult, error) {
+	var lengthBuf [4]byte
+	if _, err := io.ReadFull(r, lengthBuf[:]); err != nil {
+		return 0, workerResult{}, err
+	}
+	length := binary.LittleEndian.Uint32(lengthBuf[:])
+	if length < responseHeaderSize || length > maxResponseFrameBytes {
+		return 0, workerResult{}, fmt.Errorf("invalid response frame length %d", length)
+	}
+	body := make([]byte, length)
+	if _, err := io.ReadFull(r, body); err != nil {
+		return 0, workerResult{}, err
+	}
+	id := binary.LittleEndian.Uint64(body[0:])
+	frameType := binary.LittleEndian.Uint16(body[8:])
+	dtype := binary.LittleEndian.Uint16(body[10:])
+	status := binary.LittleEndian.Uint32(body[12:])
+	count := binary.LittleEndian.Uint32(body[16:])
+	if status != 0 {
+		return id, workerResult{status: status, err: fmt.Errorf("worker returned status %d", status)}, nil
+	}
+	if frameType == frameReady || frameType == frameChannelClose {
+		return id, workerResult{ready: count}, nil
+	}
+	if frameType == frameChannelOpen || frameType == frameInferSecure {
+		payload := body[responseHeaderSize:]
+		if dtype != dtypeBytes || int(count) != len(payload) {
+			return id, workerResult{err: errors.New("unexpected secure channel payload")}, nil
+		}
+		return id, workerResult{bytes: payload}, nil
+	}
+	if frameType == frameAttest {
+		payload := body[responseHeaderSize:]
+		if dtype != dtypeBytes || int(count) != len(payload) || len(payload) < attestHeaderSize {
+			return id, workerResult{err: errors.New("unexpected attestation payload")}, nil
+		}
+		claimsLen := int(binary.LittleEndian.Uint32(payload[16:]))
+		evidenceLen := int(binary.LittleEndian.Uint32(payload[20:]))
+		if attestHeaderSize+claimsLen+evidenceLen != len(payload) {
+			return id, workerResult{err: errors.New("unexpected attestation payload")}, nil
+		}
+		claims := payload[attestHeaderSize : attestHeaderSize+claimsLen]
+		return id, workerResult{attestation: &attestationEvidence{
+			generated: time.UnixMilli(int64(binary.LittleEndian.Uint64(payload[0:]))),
+			expires:   time.UnixMilli(int64(binary.LittleEndian.Uint64(payload[8:]))),
+			claims:    claims,
+			evidence:  payload[attestHeaderSize+claimsLen:],
+		}}, nil
+	}
+	if frameType == frameStats {
+		if dtype != dtypeText || int(count) != len(body)-responseHeaderSize {
+			return id, workerResult{err: errors.New("unexpected stats payload")}, nil
+		}
+		return id, workerResult{text: string(body[responseHeaderSize:])}, nil
+	}
+	payload := body[responseHeaderSize:]
+	switch {
+	case dtype == dtypeScores && 4+int(count)*4 == len(payload):
+		scores := make([]float32, count)
+		for i := range scores {
+			scores[i] = math.Float32frombits(binary.LittleEndian.Uint32(payload[4+4*i:]))
+		}
+		return id, workerResult{label: binary.LittleEndian.Uint32(payload), scores: scores}, nil
+	case dtype == dtypeF16 && int(count)*2 == len(payload), dtype == dtypeI8 && 4+int(count) == len(payload):
+		return id, workerResult{bytes: payload, dtype: dtype}, nil
+	case dtype != dtypeF32 || int(count)*4 != len(payload):
+		return id, workerResult{err: errors.New("unexpected embedding payload")}, nil
+	}
+	embeddings := make([]float32, count)
+	for i := range embeddings {
+		embeddings[i] = math.Float32frombits(binary.LittleEndian.Uint32(body[responseHeaderSize+4*i:]))
+	}
+	return id, workerResult{embeddings: embeddings}, nil
 }
 
-// runInference sends a token string to the persistent worker and reads one line of output.
-func runInference(tokenString string) (string, error) {
-	inferenceMutex.Lock()
-	defer inferenceMutex.Unlock()
+// runInference sends one text to the persistent worker and waits for the
+// embedding it computed. Concurrent callers are pipelined over the same
+// worker.
+func runInference(text string) ([]float32, error) {
+	result, err := workerRoundTrip(func(requestID uint64) []byte { return encodeTextFrame(requestID, text) })
+	if err != nil {
+		return nil, err
+	}
+	return result.embeddings, result.err
+}
 
-	if workerCmd == nil {
+// workerRoundTrip writes the frame built by encode, starting the worker if
+// it is not running, and waits for the matching response.
+func workerRoundTrip(encode func(requestID uint64) []byte) (workerResult, error) {
+	ch := make(chan workerResult, 1)
+
+	workerMutex.Lock()
+	if worker == nil {
 		if err := startWorker(); err != nil {
-			return "", err
+			workerMutex.Unlock()
+			return workerResult{}, err
 		}
 	}
+	conn := worker
+	conn.writers.Add(1)
+	workerMutex.Unlock()
 
-	if _, err := io.WriteString(workerStdin, tokenString+"\n"); err != nil {
-		return "", err
+	requestID := nextRequestID.Add(1)
+	conn.pendingMutex.Lock()
+	conn.pending[requestID] = ch
+	conn.pendingMutex.Unlock()
+	frame := encode(requestID)
+	if conn.writeMutex != nil {
+		conn.writeMutex.Lock()
+	}
+	_, err := conn.requests.Write(frame)
+	if conn.writeMutex != nil {
+		conn.writeMutex.Unlock()
 	}
-	line, err := workerStdout.ReadString('\n')
+	conn.writers.Done()
 	if err != nil {
-		return "", err
+		conn.pendingMutex.Lock()
+		delete(conn.pending, requestID)
+		conn.pendingMutex.Unlock()
+		return workerResult{}, err
+	}
+
+	select {
+	case result := <-ch:
+		return result, nil
+	case <-time.After(inferenceTimeout):
+		conn.pendingMutex.Lock()
+		delete(conn.pending, requestID)
+		conn.pendingMutex.Unlock()
+		return workerResult{}, fmt.Errorf("request %d timed out", requestID)
 	}
-	return line, nil
 }
 
 // --- Utility Functions ---
@@ -206,108 +693,311 @@ func authMiddleware(next http.HandlerFunc) http.HandlerFunc {
 
 // --- NEW Attestation Handler ---
 func handleAttestation(w http.ResponseWriter, r *http.Request) {
-	log.Println("Received request for attestation evidence.")
-
-	// Define paths to the C++ host and its dependencies
-	hostAppPath := "./ml_host_prod_go"
-	modelPath := "./model/bert.bin"
-	enclavePath := "./enclave/enclave_prod.signed.so"
-
-	// Execute the host application with the --attest flag
-	cmd := exec.Command(hostAppPath, modelPath, enclavePath, "--attest")
-	output, err := cmd.CombinedOutput()
+	// The running worker serves evidence it generated in the background and
+	// refreshes before expiry, so a call costs one frame round trip rather
+	// than an enclave lifecycle and a fresh quote.
+	result, err := workerRoundTrip(encodeAttestFrame)
+	if err == nil {
+		err = result.err
+	}
 	if err != nil {
-		log.Printf("Attestation host process failed: %v\nOutput: %s", err, string(output))
+		log.Printf("Attestation evidence unavailable: %v", err)
 		writeAttestationError(w, "Failed to generate attestation evidence from host.", http.StatusInternalServerError)
 		return
 	}
+	evidence := result.attestation
 
-	// The C++ host prints the hex-encoded evidence to stdout.
-	evidenceHex := strings.TrimSpace(string(output))
-
-	log.Printf("Successfully generated attestation evidence.")
-
-	// Send the evidence back to the client
+	// Clients that can take raw bytes get the quote as is, with the claims
+	// and expiry in headers; the JSON form stays for existing clients.
+	w.Header().Set("X-Attestation-Claims", hex.EncodeToString(evidence.claims))
+	w.Header().Set("X-Attestation-Expires", evidence.expires.UTC().Format(time.RFC3339))
+	if strings.Contains(r.Header.Get("Accept"), "application/octet-stream") {
+		w.Header().Set("Content-Type", "application/octet-stream")
+		w.Write(evidence.evidence)
+		return
+	}
 	resp := AttestationResponse{
-		EvidenceHex: evidenceHex,
+		EvidenceHex: hex.EncodeToString(evidence.evidence),
+		ClaimsHex:   hex.EncodeToString(evidence.claims),
+		GeneratedAt: evidence.generated.UTC().Format(time.RFC3339),
+		ExpiresAt:   evidence.expires.UTC().Format(time.RFC3339),
 	}
 	w.Header().Set("Content-Type", "application/json")
 	json.NewEncoder(w).Encode(resp)
 }
 
-func handleInference(w http.ResponseWriter, r *http.Request) {
-	var payload RequestPayload
-	if err := json.NewDecoder(r.Body).Decode(&payload); err != nil {
+// Secure channel endpoints (see enclave/secure_channel.h). The backend only
+// relays opaque bytes: the client attests the enclave once per channel from
+// the evidence it gets back from open, then every infer call carries tokens
+// and embeddings that only the client and the enclave can read. Clients
+// tokenize themselves, since the worker's tokenizer runs outside the
+// enclave.
+
+// SecureChannelResponse answers /api/secure/open.
+type SecureChannelResponse struct {
+	// The channel ID as the 8 little-endian bytes that lead its messages.
+	ChannelIDHex string `json:"channel_id_hex,omitempty"`
+	// Uncompressed P-256 point.
+	EnclavePublicKeyHex string `json:"enclave_public_key_hex,omitempty"`
+	// Quote whose custom claims are the enclave key followed by the client's.
+	EvidenceHex string `json:"evidence_hex,omitempty"`
+	Error       string `json:"error,omitempty"`
+}
+
+// readSecureBody reads a raw request body that has to fit into one frame.
+func readSecureBody(w http.ResponseWriter, r *http.Request) ([]byte, bool) {
+	body, err := io.ReadAll(http.MaxBytesReader(w, r.Body, int64(requestFrameLimit()-requestHeaderSize)))
+	if err != nil {
 		writeJSONError(w, "Invalid request body", http.StatusBadRequest)
+		return nil, false
+	}
+	return body, true
+}
+
+// writeSecureError reports a failed secure channel frame; a lost channel is
+// 410 so clients know to open a new one rather than retry.
+func writeSecureError(w http.ResponseWriter, result workerResult, err error) {
+	log.Printf("Secure channel request failed: %v", err)
+	if result.status == oeNotFound {
+		writeJSONError(w, "Secure channel not found", http.StatusGone)
 		return
 	}
+	writeJSONError(w, "Secure channel request failed", http.StatusInternalServerError)
+}
 
-	// --- 1. Tokenization ---
-	tokenizerDir := "./tokenizer"
-	pyCmd := exec.Command("python3", "tokenize_script.py", tokenizerDir)
-	pyCmd.Stdin = strings.NewReader(payload.Input)
+func handleSecureOpen(w http.ResponseWriter, r *http.Request) {
+	body, ok := readSecureBody(w, r)
+	if !ok {
+		return
+	}
+	if len(body) != channelPublicKeySize {
+		writeJSONError(w, "Expected a 65-byte uncompressed P-256 public key", http.StatusBadRequest)
+		return
+	}
+	result, err := workerRoundTrip(func(requestID uint64) []byte {
+		return encodeBytesFrame(requestID, frameChannelOpen, body)
+	})
+	if err == nil {
+		err = result.err
+	}
+	if err != nil {
+		writeSecureError(w, result, err)
+		return
+	}
+	payload := result.bytes
+	if len(payload) < channelHeaderSize {
+		writeSecureError(w, workerResult{}, errors.New("short channel open payload"))
+		return
+	}
+	keyLen := int(binary.LittleEndian.Uint32(payload[8:]))
+	evidenceLen := int(binary.LittleEndian.Uint32(payload[12:]))
+	if channelHeaderSize+keyLen+evidenceLen != len(payload) {
+		writeSecureError(w, workerResult{}, errors.New("malformed channel open payload"))
+		return
+	}
+	resp := SecureChannelResponse{
+		ChannelIDHex:        hex.EncodeToString(payload[0:8]),
+		EnclavePublicKeyHex: hex.EncodeToString(payload[channelHeaderSize : channelHeaderSize+keyLen]),
+		EvidenceHex:         hex.EncodeToString(payload[channelHeaderSize+keyLen:]),
+	}
+	w.Header().Set("Content-Type", "application/json")
+	json.NewEncoder(w).Encode(resp)
+}
 
-	pyOutput, err := pyCmd.CombinedOutput()
+// handleSecureInfer relays one sealed request and answers with the sealed
+// embedding, both as application/octet-stream.
+func handleSecureInfer(w http.ResponseWriter, r *http.Request) {
+	body, ok := readSecureBody(w, r)
+	if !ok {
+		return
+	}
+	analyzeRequests.Add(1)
+	result, err := workerRoundTrip(func(requestID uint64) []byte {
+		return encodeBytesFrame(requestID, frameInferSecure, body)
+	})
+	if err == nil {
+		err = result.err
+	}
 	if err != nil {
-		log.Printf("Tokenization script failed: %s", string(pyOutput))
-		writeJSONError(w, "Tokenization failed", http.StatusInternalServerError)
+		analyzeFailures.Add(1)
+		writeSecureError(w, result, err)
 		return
 	}
-	// Split output by newline and take the last non-empty line.
-	lines := strings.Split(string(pyOutput), "\n")
-	tokenString := ""
-	for i := len(lines) - 1; i >= 0; i-- {
-		line := strings.TrimSpace(lines[i])
-		if line != "" {
-			tokenString = line
-			break
-		}
+	w.Header().Set("Content-Type", "application/octet-stream")
+	w.Write(result.bytes)
+}
+
+// handleSecureClose takes the 8-byte channel ID and drops the channel's keys.
+func handleSecureClose(w http.ResponseWriter, r *http.Request) {
+	body, ok := readSecureBody(w, r)
+	if !ok {
+		return
+	}
+	if len(body) != 8 {
+		writeJSONError(w, "Expected an 8-byte channel ID", http.StatusBadRequest)
+		return
+	}
+	result, err := workerRoundTrip(func(requestID uint64) []byte {
+		return encodeBytesFrame(requestID, frameChannelClose, body)
+	})
+	if err == nil {
+		err = result.err
+	}
+	if err != nil {
+		writeSecureError(w, result, err)
+		return
+	}
+	w.WriteHeader(http.StatusNoContent)
+}
+
+// EmbedRequest asks /api/embed for an embedding in the form a caller stores
+// it. Dtype is "f32" (default), "f16" or "int8"; Dims keeps the leading
+// values (0 keeps all); Normalize re-normalises them after truncation.
+// Pooling is "mean" (default); "cls" is rejected, as the model runtime only
+// returns mean-pooled vectors.
+type EmbedRequest struct {
+	Input     string `json:"input"`
+	Dtype     string `json:"dtype,omitempty"`
+	Dims      int    `json:"dims,omitempty"`
+	Normalize bool   `json:"normalize,omitempty"`
+	Pooling   string `json:"pooling,omitempty"`
+}
+
+// EmbedResponse carries a float32 embedding as a JSON array, and f16 or
+// int8 ones as their raw little-endian bytes (base64 in JSON). An int8
+// value i decodes to Scale * int8(Data[i]).
+type EmbedResponse struct {
+	Dtype     string    `json:"dtype,omitempty"`
+	Dims      int       `json:"dims,omitempty"`
+	Scale     float32   `json:"scale,omitempty"`
+	Embedding []float32 `json:"embedding,omitempty"`
+	Data      []byte    `json:"data,omitempty"`
+	Error     string    `json:"error,omitempty"`
+}
+
+func parseOutputOptions(req EmbedRequest) (outputOptions, error) {
+	opts := outputOptions{normalize: req.Normalize}
+	switch req.Dtype {
+	case "", "f32":
+		opts.dtype = dtypeF32
+	case "f16":
+		opts.dtype = dtypeF16
+	case "int8":
+		opts.dtype = dtypeI8
+	default:
+		return opts, fmt.Errorf("unknown dtype %q", req.Dtype)
+	}
+	switch req.Pooling {
+	case "", "mean":
+	case "cls":
+		return opts, errors.New("cls pooling is not supported by the model runtime")
+	default:
+		return opts, fmt.Errorf("unknown pooling %q", req.Pooling)
+	}
+	if req.Dims < 0 || req.Dims > math.MaxUint16 {
+		return opts, fmt.Errorf("dims %d out of range", req.Dims)
 	}
-	tokenString = strings.TrimSpace(tokenString)
+	opts.dims = uint16(req.Dims)
+	return opts, nil
+}
 
-	// --- 2. Inference via C++ Worker ---
-	resultString, err := runInference(tokenString)
+// handleEmbed returns the embedding itself, encoded by the worker as the
+// request asks, for callers that keep vectors rather than labels.
+func handleEmbed(w http.ResponseWriter, r *http.Request) {
+	var payload EmbedRequest
+	if err := json.NewDecoder(r.Body).Decode(&payload); err != nil {
+		writeJSONError(w, "Invalid request body", http.StatusBadRequest)
+		return
+	}
+	if strings.TrimSpace(payload.Input) == "" {
+		writeJSONError(w, "Input text is empty", http.StatusBadRequest)
+		return
+	}
+	if len(payload.Input) > requestFrameLimit()-requestHeaderSize-outputOptionsSize {
+		writeJSONError(w, "Input text is too long", http.StatusRequestEntityTooLarge)
+		return
+	}
+	opts, err := parseOutputOptions(payload)
 	if err != nil {
-		log.Printf("Inference process failed: %v", err)
+		writeJSONError(w, err.Error(), http.StatusBadRequest)
+		return
+	}
+	analyzeRequests.Add(1)
+	result, err := workerRoundTrip(func(requestID uint64) []byte {
+		return encodeTextFrameWithOptions(requestID, payload.Input, opts)
+	})
+	if err == nil {
+		err = result.err
+	}
+	if err != nil {
+		analyzeFailures.Add(1)
+		log.Printf("Embedding request failed: %v", err)
+		if result.status == oeInvalidParameter {
+			writeJSONError(w, "Output options do not fit the model", http.StatusBadRequest)
+			return
+		}
 		writeJSONError(w, "Failed to run inference", http.StatusInternalServerError)
 		return
 	}
 
-	// --- 3. Process the output ---
-	// The C++ process might print "bert_load_from_file: using CPU backend" on its first run.
-	// We need to find the line that actually contains the comma-separated embeddings.
-	var embeddingLine string
-	scanner := bufio.NewScanner(strings.NewReader(resultString))
-	for scanner.Scan() {
-		line := scanner.Text()
-		if strings.Contains(line, ",") {
-			embeddingLine = line
-			break
+	var resp EmbedResponse
+	switch result.dtype {
+	case dtypeF16:
+		resp = EmbedResponse{Dtype: "f16", Dims: len(result.bytes) / 2, Data: result.bytes}
+	case dtypeI8:
+		resp = EmbedResponse{
+			Dtype: "int8",
+			Dims:  len(result.bytes) - 4,
+			Scale: math.Float32frombits(binary.LittleEndian.Uint32(result.bytes)),
+			Data:  result.bytes[4:],
 		}
+	default:
+		resp = EmbedResponse{Dtype: "f32", Dims: len(result.embeddings), Embedding: result.embeddings}
 	}
-	if embeddingLine == "" {
-		log.Printf("Could not find embedding vector in C++ output: %s", resultString)
-		writeJSONError(w, "Failed to parse inference output", http.StatusInternalServerError)
+	w.Header().Set("Content-Type", "application/json")
+	json.NewEncoder(w).Encode(&resp)
+}
+
+func handleInference(w http.ResponseWriter, r *http.Request) {
+	var payload RequestPayload
+	if err := json.NewDecoder(r.Body).Decode(&payload); err != nil {
+		writeJSONError(w, "Invalid request body", http.StatusBadRequest)
 		return
 	}
 
-	outputParts := strings.Split(strings.TrimSpace(embeddingLine), ",")
-	embeddings := make([]float32, len(outputParts))
-	for i, part := range outputParts {
-		val, _ := strconv.ParseFloat(strings.TrimSpace(part), 64)
-		embeddings[i] = float32(val)
+	// --- 1. Tokenization and inference via C++ Worker ---
+	// The worker tokenizes the text itself, so there is no per-request
+	// tokenizer process.
+	if strings.TrimSpace(payload.Input) == "" {
+		writeJSONError(w, "Input text is empty", http.StatusBadRequest)
+		return
+	}
+	if len(payload.Input) > requestFrameLimit()-requestHeaderSize {
+		writeJSONError(w, "Input text is too long", http.StatusRequestEntityTooLarge)
+		return
+	}
+	analyzeRequests.Add(1)
+	result, err := workerRoundTrip(func(requestID uint64) []byte { return encodeClassifyFrame(requestID, payload.Input) })
+	if err == nil {
+		err = result.err
+	}
+	if err == nil && (len(result.scores) != len(sentimentLabels) || int(result.label) >= len(sentimentLabels)) {
+		err = errors.New("unexpected classification")
+	}
+	if err != nil {
+		analyzeFailures.Add(1)
+		log.Printf("Inference process failed: %v", err)
+		writeJSONError(w, "Failed to run inference", http.StatusInternalServerError)
+		return
 	}
 
 	// --- 4. Classify Sentiment ---
-	posSimilarity := cosineSimilarity(embeddings, positiveReferenceEmbedding)
-	negSimilarity := cosineSimilarity(embeddings, negativeReferenceEmbedding)
-
-	var sentiment string
-	if posSimilarity > negSimilarity {
-		sentiment = "Positive"
-	} else if negSimilarity > posSimilarity {
-		sentiment = "Negative"
-	} else {
+	// The enclave scored the embedding against the reference embeddings
+	// (writeSentimentHead), the same cosine the -check-variants classifier
+	// (variant_check.go) computes.
+	sentiment := sentimentLabels[result.label]
+	posSimilarity, negSimilarity := float64(result.scores[0]), float64(result.scores[1])
+	if posSimilarity == negSimilarity {
 		sentiment = "Neutral"
 	}
 	log.Printf("Input: '%s', Sentiment: %s (Pos-Sim: %f, Neg-Sim: %f)", payload.Input, sentiment, posSimilarity, negSimilarity)
@@ -324,8 +1014,21 @@ func handleInference(w http.ResponseWriter, r *http.Request) {
 // --- Main Function ---
 
 func main() {
+	checkVariants := flag.String("check-variants", "",
+		"compare comma-separated model variants (e.g. q8_0,q4_k) with f16 and exit")
+	flag.Parse()
+	if *checkVariants != "" {
+		if err := runVariantCheck(strings.Split(*checkVariants, ",")); err != nil {
+			log.Fatalf("variant check failed: %v", err)
+		}
+		return
+	}
+
 	// Start the persistent C++ worker process for inference
-	if err := startWorker(); err != nil {
+	workerMutex.Lock()
+	err := startWorker()
+	workerMutex.Unlock()
+	if err != nil {
 		log.Fatalf("failed to start worker: %v", err)
 	}
 
@@ -338,6 +1041,19 @@ func main() {
 
 	// The inference endpoint remains protected by the auth middleware.
 	mux.HandleFunc("/api/analyze", authMiddleware(handleInference))
+	mux.HandleFunc("/api/embed", authMiddleware(handleEmbed))
+
+	// Secure channel endpoints, behind the same authentication.
+	mux.HandleFunc("/api/secure/open", authMiddleware(handleSecureOpen))
+	mux.HandleFunc("/api/secure/infer", authMiddleware(handleSecureInfer))
+	mux.HandleFunc("/api/secure/close", authMiddleware(handleSecureClose))
+
+	// Prometheus scrape endpoint for the backend and its worker; meant for
+	// the cluster-internal scraper, like the pod's other ports.
+	mux.HandleFunc("/metrics", handleMetrics)
+
+	// Readiness probe: ready while at least one enclave instance is warm.
+	mux.HandleFunc("/readyz", handleReady)
 
 	allowedOrigins := []string{"http://localhost:3000"}
 	if envOrigin := strings.TrimSpace(os.Getenv("ALLOWED_ORIGIN")); envOrigin != "" {
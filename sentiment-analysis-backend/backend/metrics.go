@@ -0,0 +1,65 @@
+package main
+
+import (
+	"fmt"
+	"log"
+	"net/http"
+	"strings"
+	"sync/atomic"
+)
+
+// Backend counters, exposed next to the worker's own metrics on /metrics.
+var (
+	analyzeRequests atomic.Uint64
+	analyzeFailures atomic.Uint64
+	workerStarts    atomic.Uint64
+)
+
+// handleMetrics serves the backend counters and, when the worker answers,
+// the worker and enclave metrics from a stats frame. The stats frame is
+// only sent on a scrape, so requests carry no extra work for it.
+func handleMetrics(w http.ResponseWriter, r *http.Request) {
+	var b strings.Builder
+	writeCounter(&b, "ml_backend_analyze_requests_total", "Analyze requests that reached the worker.",
+		analyzeRequests.Load())
+	writeCounter(&b, "ml_backend_analyze_failures_total", "Analyze requests the worker failed.",
+		analyzeFailures.Load())
+	writeCounter(&b, "ml_backend_worker_starts_total", "Worker processes started.", workerStarts.Load())
+
+	up := uint64(1)
+	result, err := workerRoundTrip(encodeStatsFrame)
+	if err == nil {
+		err = result.err
+	}
+	if err != nil {
+		log.Printf("worker stats unavailable: %v", err)
+		up = 0
+	}
+	fmt.Fprintf(&b, "# HELP ml_backend_worker_up Whether the worker answered the stats request.\n"+
+		"# TYPE ml_backend_worker_up gauge\nml_backend_worker_up %d\n", up)
+	if up == 1 {
+		b.WriteString(result.text)
+	}
+
+	w.Header().Set("Content-Type", "text/plain; version=0.0.4")
+	w.Write([]byte(b.String()))
+}
+
+func writeCounter(b *strings.Builder, name, help string, value uint64) {
+	fmt.Fprintf(b, "# HELP %s %s\n# TYPE %s counter\n%s %d\n", name, help, name, name, value)
+}
+
+// handleReady answers the readiness probe from a readiness frame, so a pod
+// only takes traffic once an enclave session is warm and stops while the
+// supervisor has none left. It starts the worker if it is not running.
+func handleReady(w http.ResponseWriter, r *http.Request) {
+	result, err := workerRoundTrip(encodeReadyFrame)
+	if err == nil {
+		err = result.err
+	}
+	if err != nil {
+		http.Error(w, "not ready: "+err.Error(), http.StatusServiceUnavailable)
+		return
+	}
+	fmt.Fprintf(w, "ready instances=%d\n", result.ready)
+}
@@ -0,0 +1,303 @@
+package main
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"math"
+	"os"
+	"runtime"
+	"sync/atomic"
+	"syscall"
+	"unsafe"
+)
+
+// Shared-memory transport to the worker (WORKER_TRANSPORT=shm): the same
+// binary frames as over its stdin and stdout, through two rings in a
+// segment the worker inherits as fd 3. host/shm_ring.h describes the
+// layout; the constants below must match it.
+const (
+	shmVersion                = 1
+	shmRequestControlOffset   = 64
+	shmResponseControlOffset  = 256
+	shmDataOffset             = 4096
+	shmRecordHeader           = 8
+	shmPaddingFlag            = 1 << 31
+	shmMinRingBytes           = 64 << 10
+	shmMaxRingBytes           = 1 << 30
+	shmSpins                  = 200
+	shmWaitNanos              = 100 * 1000 * 1000
+	futexWait                 = 0
+	futexWake                 = 1
+	shmControlTailOffset      = 64
+	shmControlDataSeqOffset   = 128
+	shmControlSpaceSeqOffset  = 136
+	shmControlClosedOffset    = 144
+	shmControlWaitersDistance = 4
+)
+
+var shmMagic = [8]byte{'M', 'L', 'P', 'O', 'C', 'S', 'H', 'M'}
+
+var errShmRingClosed = errors.New("shared-memory ring closed")
+
+// shmRing is one direction of the segment. Write may be called from any
+// number of goroutines; Read from one.
+type shmRing struct {
+	head, tail                  *uint64
+	dataSeq, dataWaiters        *uint32
+	spaceSeq, spaceWaiters      *uint32
+	closed                      *uint32
+	data                        []byte
+	capacity                    uint64
+	framePos, frameLeft, recLen uint64
+}
+
+func newShmRing(mem []byte, controlOffset, dataOffset, capacity uint64) *shmRing {
+	word32 := func(off uint64) *uint32 { return (*uint32)(unsafe.Pointer(&mem[controlOffset+off])) }
+	return &shmRing{
+		head:         (*uint64)(unsafe.Pointer(&mem[controlOffset])),
+		tail:         (*uint64)(unsafe.Pointer(&mem[controlOffset+shmControlTailOffset])),
+		dataSeq:      word32(shmControlDataSeqOffset),
+		dataWaiters:  word32(shmControlDataSeqOffset + shmControlWaitersDistance),
+		spaceSeq:     word32(shmControlSpaceSeqOffset),
+		spaceWaiters: word32(shmControlSpaceSeqOffset + shmControlWaitersDistance),
+		closed:       word32(shmControlClosedOffset),
+		data:         mem[dataOffset : dataOffset+capacity],
+		capacity:     capacity,
+	}
+}
+
+func (r *shmRing) recordWord(pos uint64) *uint32 {
+	return (*uint32)(unsafe.Pointer(&r.data[pos]))
+}
+
+// futex words are shared with the worker, so these are not private futexes.
+func futexSleep(word *uint32, expected uint32) {
+	timeout := syscall.Timespec{Nsec: shmWaitNanos}
+	syscall.Syscall6(syscall.SYS_FUTEX, uintptr(unsafe.Pointer(word)), futexWait, uintptr(expected),
+		uintptr(unsafe.Pointer(&timeout)), 0, 0)
+}
+
+// shmNotify bumps seq and wakes its sleepers if there are any; see notify
+// in host/shm_ring.cpp for why this cannot lose a wake.
+func shmNotify(seq, waiters *uint32) {
+	atomic.AddUint32(seq, 1)
+	if atomic.LoadUint32(waiters) > 0 {
+		syscall.Syscall6(syscall.SYS_FUTEX, uintptr(unsafe.Pointer(seq)), futexWake, math.MaxInt32, 0, 0, 0)
+	}
+}
+
+// shmWaitUntil sleeps on seq until ready holds, yielding briefly first.
+func shmWaitUntil(seq, waiters *uint32, ready func() bool) {
+	for spin := 0; spin < shmSpins; spin++ {
+		if ready() {
+			return
+		}
+		runtime.Gosched()
+	}
+	for !ready() {
+		atomic.AddUint32(waiters, 1)
+		seen := atomic.LoadUint32(seq)
+		if !ready() {
+			futexSleep(seq, seen)
+		}
+		atomic.AddUint32(waiters, ^uint32(0))
+	}
+}
+
+// close ends the stream: the reader sees io.EOF once it has drained the
+// ring and writers fail.
+func (r *shmRing) close() {
+	atomic.StoreUint32(r.closed, 1)
+	shmNotify(r.dataSeq, r.dataWaiters)
+	shmNotify(r.spaceSeq, r.spaceWaiters)
+}
+
+func (r *shmRing) isClosed() bool {
+	return atomic.LoadUint32(r.closed) != 0
+}
+
+func shmRoundUp(n uint64) uint64 {
+	return (n + shmRecordHeader - 1) / shmRecordHeader * shmRecordHeader
+}
+
+// Write copies frame, one whole frame per call, into the ring, waiting
+// while it is full.
+func (r *shmRing) Write(frame []byte) (int, error) {
+	length := uint64(len(frame))
+	recordBytes := shmRecordHeader + shmRoundUp(length)
+	if length == 0 || length > shmMaxFrameBytes(r.capacity) {
+		return 0, fmt.Errorf("frame of %d bytes does not fit the shared-memory ring", length)
+	}
+
+	var head, pos, padding uint64
+	for {
+		if r.isClosed() {
+			return 0, errShmRingClosed
+		}
+		head = atomic.LoadUint64(r.head)
+		tail := atomic.LoadUint64(r.tail)
+		pos = head % r.capacity
+		padding = 0
+		if pos+recordBytes > r.capacity {
+			padding = r.capacity - pos
+		}
+		if head+padding+recordBytes-tail > r.capacity {
+			shmWaitUntil(r.spaceSeq, r.spaceWaiters, func() bool {
+				return atomic.LoadUint64(r.head) != head ||
+					head+padding+recordBytes-atomic.LoadUint64(r.tail) <= r.capacity || r.isClosed()
+			})
+			continue
+		}
+		if atomic.CompareAndSwapUint64(r.head, head, head+padding+recordBytes) {
+			break
+		}
+	}
+
+	if padding > 0 {
+		atomic.StoreUint32(r.recordWord(pos), shmPaddingFlag|uint32(padding))
+		pos = 0
+	}
+	copy(r.data[pos+shmRecordHeader:], frame)
+	atomic.StoreUint32(r.recordWord(pos), uint32(length))
+	shmNotify(r.dataSeq, r.dataWaiters)
+	return len(frame), nil
+}
+
+// releaseRecord zeroes the record at tail and advances tail past it.
+func (r *shmRing) releaseRecord(recordBytes uint64) {
+	pos := atomic.LoadUint64(r.tail) % r.capacity
+	clear(r.data[pos : pos+recordBytes])
+	atomic.AddUint64(r.tail, recordBytes)
+	shmNotify(r.spaceSeq, r.spaceWaiters)
+}
+
+// waitForRecord waits until the record at tail is published; false once
+// the ring is closed with nothing left to read.
+func (r *shmRing) waitForRecord() (bool, error) {
+	for {
+		pos := atomic.LoadUint64(r.tail) % r.capacity
+		word := r.recordWord(pos)
+		shmWaitUntil(r.dataSeq, r.dataWaiters, func() bool {
+			return atomic.LoadUint32(word) != 0 || r.isClosed()
+		})
+		length := uint64(atomic.LoadUint32(word))
+		if length == 0 {
+			return false, nil
+		}
+		if length&shmPaddingFlag != 0 {
+			if pos+(length&^shmPaddingFlag) != r.capacity {
+				return false, errors.New("corrupt shared-memory ring padding")
+			}
+			r.releaseRecord(length &^ shmPaddingFlag)
+			continue
+		}
+		if pos+shmRecordHeader+length > r.capacity || length > r.capacity/2 {
+			return false, errors.New("corrupt shared-memory ring record")
+		}
+		r.framePos = pos + shmRecordHeader
+		r.frameLeft = length
+		r.recLen = shmRecordHeader + shmRoundUp(length)
+		return true, nil
+	}
+}
+
+// Read returns bytes of the current frame, waiting for one if needed, and
+// io.EOF once the ring is closed and drained.
+func (r *shmRing) Read(p []byte) (int, error) {
+	if len(p) == 0 {
+		return 0, nil
+	}
+	if r.frameLeft == 0 {
+		ok, err := r.waitForRecord()
+		if err != nil {
+			return 0, err
+		}
+		if !ok {
+			return 0, io.EOF
+		}
+	}
+	n := copy(p, r.data[r.framePos:r.framePos+r.frameLeft])
+	r.framePos += uint64(n)
+	r.frameLeft -= uint64(n)
+	if r.frameLeft == 0 {
+		// Released as soon as it is read, so the worker can reuse the space.
+		r.releaseRecord(r.recLen)
+	}
+	return n, nil
+}
+
+// shmSegment is a mapped segment and the file that backs it until it is
+// handed to the worker.
+type shmSegment struct {
+	mem       []byte
+	file      *os.File
+	requests  *shmRing
+	responses *shmRing
+}
+
+// shmRingCapacity is the size of a ring asked to hold ringBytes: rounded
+// up to a power of two within the supported range.
+func shmRingCapacity(ringBytes uint64) uint64 {
+	capacity := uint64(shmMinRingBytes)
+	for capacity < ringBytes && capacity < shmMaxRingBytes {
+		capacity <<= 1
+	}
+	return capacity
+}
+
+// shmMaxFrameBytes is the longest frame Write takes on a ring of capacity
+// bytes: a record may fill half of it.
+func shmMaxFrameBytes(capacity uint64) uint64 {
+	return capacity/2 - shmRecordHeader
+}
+
+// newShmSegment creates an unlinked segment with two rings of at least
+// ringBytes each (see shmRingCapacity), in /dev/shm when it exists so the
+// pages never reach a disk.
+func newShmSegment(ringBytes uint64) (*shmSegment, error) {
+	capacity := shmRingCapacity(ringBytes)
+	dir := "/dev/shm"
+	if info, err := os.Stat(dir); err != nil || !info.IsDir() {
+		dir = os.TempDir()
+	}
+	file, err := os.CreateTemp(dir, "ml-worker-shm-*")
+	if err != nil {
+		return nil, err
+	}
+	os.Remove(file.Name())
+	size := shmDataOffset + 2*capacity
+	if err := file.Truncate(int64(size)); err != nil {
+		file.Close()
+		return nil, err
+	}
+	mem, err := syscall.Mmap(int(file.Fd()), 0, int(size), syscall.PROT_READ|syscall.PROT_WRITE, syscall.MAP_SHARED)
+	if err != nil {
+		file.Close()
+		return nil, err
+	}
+	copy(mem, shmMagic[:])
+	binary.LittleEndian.PutUint32(mem[8:], shmVersion)
+	binary.LittleEndian.PutUint32(mem[12:], uint32(capacity))
+	return &shmSegment{
+		mem:       mem,
+		file:      file,
+		requests:  newShmRing(mem, shmRequestControlOffset, shmDataOffset, capacity),
+		responses: newShmRing(mem, shmResponseControlOffset, shmDataOffset+capacity, capacity),
+	}, nil
+}
+
+// closeFile drops this process's descriptor once the worker has its own.
+func (s *shmSegment) closeFile() {
+	if s.file != nil {
+		s.file.Close()
+		s.file = nil
+	}
+}
+
+// unmap releases the segment. Nothing may use the rings afterwards.
+func (s *shmSegment) unmap() {
+	s.closeFile()
+	syscall.Munmap(s.mem)
+}
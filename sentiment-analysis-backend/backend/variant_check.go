@@ -0,0 +1,151 @@
+package main
+
+import (
+	"fmt"
+	"math"
+	"sort"
+	"strings"
+	"time"
+)
+
+// Quality-vs-speed check for quantised model variants (-check-variants).
+// Every variant embeds the same sentences through its own worker. Each one
+// is then scored against the f16 model: cosine similarity of the
+// embeddings, and whether the sentiment picked with the reference
+// embeddings stays the same.
+
+var variantCheckSentences = []string{
+	"This movie was absolutely wonderful, I loved every minute of it.",
+	"The service was quick and the staff were friendly.",
+	"What a fantastic experience, I would recommend it to anyone.",
+	"The new update makes the app so much faster and easier to use.",
+	"I am really happy with how the project turned out.",
+	"The food was delicious and reasonably priced.",
+	"She gave a brilliant performance and the audience adored her.",
+	"Great value for money, it works exactly as described.",
+	"This was the worst film I have seen in years.",
+	"The package arrived late and the box was damaged.",
+	"I am disappointed with the quality, it broke after one day.",
+	"The customer support never answered my emails.",
+	"The hotel room was dirty and the air conditioning did not work.",
+	"It crashes every time I try to open a file.",
+	"The plot was boring and the acting was terrible.",
+	"I regret buying this, it is a complete waste of money.",
+}
+
+// variantWarmupAttempts covers model loading on the first request, which
+// can outlast inferenceTimeout.
+const variantWarmupAttempts = 5
+
+type variantResult struct {
+	embeddings [][]float32
+	latencies  []time.Duration
+}
+
+func embedWithVariant(variant string) (variantResult, error) {
+	workerMutex.Lock()
+	modelVariant = variant
+	err := startWorker()
+	workerMutex.Unlock()
+	if err != nil {
+		return variantResult{}, err
+	}
+	defer stopWorker()
+
+	for attempt := 1; ; attempt++ {
+		if _, err = runInference(variantCheckSentences[0]); err == nil {
+			break
+		}
+		if attempt == variantWarmupAttempts {
+			return variantResult{}, fmt.Errorf("%s: warm-up failed: %v", variant, err)
+		}
+	}
+
+	var result variantResult
+	for _, sentence := range variantCheckSentences {
+		start := time.Now()
+		embeddings, err := runInference(sentence)
+		if err != nil {
+			return variantResult{}, fmt.Errorf("%s: %v", variant, err)
+		}
+		result.latencies = append(result.latencies, time.Since(start))
+		result.embeddings = append(result.embeddings, embeddings)
+	}
+	return result, nil
+}
+
+func medianLatency(latencies []time.Duration) time.Duration {
+	sorted := append([]time.Duration(nil), latencies...)
+	sort.Slice(sorted, func(i, j int) bool { return sorted[i] < sorted[j] })
+	return sorted[len(sorted)/2]
+}
+
+// runVariantCheck prints one line per variant: median request latency,
+// mean and worst cosine similarity to the f16 embedding of the same
+// sentence, and the share of sentences whose sentiment matches f16's.
+func runVariantCheck(variants []string) error {
+	baseline, err := embedWithVariant("f16")
+	if err != nil {
+		return err
+	}
+	fmt.Printf("%-8s %10s %9s %9s %10s\n", "variant", "p50 ms", "mean cos", "min cos", "agreement")
+	for _, variant := range append([]string{"f16"}, variants...) {
+		variant = strings.TrimSpace(variant)
+		result := baseline
+		if variant != "f16" {
+			if result, err = embedWithVariant(variant); err != nil {
+				return err
+			}
+		}
+		var sumCos float64
+		minCos := 1.0
+		agree := 0
+		for i, embeddings := range result.embeddings {
+			cos := cosineSimilarity(embeddings, baseline.embeddings[i])
+			sumCos += cos
+			if cos < minCos {
+				minCos = cos
+			}
+			label, _, _ := classifySentiment(embeddings)
+			baseLabel, _, _ := classifySentiment(baseline.embeddings[i])
+			if label == baseLabel {
+				agree++
+			}
+		}
+		n := len(result.embeddings)
+		fmt.Printf("%-8s %10.2f %9.4f %9.4f %9.0f%%\n", variant,
+			float64(medianLatency(result.latencies).Microseconds())/1000, sumCos/float64(n), minCos,
+			100*float64(agree)/float64(n))
+	}
+	return nil
+}
+
+// classifySentiment labels an embedding by whichever reference embedding it
+// is closer to, and returns both similarities.
+func classifySentiment(embeddings []float32) (string, float64, float64) {
+	posSimilarity := cosineSimilarity(embeddings, positiveReferenceEmbedding)
+	negSimilarity := cosineSimilarity(embeddings, negativeReferenceEmbedding)
+	switch {
+	case posSimilarity > negSimilarity:
+		return "Positive", posSimilarity, negSimilarity
+	case negSimilarity > posSimilarity:
+		return "Negative", posSimilarity, negSimilarity
+	default:
+		return "Neutral", posSimilarity, negSimilarity
+	}
+}
+
+// cosineSimilarity is the cosine of the angle between a and b, or 0 if
+// either is all zeros.
+func cosineSimilarity(a, b []float32) float64 {
+	var dotProduct, aMag, bMag float64
+	for i := 0; i < len(a); i++ {
+		dotProduct += float64(a[i] * b[i])
+		aMag += float64(a[i] * a[i])
+		bMag += float64(b[i] * b[i])
+	}
+	if aMag == 0 || bMag == 0 {
+		return 0.0
+	}
+	return dotProduct / (math.Sqrt(aMag) * math.Sqrt(bMag))
+}
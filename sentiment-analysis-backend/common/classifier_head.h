@@ -0,0 +1,62 @@
+// openenclave_ml_poc/common/classifier_head.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <openenclave/bits/result.h>
+
+// A small classifier a session runs on its embeddings inside the enclave,
+// so a request can get back a label and a handful of scores instead of the
+// embedding itself.
+//
+// Serialized form, as the host passes it to set_enclave_ml_head: a
+// ClassifierHeadHeader, then labels x dim little-endian float32 rows, then
+// for kHeadLinear labels float32 biases. kHeadCosine rows are reference
+// embeddings and a label's score is the cosine similarity to its row;
+// kHeadLinear rows are weights and the score is row . embedding + bias. The
+// label is the best-scoring row, the first one on ties.
+
+#pragma pack(push, 1)
+struct ClassifierHeadHeader {
+    char magic[8];
+    uint32_t kind;
+    uint32_t labels;
+    uint32_t dim;
+    uint32_t reserved;
+};
+#pragma pack(pop)
+
+enum ClassifierHeadKind : uint32_t {
+    kHeadCosine = 0,
+    kHeadLinear = 1,
+};
+
+constexpr char kClassifierHeadMagic[8] = {'M', 'L', 'P', 'O', 'C', 'H', 'D', '1'};
+// Bounds what one head can make the enclave allocate from host input.
+constexpr uint32_t kMaxHeadLabels = 4096;
+constexpr uint32_t kMaxHeadDim = 8192;
+
+class ClassifierHead {
+public:
+    // Validates and copies a serialized head into enclave memory.
+    static oe_result_t parse(const uint8_t* data, size_t size, std::shared_ptr<const ClassifierHead>& head);
+
+    size_t labels() const { return labels_; }
+    size_t dim() const { return dim_; }
+
+    // Writes labels() scores for one dim()-float embedding and returns the
+    // best label.
+    uint32_t score(const float* embedding, float* scores) const;
+
+private:
+    uint32_t kind_ = kHeadCosine;
+    size_t labels_ = 0;
+    size_t dim_ = 0;
+    // Row-major labels_ x dim_; cosine rows are normalised at parse time,
+    // so scoring needs one norm per embedding rather than one per row.
+    std::vector<float> rows_;
+    std::vector<float> bias_;
+};
@@ -0,0 +1,65 @@
+// openenclave_ml_poc/common/packed_batch.h
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits a packed batch (concatenated tokens plus cumulative offsets, as
+// enclave_infer_batch and ocall_ggml_run_inference_batch take it) into
+// bert_forward_batch calls. bert.cpp pads every sequence of a call to the
+// call's longest, and its padded slots cost as many FLOPs as real tokens,
+// in attention and in the feed-forward layers alike. Evaluating the
+// sequences by length, and starting a new call whenever the next one would
+// pad the call too much, keeps the work close to the number of real tokens.
+
+// A call's padded slots (sequences x longest) stay within this factor of
+// its real tokens, unless the call holds a single sequence.
+constexpr double kMaxPaddingOverhead = 1.25;
+
+struct PackedPass {
+    // Positions [first, last) of the plan's order.
+    size_t first;
+    size_t last;
+    size_t longest;
+    size_t tokens;
+};
+
+// Orders the num_sequences sequences delimited by offsets by length (ties
+// in input order) and groups them into passes of at most max_per_pass.
+// order[i] is the input index of the i-th sequence evaluated.
+inline void plan_packed_passes(const uint64_t* offsets, size_t num_sequences, size_t max_per_pass,
+                               std::vector<size_t>& order, std::vector<PackedPass>& passes) {
+    auto length = [offsets](size_t s) { return static_cast<size_t>(offsets[s + 1] - offsets[s]); };
+    order.resize(num_sequences);
+    for (size_t s = 0; s < num_sequences; ++s) order[s] = s;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return length(a) < length(b); });
+
+    passes.clear();
+    for (size_t i = 0; i < num_sequences; ++i) {
+        size_t len = length(order[i]);
+        if (!passes.empty()) {
+            PackedPass& pass = passes.back();
+            size_t count = pass.last - pass.first;
+            // Sorted ascending, so len becomes the pass's longest.
+            if (count < max_per_pass &&
+                static_cast<double>((count + 1) * len) <= kMaxPaddingOverhead * static_cast<double>(pass.tokens + len)) {
+                pass.last = i + 1;
+                pass.longest = len;
+                pass.tokens += len;
+                continue;
+            }
+        }
+        passes.push_back(PackedPass{i, i + 1, len, len});
+    }
+}
+
+// Whether the pass's sequences keep their input order and positions, so
+// its rows can be written straight to the output.
+inline bool packed_pass_in_place(const std::vector<size_t>& order, const PackedPass& pass) {
+    for (size_t i = pass.first; i < pass.last; ++i) {
+        if (order[i] != i) return false;
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+// openenclave_ml_poc/common/reference_index.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <openenclave/bits/result.h>
+
+// A matrix of labelled reference embeddings the enclave searches for the
+// nearest neighbours of a request's embedding, so intent matching against
+// thousands of sentences returns only their IDs and similarities.
+//
+// Serialized update, as the host passes it to update_reference_index: a
+// ReferenceIndexUpdateHeader, then count uint64 IDs, then for kIndexReplace
+// and kIndexUpsert count x dim little-endian float32 rows in ID order.
+// Similarity is cosine: rows are normalised on the way in, and queries
+// before the search. kIndexReplace builds a new index from the update
+// alone, in the storage it names; kIndexUpsert adds or overwrites rows of
+// the current index, whose dim and storage it must match; kIndexRemove
+// drops the given IDs, ignoring unknown ones, and only uses count.
+
+#pragma pack(push, 1)
+struct ReferenceIndexUpdateHeader {
+    char magic[8];
+    uint32_t op;
+    uint32_t storage;
+    uint32_t dim;
+    uint32_t count;
+};
+#pragma pack(pop)
+
+enum ReferenceIndexOp : uint32_t {
+    kIndexReplace = 0,
+    kIndexUpsert = 1,
+    kIndexRemove = 2,
+};
+
+enum ReferenceIndexStorage : uint32_t {
+    kIndexF32 = 0,
+    // Symmetric int8 with one float32 scale per row: a quarter of the
+    // memory and bandwidth, at about two decimal digits of similarity.
+    kIndexI8 = 1,
+};
+
+constexpr char kReferenceIndexMagic[8] = {'M', 'L', 'P', 'O', 'C', 'I', 'X', '1'};
+// Bounds what one index can make the enclave allocate from host input.
+constexpr uint32_t kMaxIndexRows = 1u << 20;
+constexpr uint32_t kMaxIndexDim = 8192;
+// Most neighbours one query can ask for.
+constexpr uint32_t kMaxIndexTopK = 256;
+
+// Size an update with this header must have, or 0 if the header itself is
+// malformed.
+inline size_t reference_index_update_size(const ReferenceIndexUpdateHeader& header) {
+    if (header.op > kIndexRemove || header.count > kMaxIndexRows) return 0;
+    size_t ids = static_cast<size_t>(header.count) * sizeof(uint64_t);
+    if (header.op == kIndexRemove) return sizeof(header) + ids;
+    if (header.storage > kIndexI8 || header.dim == 0 || header.dim > kMaxIndexDim) return 0;
+    return sizeof(header) + ids + static_cast<size_t>(header.count) * header.dim * sizeof(float);
+}
+
+class ReferenceIndex {
+public:
+    ReferenceIndex() = default;
+    // data_ points into buffer_.
+    ReferenceIndex(const ReferenceIndex&) = delete;
+    ReferenceIndex& operator=(const ReferenceIndex&) = delete;
+
+    // Validates a serialized update and builds the index it leaves behind
+    // from current (null when there is none), which is never modified, so
+    // searches running against it are unaffected.
+    static oe_result_t apply(const std::shared_ptr<const ReferenceIndex>& current, const uint8_t* data, size_t size,
+                             std::shared_ptr<const ReferenceIndex>& updated);
+
+    size_t rows() const { return ids_.size(); }
+    size_t dim() const { return dim_; }
+
+    // Finds the k most similar rows for each of num_queries dim()-float
+    // queries, which need not be normalised. Writes min(k, rows()) IDs and
+    // similarities per query, best first (the lower row on ties), into
+    // row-major num_queries x k ids and scores, and returns that count.
+    // Rows are streamed once per block of queries rather than once per
+    // query, so a batch costs little more memory bandwidth than one search.
+    size_t search(const float* queries, size_t num_queries, size_t k, uint64_t* ids, float* scores) const;
+
+private:
+    // Bytes between rows: dim_ values rounded up to a cache line, so every
+    // row starts on one and the kernels never split a load across two.
+    size_t stride() const;
+    const uint8_t* row(size_t r) const { return data_ + r * stride(); }
+    uint8_t* row(size_t r) { return data_ + r * stride(); }
+    void allocate(size_t rows);
+    // Normalises values and stores them as row r.
+    void store(size_t r, const float* values);
+
+    uint32_t storage_ = kIndexF32;
+    size_t dim_ = 0;
+    // The matrix lives in buffer_ at the first 64-byte boundary.
+    std::vector<uint8_t> buffer_;
+    uint8_t* data_ = nullptr;
+    // Per-row dequantisation scales for kIndexI8.
+    std::vector<float> scales_;
+    std::vector<uint64_t> ids_;
+    std::unordered_map<uint64_t, size_t> rows_by_id_;
+};
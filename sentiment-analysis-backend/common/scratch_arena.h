@@ -0,0 +1,66 @@
+// openenclave_ml_poc/common/scratch_arena.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Bump allocator for per-request buffers, shared by the enclave and the
+// host. Allocations are carved out of one block and released all at once by
+// reset(). A request that outgrows the block spills into extra blocks; the
+// next reset() folds them into one block sized for that high-water mark, so
+// once a worker has seen its largest request it serves every later one
+// without touching the heap. Not thread-safe: give each thread (or each
+// compute context) its own arena.
+class ScratchArena {
+public:
+    explicit ScratchArena(size_t initial_bytes = 0) { grow_block(initial_bytes); }
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+    ScratchArena(ScratchArena&&) = default;
+    ScratchArena& operator=(ScratchArena&&) = default;
+
+    // align must not exceed alignof(std::max_align_t).
+    void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+        size_t offset = (used_ + align - 1) & ~(align - 1);
+        if (offset + bytes <= block_size_) {
+            used_ = offset + bytes;
+            return block_.get() + offset;
+        }
+        overflow_.emplace_back(new unsigned char[bytes]);
+        overflow_bytes_ += bytes;
+        return overflow_.back().get();
+    }
+
+    template <typename T>
+    T* allocate_array(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void reset() {
+        if (!overflow_.empty()) {
+            size_t high_water = used_ + overflow_bytes_ + overflow_.size() * alignof(std::max_align_t);
+            overflow_.clear();
+            overflow_bytes_ = 0;
+            grow_block(high_water);
+        }
+        used_ = 0;
+    }
+
+    size_t capacity() const { return block_size_; }
+
+private:
+    void grow_block(size_t bytes) {
+        if (bytes <= block_size_) return;
+        block_.reset(new unsigned char[bytes]);
+        block_size_ = bytes;
+    }
+
+    std::unique_ptr<unsigned char[]> block_;
+    size_t block_size_ = 0;
+    size_t used_ = 0;
+    std::vector<std::unique_ptr<unsigned char[]>> overflow_;
+    size_t overflow_bytes_ = 0;
+};
@@ -0,0 +1,58 @@
+// openenclave_ml_poc/common/session_table.h
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Handle -> session map shared by the enclave and the host. Handles come from
+// an atomic counter and sessions are spread over independently locked shards,
+// so concurrent ECALL/OCALL threads only contend when they hit the same shard,
+// and only for the duration of a lookup. Lookups hand out shared_ptr copies,
+// so a session being erased stays alive until in-flight calls drop it.
+template <typename T, size_t kShards = 16>
+class SessionTable {
+public:
+    uint64_t insert(std::shared_ptr<T> session) {
+        uint64_t handle = next_handle_.fetch_add(1, std::memory_order_relaxed);
+        Shard& s = shard(handle);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.sessions.emplace(handle, std::move(session));
+        return handle;
+    }
+
+    std::shared_ptr<T> find(uint64_t handle) const {
+        const Shard& s = shard(handle);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.sessions.find(handle);
+        return it == s.sessions.end() ? nullptr : it->second;
+    }
+
+    // Removes and returns the session, or nullptr if the handle is unknown.
+    std::shared_ptr<T> erase(uint64_t handle) {
+        Shard& s = shard(handle);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.sessions.find(handle);
+        if (it == s.sessions.end()) return nullptr;
+        std::shared_ptr<T> session = std::move(it->second);
+        s.sessions.erase(it);
+        return session;
+    }
+
+private:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<uint64_t, std::shared_ptr<T>> sessions;
+    };
+
+    Shard& shard(uint64_t handle) { return shards_[handle % kShards]; }
+    const Shard& shard(uint64_t handle) const { return shards_[handle % kShards]; }
+
+    std::array<Shard, kShards> shards_;
+    // Handle 0 is reserved as "no session".
+    std::atomic<uint64_t> next_handle_{1};
+};
@@ -0,0 +1,32 @@
+// openenclave_ml_poc/common/sha256.h
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Minimal SHA-256 used to fingerprint model files, so only the digest has to
+// cross the enclave boundary instead of the weights. Dependency-free so the
+// host and the enclave build the same code.
+class Sha256 {
+public:
+    static constexpr size_t kDigestSize = 32;
+    using Digest = std::array<unsigned char, kDigestSize>;
+
+    Sha256();
+    void update(const void* data, size_t len);
+    Digest finish();
+
+    static Digest hash(const void* data, size_t len);
+
+private:
+    void compress(const unsigned char* block);
+
+    uint32_t state_[8];
+    unsigned char block_[64];
+    size_t block_len_;
+    uint64_t total_len_;
+};
+
+std::string digest_to_hex(const unsigned char* digest, size_t size);
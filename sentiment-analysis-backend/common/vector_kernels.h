@@ -0,0 +1,87 @@
+// openenclave_ml_poc/common/vector_kernels.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+// Dot-product kernels for scoring embeddings against small matrices of
+// reference rows. They are static so every translation unit gets its own
+// copy built with its own flags: in ENCLAVE_INPROC_BERT builds the enclave
+// sources that want the AVX2 path are compiled with ENCLAVE_BERT_SIMD_FLAGS,
+// and mixing those with baseline-flag copies of one inline function would
+// be an ODR violation.
+
+static inline float dot_f32(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    // Two accumulators hide the FMA latency; 768-wide rows divide evenly.
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_movehdup_ps(half));
+    sum = _mm_cvtss_f32(half);
+#else
+    // Independent partial sums let the compiler vectorise without
+    // reassociating floating point itself.
+    float partial[4] = {0, 0, 0, 0};
+    for (; i + 4 <= n; i += 4) {
+        partial[0] += a[i] * b[i];
+        partial[1] += a[i + 1] * b[i + 1];
+        partial[2] += a[i + 2] * b[i + 2];
+        partial[3] += a[i + 3] * b[i + 3];
+    }
+    sum = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+#endif
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+// Dot product of int8 values with float32 ones, for quantised rows; the
+// caller applies the row's scale.
+static inline float dot_i8_f32(const int8_t* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(q));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(q, 8)));
+        acc0 = _mm256_fmadd_ps(lo, _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(hi, _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_movehdup_ps(half));
+    sum = _mm_cvtss_f32(half);
+#else
+    float partial[4] = {0, 0, 0, 0};
+    for (; i + 4 <= n; i += 4) {
+        partial[0] += a[i] * b[i];
+        partial[1] += a[i + 1] * b[i + 1];
+        partial[2] += a[i + 2] * b[i + 2];
+        partial[3] += a[i + 3] * b[i + 3];
+    }
+    sum = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+#endif
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+// out[r] = rows[r] . v for a row-major rows x dim matrix.
+static inline void dot_rows_f32(const float* matrix, size_t rows, size_t dim, const float* v, float* out) {
+    for (size_t r = 0; r < rows; ++r) out[r] = dot_f32(matrix + r * dim, v, dim);
+}
@@ -50,3 +50,4 @@ git submodule update --init --recursive
 cd "$ROOT_DIR" # Return to the project root
 
 echo "External dependencies downloaded and set up in ${EXTERNAL_DIR}"
+echo "After building, run 'make quantize_models' in the build directory to write the q8_0/q4_k model variants."
@@ -0,0 +1,63 @@
+// openenclave_ml_poc/enclave/classifier_head.cpp
+#include "classifier_head.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "vector_kernels.h"
+
+oe_result_t ClassifierHead::parse(const uint8_t* data, size_t size, std::shared_ptr<const ClassifierHead>& head) {
+    ClassifierHeadHeader header;
+    if (!data || size < sizeof(header)) return OE_INVALID_PARAMETER;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, kClassifierHeadMagic, sizeof(header.magic)) != 0 ||
+        (header.kind != kHeadCosine && header.kind != kHeadLinear) || header.labels == 0 ||
+        header.labels > kMaxHeadLabels || header.dim == 0 || header.dim > kMaxHeadDim) {
+        return OE_INVALID_PARAMETER;
+    }
+    size_t weights = static_cast<size_t>(header.labels) * header.dim;
+    size_t biases = header.kind == kHeadLinear ? header.labels : 0;
+    if (size != sizeof(header) + (weights + biases) * sizeof(float)) return OE_INVALID_PARAMETER;
+
+    auto parsed = std::make_shared<ClassifierHead>();
+    parsed->kind_ = header.kind;
+    parsed->labels_ = header.labels;
+    parsed->dim_ = header.dim;
+    parsed->rows_.resize(weights);
+    memcpy(parsed->rows_.data(), data + sizeof(header), weights * sizeof(float));
+    parsed->bias_.resize(biases);
+    memcpy(parsed->bias_.data(), data + sizeof(header) + weights * sizeof(float), biases * sizeof(float));
+
+    for (float value : parsed->rows_) {
+        if (!isfinite(value)) return OE_INVALID_PARAMETER;
+    }
+    for (float value : parsed->bias_) {
+        if (!isfinite(value)) return OE_INVALID_PARAMETER;
+    }
+    if (parsed->kind_ == kHeadCosine) {
+        for (size_t r = 0; r < parsed->labels_; ++r) {
+            float* row = parsed->rows_.data() + r * parsed->dim_;
+            float norm = sqrtf(dot_f32(row, row, parsed->dim_));
+            float inv = norm > 0 ? 1.0f / norm : 0.0f;
+            for (size_t i = 0; i < parsed->dim_; ++i) row[i] *= inv;
+        }
+    }
+    head = std::move(parsed);
+    return OE_OK;
+}
+
+uint32_t ClassifierHead::score(const float* embedding, float* scores) const {
+    dot_rows_f32(rows_.data(), labels_, dim_, embedding, scores);
+    if (kind_ == kHeadCosine) {
+        float norm = sqrtf(dot_f32(embedding, embedding, dim_));
+        float inv = norm > 0 ? 1.0f / norm : 0.0f;
+        for (size_t r = 0; r < labels_; ++r) scores[r] *= inv;
+    } else {
+        for (size_t r = 0; r < labels_; ++r) scores[r] += bias_[r];
+    }
+    uint32_t best = 0;
+    for (size_t r = 1; r < labels_; ++r) {
+        if (scores[r] > scores[best]) best = static_cast<uint32_t>(r);
+    }
+    return best;
+}
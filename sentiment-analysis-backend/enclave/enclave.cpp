@@ -1,12 +1,23 @@
 /* enclave/enclave.cpp - Updated with Attestation */
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
+#include <mutex>
 #include <vector>
-#include <map>
+#include <memory>
 
+#include <openenclave/advanced/allocator.h>
 #include <openenclave/bits/result.h>
 #include <openenclave/enclave.h>
+#include "classifier_head.h"
 #include "enclave_t.h"
+#include "reference_index.h"
+#include "secure_channel.h"
+#include "session_table.h"
+#ifdef ENCLAVE_INPROC_BERT
+#include "inproc_model.h"
+#include "packed_batch.h"
+#endif
 
 // --- NEW INCLUDES for Attestation ---
 #include <openenclave/attestation/attester.h>      // oe_get_evidence / oe_attester_initialize
@@ -14,14 +25,112 @@
 
 #define ENCLAVE_LOG(level, fmt, ...) printf("[" level "] [Enclave] " fmt "\n", ##__VA_ARGS__)
 
+#define ENCLAVE_MODEL_DIGEST_SIZE 32
+
 typedef struct _enclave_ml_session {
+    // 0 when the model runs inside the enclave.
     uint64_t host_ggml_session_handle;
+    // SHA-256 of the model the host was asked to load; all zero when the
+    // session was created from an in-band model copy. Never evidence of the
+    // weights in use, not even for an in-enclave model (see EnclaveModel).
+    unsigned char model_digest[ENCLAVE_MODEL_DIGEST_SIZE];
+#ifdef ENCLAVE_INPROC_BERT
+    // Set for sessions whose model was loaded into the enclave.
+    std::shared_ptr<EnclaveModel> model;
+#endif
+    // Set by set_enclave_ml_head; read and replaced only through
+    // std::atomic_load / std::atomic_store.
+    std::shared_ptr<const ClassifierHead> head;
 } enclave_ml_session_t;
 
-static std::map<uint64_t, enclave_ml_session_t> g_enclave_sessions;
-static uint64_t g_next_enclave_session_handle = 1;
+// Sessions are immutable once inserted, apart from their atomically swapped
+// head, so concurrent ECALL threads (one per TCS) can share them without
+// further locking.
+static SessionTable<enclave_ml_session_t> g_enclave_sessions;
+
+// The reference index searched by enclave_infer_topk. Like a session's head
+// it is only read and replaced through std::atomic_load / std::atomic_store;
+// updates build a new index from the current one, so they are serialised.
+static std::shared_ptr<const ReferenceIndex> g_reference_index;
+static std::mutex g_reference_index_update_mutex;
+
+// Inference counters for get_enclave_stats. Relaxed atomics: they are only
+// read for monitoring, never to order other memory accesses.
+static struct {
+    std::atomic<uint64_t> infer_calls{0};
+    std::atomic<uint64_t> sequences{0};
+    std::atomic<uint64_t> tokens{0};
+    std::atomic<uint64_t> failures{0};
+} g_enclave_counters;
+
+static oe_result_t count_inference(oe_result_t result, size_t num_sequences, size_t input_data_byte_size) {
+    g_enclave_counters.infer_calls.fetch_add(1, std::memory_order_relaxed);
+    if (result == OE_OK) {
+        g_enclave_counters.sequences.fetch_add(num_sequences, std::memory_order_relaxed);
+        g_enclave_counters.tokens.fetch_add(input_data_byte_size / sizeof(int64_t), std::memory_order_relaxed);
+    } else {
+        g_enclave_counters.failures.fetch_add(1, std::memory_order_relaxed);
+    }
+    return result;
+}
+
+#ifdef ENCLAVE_INPROC_BERT
+// Runs the sequences delimited by sequence_offsets through the in-enclave
+// model, writing a row-major num_sequences x n_embd matrix to output.
+static oe_result_t infer_in_enclave(
+    EnclaveModel& model,
+    const int64_t* input_data,
+    const uint64_t* sequence_offsets,
+    size_t num_sequences,
+    float* output,
+    size_t output_size_bytes,
+    size_t* actual_output_size_bytes_out) {
+
+    size_t n_embd = static_cast<size_t>(model.n_embd());
+    size_t required = num_sequences * n_embd * sizeof(float);
+    *actual_output_size_bytes_out = required;
+    if (required > output_size_bytes) return OE_BUFFER_TOO_SMALL;
+
+    size_t max_tokens = static_cast<size_t>(model.n_max_tokens());
+    for (size_t s = 0; s < num_sequences; ++s) {
+        if (sequence_offsets[s + 1] - sequence_offsets[s] > max_tokens) return OE_INVALID_PARAMETER;
+    }
+
+    EnclaveModel::Lease ctx = model.acquire();
+    if (num_sequences == 1) {
+        bert_tokens& tokens = ctx.tokens();
+        tokens.assign(input_data, input_data + sequence_offsets[1]);
+        bert_forward(ctx.get(), tokens, output, 1);
+        return OE_OK;
+    }
+    // Contexts here are all sized for the model's maximum, so ordering by
+    // length saves the padded FLOPs but not compute-buffer memory.
+    thread_local std::vector<size_t> order;
+    thread_local std::vector<PackedPass> passes;
+    plan_packed_passes(sequence_offsets, num_sequences, ENCLAVE_INPROC_MAX_BATCH, order, passes);
+    for (const PackedPass& pass : passes) {
+        bert_batch& batch = ctx.batch();
+        batch.resize(pass.last - pass.first);
+        for (size_t i = pass.first; i < pass.last; ++i) {
+            size_t s = order[i];
+            batch[i - pass.first].assign(input_data + sequence_offsets[s], input_data + sequence_offsets[s + 1]);
+        }
+        if (packed_pass_in_place(order, pass)) {
+            bert_forward_batch(ctx.get(), batch, output + pass.first * n_embd, 1);
+            continue;
+        }
+        std::vector<float>& rows = ctx.rows();
+        rows.resize(batch.size() * n_embd);
+        bert_forward_batch(ctx.get(), batch, rows.data(), 1);
+        for (size_t i = pass.first; i < pass.last; ++i) {
+            memcpy(output + order[i] * n_embd, rows.data() + (i - pass.first) * n_embd, n_embd * sizeof(float));
+        }
+    }
+    return OE_OK;
+}
+#endif
 
-// --- Existing Functions (Unchanged) ---
+// --- Model sessions, inference and heads ---
 
 oe_result_t initialize_enclave_ml_context(
     const unsigned char* model_data,
@@ -50,15 +159,69 @@ oe_result_t initialize_enclave_ml_context(
     if (host_return_value != OE_OK) return host_return_value;
     if (host_session_handle == 0) return OE_UNEXPECTED;
 
-    enclave_ml_session_t new_session = {host_session_handle};
-    uint64_t current_enclave_handle = g_next_enclave_session_handle++;
-    g_enclave_sessions[current_enclave_handle] = new_session;
-    *enclave_session_handle_out = current_enclave_handle;
+    auto new_session = std::make_shared<enclave_ml_session_t>();
+    new_session->host_ggml_session_handle = host_session_handle;
+    *enclave_session_handle_out = g_enclave_sessions.insert(std::move(new_session));
 
     return OE_OK;
 }
 
-oe_result_t enclave_infer(
+oe_result_t initialize_enclave_ml_context_by_ref(
+    const char* model_id,
+    const unsigned char* model_digest,
+    size_t model_digest_size,
+    uint64_t* enclave_session_handle_out) {
+
+    if (!model_id || model_id[0] == '\0' || !model_digest ||
+        model_digest_size != ENCLAVE_MODEL_DIGEST_SIZE || !enclave_session_handle_out) {
+        return OE_INVALID_PARAMETER;
+    }
+
+#ifdef ENCLAVE_INPROC_BERT
+    // Load and run the model here instead of in the host; one context per
+    // TCS at most, since each ECALL thread runs one forward pass at a time.
+    {
+        Sha256::Digest digest;
+        memcpy(digest.data(), model_digest, digest.size());
+        oe_result_t load_result = OE_FAILURE;
+        auto new_session = std::make_shared<enclave_ml_session_t>();
+        new_session->host_ggml_session_handle = 0;
+        new_session->model = get_or_load_enclave_model(model_id, digest, ENCLAVE_NUM_TCS, &load_result);
+        if (!new_session->model) return load_result;
+        memcpy(new_session->model_digest, model_digest, ENCLAVE_MODEL_DIGEST_SIZE);
+        *enclave_session_handle_out = g_enclave_sessions.insert(std::move(new_session));
+        return OE_OK;
+    }
+#endif
+
+    oe_result_t ocall_status;
+    oe_result_t ocall_retval = OE_FAILURE;
+    oe_result_t ocall_host_ret = OE_FAILURE;
+    oe_result_t host_return_value = OE_FAILURE;
+    uint64_t host_session_handle = 0;
+
+    ocall_status = ocall_ggml_load_model_by_ref(
+        &ocall_retval,
+        &ocall_host_ret,
+        &host_return_value,
+        &host_session_handle,
+        model_id,
+        model_digest,
+        model_digest_size);
+    if (ocall_status != OE_OK) return ocall_status;
+    if (ocall_host_ret != OE_OK) return ocall_host_ret;
+    if (host_return_value != OE_OK) return host_return_value;
+    if (host_session_handle == 0) return OE_UNEXPECTED;
+
+    auto new_session = std::make_shared<enclave_ml_session_t>();
+    new_session->host_ggml_session_handle = host_session_handle;
+    memcpy(new_session->model_digest, model_digest, ENCLAVE_MODEL_DIGEST_SIZE);
+    *enclave_session_handle_out = g_enclave_sessions.insert(std::move(new_session));
+
+    return OE_OK;
+}
+
+static oe_result_t run_enclave_infer(
     uint64_t enclave_session_handle,
     const int64_t* input_data,
     size_t input_data_byte_size,
@@ -70,12 +233,20 @@ oe_result_t enclave_infer(
         return OE_INVALID_PARAMETER;
     }
 
-    auto it = g_enclave_sessions.find(enclave_session_handle);
-    if (it == g_enclave_sessions.end()) {
+    std::shared_ptr<enclave_ml_session_t> session = g_enclave_sessions.find(enclave_session_handle);
+    if (!session) {
         return OE_NOT_FOUND;
     }
 
-    enclave_ml_session_t* session = &it->second;
+#ifdef ENCLAVE_INPROC_BERT
+    if (session->model) {
+        if (input_data_byte_size % sizeof(int64_t) != 0) return OE_INVALID_PARAMETER;
+        const uint64_t sequence_offsets[2] = {0, input_data_byte_size / sizeof(int64_t)};
+        return infer_in_enclave(*session->model, input_data, sequence_offsets, 1,
+                                output_buffer, output_buffer_size_bytes, actual_output_size_bytes_out);
+    }
+#endif
+
     oe_result_t ocall_status;
     oe_result_t ocall_retval = OE_FAILURE;
     oe_result_t ocall_host_ret = OE_FAILURE;
@@ -98,17 +269,115 @@ oe_result_t enclave_infer(
     return OE_OK;
 }
 
+static oe_result_t run_enclave_infer_batch(
+    uint64_t enclave_session_handle,
+    const int64_t* input_data,
+    size_t input_data_byte_size,
+    const uint64_t* sequence_offsets,
+    size_t offset_count,
+    float* output_buffer,
+    size_t output_buffer_size_bytes,
+    size_t* actual_output_size_bytes_out) {
+
+    if (!input_data || input_data_byte_size == 0 || !sequence_offsets || offset_count < 2 ||
+        !output_buffer || output_buffer_size_bytes == 0 || !actual_output_size_bytes_out ||
+        enclave_session_handle == 0) {
+        return OE_INVALID_PARAMETER;
+    }
+
+    // The offsets come from the untrusted host; check they describe the
+    // token buffer exactly before handing them back out.
+    size_t num_tokens = input_data_byte_size / sizeof(int64_t);
+    if (input_data_byte_size % sizeof(int64_t) != 0 || sequence_offsets[0] != 0 ||
+        sequence_offsets[offset_count - 1] != num_tokens) {
+        return OE_INVALID_PARAMETER;
+    }
+    for (size_t i = 1; i < offset_count; ++i) {
+        if (sequence_offsets[i] <= sequence_offsets[i - 1]) {
+            return OE_INVALID_PARAMETER;
+        }
+    }
+
+    std::shared_ptr<enclave_ml_session_t> session = g_enclave_sessions.find(enclave_session_handle);
+    if (!session) {
+        return OE_NOT_FOUND;
+    }
+
+#ifdef ENCLAVE_INPROC_BERT
+    if (session->model) {
+        return infer_in_enclave(*session->model, input_data, sequence_offsets, offset_count - 1,
+                                output_buffer, output_buffer_size_bytes, actual_output_size_bytes_out);
+    }
+#endif
+
+    oe_result_t ocall_status;
+    oe_result_t ocall_retval = OE_FAILURE;
+    oe_result_t ocall_host_ret = OE_FAILURE;
+    oe_result_t host_return_value = OE_FAILURE;
+
+    ocall_status = ocall_ggml_run_inference_batch(
+        &ocall_retval,
+        &ocall_host_ret,
+        &host_return_value,
+        session->host_ggml_session_handle,
+        input_data,
+        input_data_byte_size,
+        sequence_offsets,
+        offset_count,
+        output_buffer,
+        output_buffer_size_bytes,
+        actual_output_size_bytes_out);
+    if (ocall_status != OE_OK) return ocall_status;
+    if (ocall_host_ret != OE_OK) return ocall_host_ret;
+    if (host_return_value != OE_OK) return host_return_value;
+    if (*actual_output_size_bytes_out > output_buffer_size_bytes) return OE_BUFFER_TOO_SMALL;
+
+    return OE_OK;
+}
+
+oe_result_t enclave_infer(
+    uint64_t enclave_session_handle,
+    const int64_t* input_data,
+    size_t input_data_byte_size,
+    float* output_buffer,
+    size_t output_buffer_size_bytes,
+    size_t* actual_output_size_bytes_out) {
+    oe_result_t result = run_enclave_infer(enclave_session_handle, input_data, input_data_byte_size,
+                                           output_buffer, output_buffer_size_bytes, actual_output_size_bytes_out);
+    return count_inference(result, 1, input_data_byte_size);
+}
+
+oe_result_t enclave_infer_batch(
+    uint64_t enclave_session_handle,
+    const int64_t* input_data,
+    size_t input_data_byte_size,
+    const uint64_t* sequence_offsets,
+    size_t offset_count,
+    float* output_buffer,
+    size_t output_buffer_size_bytes,
+    size_t* actual_output_size_bytes_out) {
+    oe_result_t result = run_enclave_infer_batch(enclave_session_handle, input_data, input_data_byte_size,
+                                                 sequence_offsets, offset_count, output_buffer,
+                                                 output_buffer_size_bytes, actual_output_size_bytes_out);
+    return count_inference(result, offset_count > 0 ? offset_count - 1 : 0, input_data_byte_size);
+}
+
 oe_result_t terminate_enclave_ml_context(uint64_t enclave_session_handle) {
     if (enclave_session_handle == 0) {
         return OE_INVALID_PARAMETER;
     }
 
-    auto it = g_enclave_sessions.find(enclave_session_handle);
-    if (it == g_enclave_sessions.end()) {
+    // Erase before releasing the host side so no other thread can start
+    // using a session whose host context is going away.
+    std::shared_ptr<enclave_ml_session_t> session = g_enclave_sessions.erase(enclave_session_handle);
+    if (!session) {
         return OE_NOT_FOUND;
     }
+    // In-enclave models are freed with their last session.
+    if (session->host_ggml_session_handle == 0) {
+        return OE_OK;
+    }
 
-    enclave_ml_session_t* session = &it->second;
     oe_result_t ocall_status;
     oe_result_t ocall_retval = OE_FAILURE;
     oe_result_t ocall_host_ret = OE_FAILURE;
@@ -120,8 +389,6 @@ oe_result_t terminate_enclave_ml_context(uint64_t enclave_session_handle) {
         &host_return_value,
         session->host_ggml_session_handle);
 
-    g_enclave_sessions.erase(it);
-
     if (ocall_status != OE_OK) return ocall_status;
     if (ocall_host_ret != OE_OK) return ocall_host_ret;
     if (host_return_value != OE_OK) return host_return_value;
@@ -129,11 +396,201 @@ oe_result_t terminate_enclave_ml_context(uint64_t enclave_session_handle) {
     return OE_OK;
 }
 
-// --- NEW ATTESTATION FUNCTION ---
-bool get_attestation_evidence(unsigned char** evidence_buffer, size_t* evidence_size)
+oe_result_t get_enclave_ml_embedding_dim(uint64_t enclave_session_handle, uint64_t* n_embd_out) {
+    if (enclave_session_handle == 0 || !n_embd_out) {
+        return OE_INVALID_PARAMETER;
+    }
+
+    std::shared_ptr<enclave_ml_session_t> session = g_enclave_sessions.find(enclave_session_handle);
+    if (!session) {
+        return OE_NOT_FOUND;
+    }
+#ifdef ENCLAVE_INPROC_BERT
+    if (session->model) {
+        *n_embd_out = static_cast<uint64_t>(session->model->n_embd());
+        return OE_OK;
+    }
+#endif
+    // Host-backed sessions: the host loaded the model and already knows.
+    return OE_UNSUPPORTED;
+}
+
+oe_result_t set_enclave_ml_head(uint64_t enclave_session_handle, const uint8_t* head_data, size_t head_size) {
+    if (enclave_session_handle == 0) return OE_INVALID_PARAMETER;
+    std::shared_ptr<enclave_ml_session_t> session = g_enclave_sessions.find(enclave_session_handle);
+    if (!session) return OE_NOT_FOUND;
+
+    std::shared_ptr<const ClassifierHead> head;
+    if (head_size > 0) {
+        oe_result_t result = ClassifierHead::parse(head_data, head_size, head);
+        if (result != OE_OK) return result;
+#ifdef ENCLAVE_INPROC_BERT
+        // Host-backed sessions are checked on every call instead, since
+        // only the host knows their embedding size.
+        if (session->model && head->dim() != static_cast<size_t>(session->model->n_embd())) {
+            return OE_INVALID_PARAMETER;
+        }
+#endif
+    }
+    std::atomic_store(&session->head, head);
+    return OE_OK;
+}
+
+static oe_result_t run_enclave_classify(
+    uint64_t enclave_session_handle,
+    const int64_t* input_data,
+    size_t input_data_byte_size,
+    const uint64_t* sequence_offsets,
+    size_t offset_count,
+    uint32_t* labels,
+    size_t label_count,
+    float* scores,
+    size_t score_count,
+    uint32_t* n_labels_out) {
+
+    if (!labels || !scores || !n_labels_out || offset_count < 2 || enclave_session_handle == 0) {
+        return OE_INVALID_PARAMETER;
+    }
+    std::shared_ptr<enclave_ml_session_t> session = g_enclave_sessions.find(enclave_session_handle);
+    if (!session) return OE_NOT_FOUND;
+    std::shared_ptr<const ClassifierHead> head = std::atomic_load(&session->head);
+    if (!head) return OE_UNSUPPORTED;
+
+    size_t num_sequences = offset_count - 1;
+    *n_labels_out = static_cast<uint32_t>(head->labels());
+    if (label_count < num_sequences || score_count < num_sequences * head->labels()) return OE_BUFFER_TOO_SMALL;
+
+    // The embeddings land in enclave memory, even from a host-backed
+    // session's OCALL, and never leave it. Reused by every call on the TCS.
+    thread_local std::vector<float> embeddings;
+    embeddings.resize(num_sequences * head->dim());
+    size_t actual_output_size_bytes = 0;
+    oe_result_t result = run_enclave_infer_batch(enclave_session_handle, input_data, input_data_byte_size,
+                                                 sequence_offsets, offset_count, embeddings.data(),
+                                                 embeddings.size() * sizeof(float), &actual_output_size_bytes);
+    if (result == OE_BUFFER_TOO_SMALL) return OE_INVALID_PARAMETER;
+    if (result != OE_OK) return result;
+    if (actual_output_size_bytes != embeddings.size() * sizeof(float)) return OE_INVALID_PARAMETER;
+
+    for (size_t s = 0; s < num_sequences; ++s) {
+        labels[s] = head->score(embeddings.data() + s * head->dim(), scores + s * head->labels());
+    }
+    return OE_OK;
+}
+
+oe_result_t enclave_classify(
+    uint64_t enclave_session_handle,
+    const int64_t* input_data,
+    size_t input_data_byte_size,
+    const uint64_t* sequence_offsets,
+    size_t offset_count,
+    uint32_t* labels,
+    size_t label_count,
+    float* scores,
+    size_t score_count,
+    uint32_t* n_labels_out) {
+    oe_result_t result = run_enclave_classify(enclave_session_handle, input_data, input_data_byte_size,
+                                              sequence_offsets, offset_count, labels, label_count, scores,
+                                              score_count, n_labels_out);
+    return count_inference(result, offset_count > 0 ? offset_count - 1 : 0, input_data_byte_size);
+}
+
+oe_result_t update_reference_index(const uint8_t* update, size_t update_size, uint64_t* rows_out) {
+    if (!rows_out) return OE_INVALID_PARAMETER;
+    std::lock_guard<std::mutex> lock(g_reference_index_update_mutex);
+    std::shared_ptr<const ReferenceIndex> updated;
+    oe_result_t result = ReferenceIndex::apply(std::atomic_load(&g_reference_index), update, update_size, updated);
+    if (result != OE_OK) return result;
+    *rows_out = updated->rows();
+    std::atomic_store(&g_reference_index, updated);
+    return OE_OK;
+}
+
+static oe_result_t run_enclave_infer_topk(
+    uint64_t enclave_session_handle,
+    const int64_t* input_data,
+    size_t input_data_byte_size,
+    const uint64_t* sequence_offsets,
+    size_t offset_count,
+    uint32_t k,
+    uint64_t* ids,
+    float* scores,
+    size_t result_capacity,
+    uint32_t* result_count_out) {
+
+    if (!ids || !scores || !result_count_out || offset_count < 2 || k == 0 || k > kMaxIndexTopK) {
+        return OE_INVALID_PARAMETER;
+    }
+    std::shared_ptr<const ReferenceIndex> index = std::atomic_load(&g_reference_index);
+    if (!index || index->rows() == 0) return OE_UNSUPPORTED;
+
+    size_t num_sequences = offset_count - 1;
+    if (result_capacity < num_sequences * k) return OE_BUFFER_TOO_SMALL;
+
+    // As in run_enclave_classify, the embeddings never leave the enclave.
+    thread_local std::vector<float> embeddings;
+    embeddings.resize(num_sequences * index->dim());
+    size_t actual_output_size_bytes = 0;
+    oe_result_t result = run_enclave_infer_batch(enclave_session_handle, input_data, input_data_byte_size,
+                                                 sequence_offsets, offset_count, embeddings.data(),
+                                                 embeddings.size() * sizeof(float), &actual_output_size_bytes);
+    // A model whose embeddings are not index->dim() wide.
+    if (result == OE_BUFFER_TOO_SMALL) return OE_INVALID_PARAMETER;
+    if (result != OE_OK) return result;
+    if (actual_output_size_bytes != embeddings.size() * sizeof(float)) return OE_INVALID_PARAMETER;
+
+    *result_count_out = static_cast<uint32_t>(index->search(embeddings.data(), num_sequences, k, ids, scores));
+    return OE_OK;
+}
+
+oe_result_t enclave_infer_topk(
+    uint64_t enclave_session_handle,
+    const int64_t* input_data,
+    size_t input_data_byte_size,
+    const uint64_t* sequence_offsets,
+    size_t offset_count,
+    uint32_t k,
+    uint64_t* ids,
+    float* scores,
+    size_t result_capacity,
+    uint32_t* result_count_out) {
+    oe_result_t result = run_enclave_infer_topk(enclave_session_handle, input_data, input_data_byte_size,
+                                                sequence_offsets, offset_count, k, ids, scores, result_capacity,
+                                                result_count_out);
+    return count_inference(result, offset_count > 0 ? offset_count - 1 : 0, input_data_byte_size);
+}
+
+oe_result_t get_enclave_stats(enclave_stats_t* stats) {
+    if (!stats) return OE_INVALID_PARAMETER;
+    memset(stats, 0, sizeof(*stats));
+    stats->infer_calls = g_enclave_counters.infer_calls.load(std::memory_order_relaxed);
+    stats->sequences = g_enclave_counters.sequences.load(std::memory_order_relaxed);
+    stats->tokens = g_enclave_counters.tokens.load(std::memory_order_relaxed);
+    stats->failures = g_enclave_counters.failures.load(std::memory_order_relaxed);
+    oe_mallinfo_t info;
+    if (oe_allocator_mallinfo(&info) == OE_OK) {
+        stats->heap_limit_bytes = info.max_total_heap_size;
+        stats->heap_used_bytes = info.current_allocated_heap_size;
+        stats->heap_peak_bytes = info.peak_allocated_heap_size;
+    }
+    return OE_OK;
+}
+
+oe_result_t enclave_ping(uint64_t ocall_count) {
+    for (uint64_t i = 0; i < ocall_count; ++i) {
+        oe_result_t result = ocall_ping();
+        if (result != OE_OK) return result;
+    }
+    return OE_OK;
+}
+
+// Evidence in the preferred format with the given custom claims, copied to
+// host memory the caller frees.
+static oe_result_t produce_evidence(const uint8_t* claims, size_t claims_size,
+                                    unsigned char** evidence_buffer, size_t* evidence_size)
 {
     if (!evidence_buffer || !evidence_size)
-        return false;
+        return OE_INVALID_PARAMETER;
 
     *evidence_buffer = nullptr;
     *evidence_size   = 0;
@@ -141,7 +598,7 @@ bool get_attestation_evidence(unsigned char** evidence_buffer, size_t* evidence_
     // Initialize attester (idempotent on OE 0.19)
     oe_result_t r = oe_attester_initialize();
     if (r != OE_OK)
-        return false;
+        return r;
 
     // Prefer ECDSA DCAP; fall back to LOCAL (works in simulation)
     const oe_uuid_t preferred[] = {
@@ -151,26 +608,26 @@ bool get_attestation_evidence(unsigned char** evidence_buffer, size_t* evidence_
     oe_uuid_t selected{};
     r = oe_attester_select_format(preferred, sizeof(preferred)/sizeof(preferred[0]), &selected);
     if (r != OE_OK)
-        return false;
+        return r;
 
     // Get evidence into ENCLAVE memory
     unsigned char* enc_buf = nullptr;
     size_t enc_sz = 0;
     r = oe_get_evidence(&selected,
                         0,
-                        nullptr, 0,        // no custom claims
+                        claims, claims_size, // custom claims, hashed into the report data
                         nullptr, 0,        // no endorsements in
                         &enc_buf, &enc_sz, // OUT: enclave-allocated
                         nullptr, nullptr); // no endorsements out
     if (r != OE_OK)
-        return false;
+        return r;
 
     // Allocate HOST memory and copy evidence out
     unsigned char* host_buf = (unsigned char*)oe_host_malloc(enc_sz);
     if (!host_buf)
     {
         oe_free_evidence(enc_buf);  // free enclave memory before returning
-        return false;
+        return OE_OUT_OF_MEMORY;
     }
 
     // It’s OK for enclave to write to host memory
@@ -179,5 +636,160 @@ bool get_attestation_evidence(unsigned char** evidence_buffer, size_t* evidence_
 
     *evidence_buffer = host_buf;    // host owns this pointer
     *evidence_size   = enc_sz;
-    return true;
+    return OE_OK;
+}
+
+// --- NEW ATTESTATION FUNCTION ---
+bool get_attestation_evidence(unsigned char** evidence_buffer, size_t* evidence_size)
+{
+    return produce_evidence(nullptr, 0, evidence_buffer, evidence_size) == OE_OK;
+}
+
+oe_result_t get_attestation_evidence_with_claims(const uint8_t* claims, size_t claims_size,
+                                                 unsigned char** evidence_buffer, size_t* evidence_size)
+{
+    if (!claims || claims_size == 0)
+        return OE_INVALID_PARAMETER;
+    return produce_evidence(claims, claims_size, evidence_buffer, evidence_size);
+}
+
+// --- Secure channel (see secure_channel.h) ---
+
+oe_result_t open_secure_channel(const uint8_t* client_public_key, size_t client_public_key_size,
+                                uint8_t* enclave_public_key, size_t enclave_public_key_size,
+                                unsigned char** evidence_buffer, size_t* evidence_size, uint64_t* channel_id)
+{
+    if (!enclave_public_key || enclave_public_key_size != kChannelPublicKeyBytes || !evidence_buffer ||
+        !evidence_size || !channel_id)
+        return OE_INVALID_PARAMETER;
+
+    std::vector<uint8_t> claims;
+    oe_result_t r = open_secure_channel_keys(client_public_key, client_public_key_size, enclave_public_key,
+                                             claims, channel_id);
+    if (r != OE_OK)
+        return r;
+    r = produce_evidence(claims.data(), claims.size(), evidence_buffer, evidence_size);
+    if (r != OE_OK)
+        close_secure_channel_keys(*channel_id);
+    return r;
+}
+
+oe_result_t close_secure_channel(uint64_t channel_id)
+{
+    return close_secure_channel_keys(channel_id);
+}
+
+// Opens, runs and seals the messages delimited by message_offsets, each
+// into its fixed-size slot of output_buffer. A message that fails to
+// authenticate or is too long gets its own status and no output instead of
+// failing the call: the others have consumed their sequence numbers by
+// then, so the host could not retry them.
+static oe_result_t run_enclave_infer_secure(
+    uint64_t enclave_session_handle,
+    const uint8_t* messages,
+    size_t messages_size,
+    const uint64_t* message_offsets,
+    size_t offset_count,
+    uint8_t* output_buffer,
+    size_t output_buffer_size_bytes,
+    size_t* actual_output_size_bytes_out,
+    uint32_t* message_status,
+    size_t* num_tokens_out) {
+
+    if (!messages || messages_size == 0 || !message_offsets || offset_count < 2 || !output_buffer ||
+        !actual_output_size_bytes_out || !message_status || enclave_session_handle == 0) {
+        return OE_INVALID_PARAMETER;
+    }
+    if (message_offsets[0] != 0 || message_offsets[offset_count - 1] != messages_size) {
+        return OE_INVALID_PARAMETER;
+    }
+    for (size_t i = 1; i < offset_count; ++i) {
+        if (message_offsets[i] <= message_offsets[i - 1]) {
+            return OE_INVALID_PARAMETER;
+        }
+    }
+
+    std::shared_ptr<enclave_ml_session_t> session = g_enclave_sessions.find(enclave_session_handle);
+    if (!session) {
+        return OE_NOT_FOUND;
+    }
+
+#ifdef ENCLAVE_INPROC_BERT
+    if (session->model) {
+        size_t num_messages = offset_count - 1;
+        size_t n_embd = static_cast<size_t>(session->model->n_embd());
+        size_t sealed_size = n_embd * sizeof(float) + kSecureMessageOverhead;
+        *actual_output_size_bytes_out = num_messages * sealed_size;
+        if (*actual_output_size_bytes_out > output_buffer_size_bytes) return OE_BUFFER_TOO_SMALL;
+
+        size_t max_tokens = static_cast<size_t>(session->model->n_max_tokens());
+        std::vector<SecureRequest> requests(num_messages);
+        std::vector<size_t> opened;
+        std::vector<int64_t> tokens;
+        std::vector<uint64_t> sequence_offsets(1, 0);
+        for (size_t i = 0; i < num_messages; ++i) {
+            oe_result_t r = open_secure_request(messages + message_offsets[i],
+                                                message_offsets[i + 1] - message_offsets[i], requests[i]);
+            if (r == OE_OK && requests[i].tokens.size() > max_tokens) r = OE_INVALID_PARAMETER;
+            message_status[i] = r;
+            if (r != OE_OK) continue;
+            opened.push_back(i);
+            tokens.insert(tokens.end(), requests[i].tokens.begin(), requests[i].tokens.end());
+            sequence_offsets.push_back(tokens.size());
+        }
+        *num_tokens_out = tokens.size();
+        if (opened.empty()) return OE_OK;
+
+        std::vector<float> embeddings(opened.size() * n_embd);
+        size_t embeddings_size = 0;
+        oe_result_t r = infer_in_enclave(*session->model, tokens.data(), sequence_offsets.data(), opened.size(),
+                                         embeddings.data(), embeddings.size() * sizeof(float), &embeddings_size);
+        if (r != OE_OK) return r;
+        for (size_t k = 0; k < opened.size(); ++k) {
+            size_t i = opened[k];
+            message_status[i] = seal_secure_response(requests[i], embeddings.data() + k * n_embd, n_embd,
+                                                     output_buffer + i * sealed_size, sealed_size);
+        }
+        return OE_OK;
+    }
+#endif
+    (void)output_buffer_size_bytes;
+    (void)num_tokens_out;
+    return OE_UNSUPPORTED;
+}
+
+oe_result_t enclave_infer_secure(
+    uint64_t enclave_session_handle,
+    const uint8_t* message,
+    size_t message_size,
+    uint8_t* output_buffer,
+    size_t output_buffer_size_bytes,
+    size_t* actual_output_size_bytes_out) {
+    const uint64_t message_offsets[2] = {0, message_size};
+    uint32_t message_status = OE_FAILURE;
+    size_t num_tokens = 0;
+    oe_result_t result = run_enclave_infer_secure(enclave_session_handle, message, message_size, message_offsets, 2,
+                                                  output_buffer, output_buffer_size_bytes,
+                                                  actual_output_size_bytes_out, &message_status, &num_tokens);
+    if (result == OE_OK) result = static_cast<oe_result_t>(message_status);
+    return count_inference(result, 1, num_tokens * sizeof(int64_t));
+}
+
+oe_result_t enclave_infer_secure_batch(
+    uint64_t enclave_session_handle,
+    const uint8_t* messages,
+    size_t messages_size,
+    const uint64_t* message_offsets,
+    size_t offset_count,
+    uint8_t* output_buffer,
+    size_t output_buffer_size_bytes,
+    size_t* actual_output_size_bytes_out,
+    uint32_t* message_status,
+    size_t message_count) {
+    if (message_count + 1 != offset_count) return OE_INVALID_PARAMETER;
+    size_t num_tokens = 0;
+    oe_result_t result = run_enclave_infer_secure(enclave_session_handle, messages, messages_size, message_offsets,
+                                                  offset_count, output_buffer, output_buffer_size_bytes,
+                                                  actual_output_size_bytes_out, message_status, &num_tokens);
+    return count_inference(result, message_count, num_tokens * sizeof(int64_t));
 }
@@ -0,0 +1,178 @@
+// openenclave_ml_poc/enclave/inproc_model.cpp
+#include "inproc_model.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <algorithm>
+#include <cstdint>
+
+#include <openenclave/enclave.h>
+#include <openenclave/advanced/allocator.h>
+
+#define ENCLAVE_LOG(level, fmt, ...) printf("[" level "] [Enclave] " fmt "\n", ##__VA_ARGS__)
+
+// Heap left free after growing a pool, for per-call allocations (token
+// vectors, bert_forward temporaries) on every TCS.
+static const size_t kHeapHeadroomBytes = 32u << 20;
+
+// Makes host files readable through stdio. Read-only: the enclave never
+// writes to the host file system.
+static oe_result_t mount_host_file_system() {
+    static std::mutex mount_mutex;
+    static bool mounted = false;
+    std::lock_guard<std::mutex> lock(mount_mutex);
+    if (mounted) return OE_OK;
+    oe_result_t result = oe_load_module_host_file_system();
+    if (result != OE_OK) return result;
+    if (mount("/", "/", OE_HOST_FILE_SYSTEM, MS_RDONLY, NULL) != 0) return OE_FAILURE;
+    mounted = true;
+    return OE_OK;
+}
+
+static bool file_digest(const std::string& path, Sha256::Digest& digest) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    Sha256 sha;
+    std::vector<unsigned char> chunk(1u << 20);
+    size_t n;
+    while ((n = fread(chunk.data(), 1, chunk.size(), file)) > 0) sha.update(chunk.data(), n);
+    bool ok = !ferror(file);
+    fclose(file);
+    if (ok) digest = sha.finish();
+    return ok;
+}
+
+// Free enclave heap in bytes, or 0 if the allocator can't tell, which stops
+// the pool from growing past its first context.
+static size_t heap_available() {
+    oe_mallinfo_t info;
+    if (oe_allocator_mallinfo(&info) != OE_OK || info.current_allocated_heap_size > info.max_total_heap_size)
+        return 0;
+    return info.max_total_heap_size - info.current_allocated_heap_size;
+}
+
+static size_t heap_allocated() {
+    oe_mallinfo_t info;
+    if (oe_allocator_mallinfo(&info) != OE_OK) return 0;
+    return info.current_allocated_heap_size;
+}
+
+EnclaveModel::EnclaveModel(const std::string& path, size_t max_contexts)
+    : path_(path), max_contexts_(std::max<size_t>(1, max_contexts)) {}
+
+EnclaveModel::~EnclaveModel() {
+    for (const std::unique_ptr<ComputeContext>& ctx : all_) bert_free(ctx->ctx);
+}
+
+std::shared_ptr<EnclaveModel> EnclaveModel::load(
+    const std::string& path, const Sha256::Digest& digest, size_t max_contexts, oe_result_t* result) {
+    *result = mount_host_file_system();
+    if (*result != OE_OK) return nullptr;
+
+    // Catches a wrong or damaged file without relying on the host's own
+    // check. It is not a guarantee about the weights: bert.cpp reopens the
+    // file to load each context and has no way to parse the checked copy,
+    // so a host serving other bytes to the loader is not detected.
+    Sha256::Digest actual;
+    if (!file_digest(path, actual)) {
+        *result = OE_NOT_FOUND;
+        return nullptr;
+    }
+    if (actual != digest) {
+        ENCLAVE_LOG("ERROR", "Model digest mismatch for %s", path.c_str());
+        *result = OE_VERIFY_FAILED;
+        return nullptr;
+    }
+
+    std::shared_ptr<EnclaveModel> model(new EnclaveModel(path, max_contexts));
+    size_t before = heap_allocated();
+    std::unique_ptr<ComputeContext> ctx = model->create_context();
+    if (!ctx) {
+        *result = OE_OUT_OF_MEMORY;
+        return nullptr;
+    }
+    size_t after = heap_allocated();
+    model->context_bytes_ = after > before ? after - before : 0;
+    model->n_embd_ = bert_n_embd(ctx->ctx);
+    model->n_max_tokens_ = bert_n_max_tokens(ctx->ctx);
+    model->reserved_ = 1;
+    model->idle_.push_back(ctx.get());
+    model->all_.push_back(std::move(ctx));
+    ENCLAVE_LOG("INFO", "Loaded %s in enclave: %zu MiB per context, up to %zu contexts",
+                path.c_str(), model->context_bytes_ >> 20, model->max_contexts_);
+    ENCLAVE_LOG("WARN", "Weights of %s are read from the host after the digest check; the digest is not attested",
+                path.c_str());
+    *result = OE_OK;
+    return model;
+}
+
+std::unique_ptr<EnclaveModel::ComputeContext> EnclaveModel::create_context() {
+    bert_ctx* ctx = bert_load_from_file(path_.c_str(), true);
+    if (!ctx) return nullptr;
+    bert_allocate_buffers(ctx, bert_n_max_tokens(ctx), ENCLAVE_INPROC_MAX_BATCH);
+    std::unique_ptr<ComputeContext> context(new ComputeContext());
+    context->ctx = ctx;
+    context->tokens.reserve(bert_n_max_tokens(ctx));
+    return context;
+}
+
+bool EnclaveModel::can_grow_locked() const {
+    if (reserved_ >= max_contexts_ || context_bytes_ == 0) return false;
+    // Contexts still loading have not been charged to the heap yet.
+    return heap_available() >= (loading_ + 1) * context_bytes_ + kHeapHeadroomBytes;
+}
+
+EnclaveModel::Lease EnclaveModel::acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        if (!idle_.empty()) {
+            ComputeContext* ctx = idle_.back();
+            idle_.pop_back();
+            return Lease(this, ctx);
+        }
+        if (!can_grow_locked()) {
+            context_released_.wait(lock);
+            continue;
+        }
+
+        ++reserved_;
+        ++loading_;
+        lock.unlock();
+        std::unique_ptr<ComputeContext> ctx = create_context();
+        lock.lock();
+        --loading_;
+        if (ctx) {
+            all_.push_back(std::move(ctx));
+            return Lease(this, all_.back().get());
+        }
+        // The heap estimate was too optimistic; stop growing and share the
+        // contexts that already exist.
+        --reserved_;
+        context_bytes_ = 0;
+    }
+}
+
+void EnclaveModel::release(ComputeContext* ctx) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(ctx);
+    context_released_.notify_one();
+}
+
+std::shared_ptr<EnclaveModel> get_or_load_enclave_model(
+    const std::string& path, const Sha256::Digest& digest, size_t max_contexts, oe_result_t* result) {
+    static std::mutex registry_mutex;
+    static std::map<std::pair<std::string, Sha256::Digest>, std::weak_ptr<EnclaveModel>> models;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto key = std::make_pair(path, digest);
+    std::shared_ptr<EnclaveModel> model = models[key].lock();
+    if (model) {
+        *result = OE_OK;
+        return model;
+    }
+    model = EnclaveModel::load(path, digest, max_contexts, result);
+    if (model) models[key] = model;
+    else models.erase(key);
+    return model;
+}
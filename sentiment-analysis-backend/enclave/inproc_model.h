@@ -0,0 +1,107 @@
+// openenclave_ml_poc/enclave/inproc_model.h
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <openenclave/bits/result.h>
+#include "bert.h"
+#include "sha256.h"
+
+// Sequences one in-enclave bert_forward_batch call may evaluate; compute
+// buffers of every context are allocated for this many.
+#define ENCLAVE_INPROC_MAX_BATCH 8
+
+// A model loaded into enclave memory (ENCLAVE_INPROC_BERT builds).
+//
+// The enclave reads the file from the host through hostfs, checks it
+// against the expected SHA-256 and runs bert_forward itself, so tokens and
+// embeddings never leave the enclave. bert.cpp can only load from a path
+// and reads the file again for every context, so the check catches a wrong
+// or damaged file but not a host that serves other bytes to the loader:
+// the digest is not an attested property of the weights in use, and
+// nothing in the enclave reports it as one. As on the host, weights live inside
+// each bert_ctx; the model keeps a pool of contexts, one per concurrent
+// ECALL thread, and only grows it while the enclave heap can hold another
+// full copy. OE enclaves cannot create threads, so every forward pass runs
+// single-threaded on the TCS that issued it.
+class EnclaveModel {
+public:
+    // A bert_ctx plus conversion buffers reused by every forward pass on
+    // it, so steady-state requests do not allocate them again.
+    struct ComputeContext {
+        bert_ctx* ctx = nullptr;
+        bert_tokens tokens;
+        bert_batch batch;
+        // Rows of a pass evaluated out of input order, before they are
+        // scattered to their place in the output.
+        std::vector<float> rows;
+    };
+
+    class Lease {
+    public:
+        Lease(EnclaveModel* model, ComputeContext* ctx) : model_(model), ctx_(ctx) {}
+        Lease(Lease&& other) noexcept : model_(other.model_), ctx_(other.ctx_) { other.ctx_ = nullptr; }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() {
+            if (ctx_) model_->release(ctx_);
+        }
+
+        bert_ctx* get() const { return ctx_ ? ctx_->ctx : nullptr; }
+        bert_tokens& tokens() const { return ctx_->tokens; }
+        bert_batch& batch() const { return ctx_->batch; }
+        std::vector<float>& rows() const { return ctx_->rows; }
+
+    private:
+        EnclaveModel* model_;
+        ComputeContext* ctx_;
+    };
+
+    // Checks the file at path against digest and loads the first context.
+    // On failure returns nullptr and sets *result.
+    static std::shared_ptr<EnclaveModel> load(
+        const std::string& path, const Sha256::Digest& digest, size_t max_contexts, oe_result_t* result);
+    ~EnclaveModel();
+
+    EnclaveModel(const EnclaveModel&) = delete;
+    EnclaveModel& operator=(const EnclaveModel&) = delete;
+
+    // Blocks until a context is free, loading another one if the pool and
+    // the enclave heap have room for it.
+    Lease acquire();
+
+    int n_embd() const { return n_embd_; }
+    int n_max_tokens() const { return n_max_tokens_; }
+
+private:
+    EnclaveModel(const std::string& path, size_t max_contexts);
+    std::unique_ptr<ComputeContext> create_context();
+    bool can_grow_locked() const;
+    void release(ComputeContext* ctx);
+
+    const std::string path_;
+    const size_t max_contexts_;
+    int n_embd_ = 0;
+    int n_max_tokens_ = 0;
+    // Enclave heap taken by one context (weights plus compute buffers),
+    // measured when the first one is loaded.
+    size_t context_bytes_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable context_released_;
+    std::vector<ComputeContext*> idle_;
+    std::vector<std::unique_ptr<ComputeContext>> all_;
+    size_t reserved_ = 0;
+    size_t loading_ = 0;
+};
+
+// In-enclave models keyed by path and digest; entries are weak so a model
+// is freed with its last session.
+std::shared_ptr<EnclaveModel> get_or_load_enclave_model(
+    const std::string& path, const Sha256::Digest& digest, size_t max_contexts, oe_result_t* result);
@@ -0,0 +1,190 @@
+// openenclave_ml_poc/enclave/reference_index.cpp
+#include "reference_index.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "vector_kernels.h"
+
+namespace {
+
+constexpr size_t kCacheLine = 64;
+// Queries scored against each row while it is in L1; eight 768-float
+// queries fit beside it.
+constexpr size_t kQueryBlock = 8;
+
+struct Match {
+    float score;
+    size_t row;
+};
+
+// Heap order with the worst match on top, so a full top-k heap is
+// replaced from the front.
+bool better(const Match& a, const Match& b) {
+    return a.score > b.score || (a.score == b.score && a.row < b.row);
+}
+
+size_t round_up(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+}  // namespace
+
+size_t ReferenceIndex::stride() const {
+    return round_up(dim_ * (storage_ == kIndexI8 ? sizeof(int8_t) : sizeof(float)), kCacheLine);
+}
+
+void ReferenceIndex::allocate(size_t rows) {
+    buffer_.assign(rows * stride() + kCacheLine - 1, 0);
+    uintptr_t base = reinterpret_cast<uintptr_t>(buffer_.data());
+    data_ = buffer_.data() + (round_up(base, kCacheLine) - base);
+    scales_.assign(storage_ == kIndexI8 ? rows : 0, 0.0f);
+    ids_.resize(rows);
+}
+
+void ReferenceIndex::store(size_t r, const float* values) {
+    float norm = sqrtf(dot_f32(values, values, dim_));
+    float inv = norm > 0 ? 1.0f / norm : 0.0f;
+    if (storage_ == kIndexF32) {
+        float* out = reinterpret_cast<float*>(row(r));
+        for (size_t i = 0; i < dim_; ++i) out[i] = values[i] * inv;
+        return;
+    }
+    float max_abs = 0;
+    for (size_t i = 0; i < dim_; ++i) max_abs = std::max(max_abs, fabsf(values[i] * inv));
+    float scale = max_abs > 0 ? max_abs / 127.0f : 1.0f;
+    int8_t* out = reinterpret_cast<int8_t*>(row(r));
+    for (size_t i = 0; i < dim_; ++i) out[i] = static_cast<int8_t>(lrintf(values[i] * inv / scale));
+    scales_[r] = scale;
+}
+
+oe_result_t ReferenceIndex::apply(const std::shared_ptr<const ReferenceIndex>& current, const uint8_t* data,
+                                  size_t size, std::shared_ptr<const ReferenceIndex>& updated) {
+    ReferenceIndexUpdateHeader header;
+    if (!data || size < sizeof(header)) return OE_INVALID_PARAMETER;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, kReferenceIndexMagic, sizeof(header.magic)) != 0 ||
+        reference_index_update_size(header) != size) {
+        return OE_INVALID_PARAMETER;
+    }
+    const uint8_t* id_data = data + sizeof(header);
+    const float* values = reinterpret_cast<const float*>(id_data + header.count * sizeof(uint64_t));
+    if (header.op != kIndexRemove) {
+        for (size_t i = 0; i < static_cast<size_t>(header.count) * header.dim; ++i) {
+            if (!isfinite(values[i])) return OE_INVALID_PARAMETER;
+        }
+    }
+    // An upsert or removal without rows to apply to starts from an empty
+    // index, whatever dim and storage it had.
+    const ReferenceIndex* base = header.op == kIndexReplace ? nullptr : current.get();
+    if (base && base->rows() == 0) base = nullptr;
+    if (header.op == kIndexUpsert && base && (header.dim != base->dim_ || header.storage != base->storage_)) {
+        return OE_INVALID_PARAMETER;
+    }
+
+    auto index = std::make_shared<ReferenceIndex>();
+    index->storage_ = header.op == kIndexRemove ? (base ? base->storage_ : kIndexF32) : header.storage;
+    index->dim_ = header.op == kIndexRemove ? (base ? base->dim_ : 0) : header.dim;
+
+    // Each output row comes either from base (the row it had there) or
+    // from the update (its values); a repeated ID keeps its last values.
+    std::vector<std::pair<size_t, const float*>> sources;
+    std::vector<bool> removed(base ? base->rows() : 0, false);
+    if (header.op == kIndexRemove && base) {
+        for (size_t i = 0; i < header.count; ++i) {
+            uint64_t id;
+            memcpy(&id, id_data + i * sizeof(id), sizeof(id));
+            auto found = base->rows_by_id_.find(id);
+            if (found != base->rows_by_id_.end()) removed[found->second] = true;
+        }
+    }
+    for (size_t r = 0; base && r < base->rows(); ++r) {
+        if (removed[r]) continue;
+        index->rows_by_id_.emplace(base->ids_[r], sources.size());
+        sources.emplace_back(r, nullptr);
+    }
+    std::vector<uint64_t> ids(sources.size());
+    for (size_t s = 0; s < sources.size(); ++s) ids[s] = base->ids_[sources[s].first];
+    if (header.op != kIndexRemove) {
+        for (size_t i = 0; i < header.count; ++i) {
+            uint64_t id;
+            memcpy(&id, id_data + i * sizeof(id), sizeof(id));
+            auto inserted = index->rows_by_id_.emplace(id, sources.size());
+            const float* row_values = values + i * header.dim;
+            if (inserted.second) {
+                sources.emplace_back(0, row_values);
+                ids.push_back(id);
+            } else {
+                sources[inserted.first->second].second = row_values;
+            }
+        }
+    }
+    if (sources.size() > kMaxIndexRows) return OE_INVALID_PARAMETER;
+
+    index->allocate(sources.size());
+    index->ids_ = std::move(ids);
+    for (size_t r = 0; r < sources.size(); ++r) {
+        if (sources[r].second) {
+            index->store(r, sources[r].second);
+            continue;
+        }
+        memcpy(index->row(r), base->row(sources[r].first), index->stride());
+        if (index->storage_ == kIndexI8) index->scales_[r] = base->scales_[sources[r].first];
+    }
+    updated = std::move(index);
+    return OE_OK;
+}
+
+size_t ReferenceIndex::search(const float* queries, size_t num_queries, size_t k, uint64_t* ids,
+                              float* scores) const {
+    size_t take = std::min(k, rows());
+    if (take == 0) return 0;
+
+    // Both are reused by every search on the TCS.
+    thread_local std::vector<float> normalised;
+    thread_local std::vector<std::vector<Match>> heaps;
+    normalised.resize(kQueryBlock * dim_);
+    heaps.resize(kQueryBlock);
+
+    for (size_t first = 0; first < num_queries; first += kQueryBlock) {
+        size_t block = std::min(kQueryBlock, num_queries - first);
+        for (size_t q = 0; q < block; ++q) {
+            const float* query = queries + (first + q) * dim_;
+            float norm = sqrtf(dot_f32(query, query, dim_));
+            float inv = norm > 0 ? 1.0f / norm : 0.0f;
+            for (size_t i = 0; i < dim_; ++i) normalised[q * dim_ + i] = query[i] * inv;
+            heaps[q].clear();
+        }
+        for (size_t r = 0; r < rows(); ++r) {
+            const uint8_t* values = row(r);
+            for (size_t q = 0; q < block; ++q) {
+                const float* query = normalised.data() + q * dim_;
+                Match match{storage_ == kIndexI8
+                                ? dot_i8_f32(reinterpret_cast<const int8_t*>(values), query, dim_) * scales_[r]
+                                : dot_f32(reinterpret_cast<const float*>(values), query, dim_),
+                            r};
+                std::vector<Match>& heap = heaps[q];
+                if (heap.size() < take) {
+                    heap.push_back(match);
+                    std::push_heap(heap.begin(), heap.end(), better);
+                } else if (better(match, heap.front())) {
+                    std::pop_heap(heap.begin(), heap.end(), better);
+                    heap.back() = match;
+                    std::push_heap(heap.begin(), heap.end(), better);
+                }
+            }
+        }
+        for (size_t q = 0; q < block; ++q) {
+            std::vector<Match>& heap = heaps[q];
+            std::sort_heap(heap.begin(), heap.end(), better);
+            for (size_t i = 0; i < take; ++i) {
+                ids[(first + q) * k + i] = ids_[heap[i].row];
+                scores[(first + q) * k + i] = heap[i].score;
+            }
+        }
+    }
+    return take;
+}
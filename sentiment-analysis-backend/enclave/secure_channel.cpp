@@ -0,0 +1,261 @@
+// openenclave_ml_poc/enclave/secure_channel.cpp
+#include "secure_channel.h"
+
+#include <string.h>
+
+#include <mutex>
+#include <unordered_map>
+
+#include <openenclave/enclave.h>
+
+#include <mbedtls/ecdh.h>
+#include <mbedtls/ecp.h>
+#include <mbedtls/gcm.h>
+#include <mbedtls/md.h>
+#include <mbedtls/platform_util.h>
+
+namespace {
+
+constexpr size_t kKeyBytes = 32;
+constexpr size_t kIvBytes = 12;
+// Channels one enclave keeps open at once; each holds two expanded AES key
+// schedules, so this bounds what a flood of opens can pin in the heap.
+constexpr size_t kMaxChannels = 4096;
+constexpr uint32_t kDirectionRequest = 0;
+constexpr uint32_t kDirectionResponse = 1;
+
+int enclave_rng(void*, unsigned char* out, size_t len) {
+    return oe_random(out, len) == OE_OK ? 0 : MBEDTLS_ERR_ECP_RANDOM_FAILED;
+}
+
+// HKDF-SHA256 (RFC 5869) for one output block, which is all a 32-byte key
+// needs.
+bool hkdf_sha256(const uint8_t* salt, size_t salt_size, const uint8_t* ikm, size_t ikm_size, const char* info,
+                 uint8_t out[kKeyBytes]) {
+    const mbedtls_md_info_t* sha256 = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    uint8_t prk[kKeyBytes];
+    if (mbedtls_md_hmac(sha256, salt, salt_size, ikm, ikm_size, prk) != 0) return false;
+    std::vector<uint8_t> block(info, info + strlen(info));
+    block.push_back(1);
+    bool ok = mbedtls_md_hmac(sha256, prk, sizeof(prk), block.data(), block.size(), out) == 0;
+    mbedtls_platform_zeroize(prk, sizeof(prk));
+    return ok;
+}
+
+void make_iv(uint64_t sequence, uint32_t direction, uint8_t iv[kIvBytes]) {
+    memcpy(iv, &sequence, sizeof(sequence));
+    memcpy(iv + sizeof(sequence), &direction, sizeof(direction));
+}
+
+}  // namespace
+
+class SecureChannel {
+public:
+    SecureChannel() {
+        mbedtls_gcm_init(&request_key_);
+        mbedtls_gcm_init(&response_key_);
+    }
+    ~SecureChannel() {
+        mbedtls_gcm_free(&request_key_);
+        mbedtls_gcm_free(&response_key_);
+    }
+    SecureChannel(const SecureChannel&) = delete;
+    SecureChannel& operator=(const SecureChannel&) = delete;
+
+    bool set_keys(const uint8_t request_key[kKeyBytes], const uint8_t response_key[kKeyBytes]) {
+        return mbedtls_gcm_setkey(&request_key_, MBEDTLS_CIPHER_ID_AES, request_key, kKeyBytes * 8) == 0 &&
+               mbedtls_gcm_setkey(&response_key_, MBEDTLS_CIPHER_ID_AES, response_key, kKeyBytes * 8) == 0;
+    }
+
+    // A GCM context keeps per-message state, so each direction is used by
+    // one thread at a time; the two directions do not contend.
+    oe_result_t decrypt(const SecureMessageHeader& header, const uint8_t* ciphertext, size_t size,
+                        const uint8_t* tag, uint8_t* plaintext) {
+        uint8_t iv[kIvBytes];
+        make_iv(header.sequence, kDirectionRequest, iv);
+        std::lock_guard<std::mutex> lock(request_mutex_);
+        // Replays are checked before and recorded after authentication, so
+        // a forged message cannot burn a sequence number.
+        if (!fresh_locked(header.sequence)) return OE_INVALID_PARAMETER;
+        if (mbedtls_gcm_auth_decrypt(&request_key_, size, iv, sizeof(iv), reinterpret_cast<const uint8_t*>(&header),
+                                     sizeof(header), tag, kSecureTagBytes, ciphertext, plaintext) != 0) {
+            return OE_CRYPTO_ERROR;
+        }
+        record_locked(header.sequence);
+        return OE_OK;
+    }
+
+    oe_result_t encrypt(const SecureMessageHeader& header, const uint8_t* plaintext, size_t size,
+                        uint8_t* ciphertext, uint8_t* tag) {
+        uint8_t iv[kIvBytes];
+        make_iv(header.sequence, kDirectionResponse, iv);
+        std::lock_guard<std::mutex> lock(response_mutex_);
+        if (mbedtls_gcm_crypt_and_tag(&response_key_, MBEDTLS_GCM_ENCRYPT, size, iv, sizeof(iv),
+                                      reinterpret_cast<const uint8_t*>(&header), sizeof(header), plaintext,
+                                      ciphertext, kSecureTagBytes, tag) != 0) {
+            return OE_CRYPTO_ERROR;
+        }
+        return OE_OK;
+    }
+
+private:
+    bool fresh_locked(uint64_t sequence) const {
+        if (sequence == 0) return false;
+        if (sequence > highest_) return true;
+        uint64_t age = highest_ - sequence;
+        return age < 64 && !(window_ & (1ull << age));
+    }
+
+    void record_locked(uint64_t sequence) {
+        if (sequence > highest_) {
+            uint64_t shift = sequence - highest_;
+            window_ = shift < 64 ? (window_ << shift) | 1 : 1;
+            highest_ = sequence;
+        } else {
+            window_ |= 1ull << (highest_ - sequence);
+        }
+    }
+
+    std::mutex request_mutex_;
+    std::mutex response_mutex_;
+    mbedtls_gcm_context request_key_;
+    mbedtls_gcm_context response_key_;
+    // Highest sequence accepted, and bit i set if highest_ - i was seen.
+    uint64_t highest_ = 0;
+    uint64_t window_ = 0;
+};
+
+namespace {
+
+// Channel IDs are random rather than counted, so they are unique across
+// the enclave instances of a supervisor and can't be guessed from one
+// another.
+std::mutex g_channels_mutex;
+std::unordered_map<uint64_t, std::shared_ptr<SecureChannel>> g_channels;
+
+std::shared_ptr<SecureChannel> find_channel(uint64_t channel_id) {
+    std::lock_guard<std::mutex> lock(g_channels_mutex);
+    auto it = g_channels.find(channel_id);
+    return it == g_channels.end() ? nullptr : it->second;
+}
+
+}  // namespace
+
+oe_result_t open_secure_channel_keys(const uint8_t* client_public_key, size_t client_public_key_size,
+                                     uint8_t* enclave_public_key, std::vector<uint8_t>& claims,
+                                     uint64_t* channel_id) {
+    if (!client_public_key || client_public_key_size != kChannelPublicKeyBytes || !enclave_public_key ||
+        !channel_id) {
+        return OE_INVALID_PARAMETER;
+    }
+
+    mbedtls_ecp_group group;
+    mbedtls_mpi secret_key;
+    mbedtls_mpi shared;
+    mbedtls_ecp_point public_key;
+    mbedtls_ecp_point peer_key;
+    mbedtls_ecp_group_init(&group);
+    mbedtls_mpi_init(&secret_key);
+    mbedtls_mpi_init(&shared);
+    mbedtls_ecp_point_init(&public_key);
+    mbedtls_ecp_point_init(&peer_key);
+
+    oe_result_t result = OE_CRYPTO_ERROR;
+    uint8_t shared_bytes[kKeyBytes] = {};
+    uint8_t request_key[kKeyBytes] = {};
+    uint8_t response_key[kKeyBytes] = {};
+    size_t written = 0;
+    auto channel = std::make_shared<SecureChannel>();
+    do {
+        if (mbedtls_ecp_group_load(&group, MBEDTLS_ECP_DP_SECP256R1) != 0) break;
+        if (mbedtls_ecp_point_read_binary(&group, &peer_key, client_public_key, client_public_key_size) != 0 ||
+            mbedtls_ecp_check_pubkey(&group, &peer_key) != 0) {
+            result = OE_INVALID_PARAMETER;
+            break;
+        }
+        if (mbedtls_ecdh_gen_public(&group, &secret_key, &public_key, enclave_rng, nullptr) != 0) break;
+        if (mbedtls_ecp_point_write_binary(&group, &public_key, MBEDTLS_ECP_PF_UNCOMPRESSED, &written,
+                                           enclave_public_key, kChannelPublicKeyBytes) != 0 ||
+            written != kChannelPublicKeyBytes) {
+            break;
+        }
+        if (mbedtls_ecdh_compute_shared(&group, &shared, &peer_key, &secret_key, enclave_rng, nullptr) != 0 ||
+            mbedtls_mpi_write_binary(&shared, shared_bytes, sizeof(shared_bytes)) != 0) {
+            break;
+        }
+
+        claims.assign(enclave_public_key, enclave_public_key + kChannelPublicKeyBytes);
+        claims.insert(claims.end(), client_public_key, client_public_key + client_public_key_size);
+        if (!hkdf_sha256(claims.data(), claims.size(), shared_bytes, sizeof(shared_bytes),
+                         "ml-poc channel v1 request", request_key) ||
+            !hkdf_sha256(claims.data(), claims.size(), shared_bytes, sizeof(shared_bytes),
+                         "ml-poc channel v1 response", response_key) ||
+            !channel->set_keys(request_key, response_key)) {
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(g_channels_mutex);
+        if (g_channels.size() >= kMaxChannels) {
+            result = OE_OUT_OF_MEMORY;
+            break;
+        }
+        uint64_t id = 0;
+        while (id == 0 || g_channels.count(id)) {
+            if (oe_random(&id, sizeof(id)) != OE_OK) break;
+        }
+        if (id == 0) break;
+        g_channels.emplace(id, std::move(channel));
+        *channel_id = id;
+        result = OE_OK;
+    } while (false);
+
+    mbedtls_platform_zeroize(shared_bytes, sizeof(shared_bytes));
+    mbedtls_platform_zeroize(request_key, sizeof(request_key));
+    mbedtls_platform_zeroize(response_key, sizeof(response_key));
+    mbedtls_ecp_point_free(&peer_key);
+    mbedtls_ecp_point_free(&public_key);
+    mbedtls_mpi_free(&shared);
+    mbedtls_mpi_free(&secret_key);
+    mbedtls_ecp_group_free(&group);
+    return result;
+}
+
+oe_result_t close_secure_channel_keys(uint64_t channel_id) {
+    std::lock_guard<std::mutex> lock(g_channels_mutex);
+    return g_channels.erase(channel_id) ? OE_OK : OE_NOT_FOUND;
+}
+
+oe_result_t open_secure_request(const uint8_t* message, size_t message_size, SecureRequest& request) {
+    if (!message || message_size < kSecureMessageOverhead + sizeof(int32_t)) return OE_INVALID_PARAMETER;
+    size_t ciphertext_size = message_size - kSecureMessageOverhead;
+    if (ciphertext_size % sizeof(int32_t) != 0) return OE_INVALID_PARAMETER;
+
+    memcpy(&request.header, message, sizeof(request.header));
+    request.channel = find_channel(request.header.channel_id);
+    if (!request.channel) return OE_NOT_FOUND;
+
+    std::vector<uint8_t> plaintext(ciphertext_size);
+    const uint8_t* ciphertext = message + sizeof(SecureMessageHeader);
+    oe_result_t result = request.channel->decrypt(request.header, ciphertext, ciphertext_size,
+                                                  ciphertext + ciphertext_size, plaintext.data());
+    if (result != OE_OK) return result;
+
+    request.tokens.resize(ciphertext_size / sizeof(int32_t));
+    for (size_t i = 0; i < request.tokens.size(); ++i) {
+        int32_t token;
+        memcpy(&token, plaintext.data() + i * sizeof(token), sizeof(token));
+        request.tokens[i] = token;
+    }
+    mbedtls_platform_zeroize(plaintext.data(), plaintext.size());
+    return OE_OK;
+}
+
+oe_result_t seal_secure_response(const SecureRequest& request, const float* data, size_t count, uint8_t* out,
+                                 size_t out_capacity) {
+    size_t payload = count * sizeof(float);
+    if (!request.channel || !out || out_capacity < payload + kSecureMessageOverhead) return OE_BUFFER_TOO_SMALL;
+    memcpy(out, &request.header, sizeof(request.header));
+    uint8_t* ciphertext = out + sizeof(SecureMessageHeader);
+    return request.channel->encrypt(request.header, reinterpret_cast<const uint8_t*>(data), payload, ciphertext,
+                                    ciphertext + payload);
+}
@@ -0,0 +1,66 @@
+// openenclave_ml_poc/enclave/secure_channel.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <openenclave/bits/result.h>
+
+// Attested channel between a client and this enclave, so request tokens and
+// response embeddings cross the untrusted host only encrypted.
+//
+// Opening: the client sends an ephemeral P-256 public key (uncompressed, 65
+// bytes). The enclave answers with its own ephemeral key and a quote whose
+// custom claims are enclave key || client key, which proves the enclave key
+// belongs to this enclave and is fresh for this client. Both sides derive
+// two AES-256-GCM keys with HKDF-SHA256 (ikm: the ECDH shared secret, salt:
+// the claims, info: "ml-poc channel v1 request" / "... response"). The
+// handshake and its quote are paid once per channel; every later request on
+// it costs one AES-GCM pass each way, with the key schedules expanded once
+// at open. mbedtls uses AES-NI for them where the CPU has it.
+//
+// Messages: SecureMessageHeader, ciphertext, 16-byte tag. The header is the
+// additional authenticated data and the IV is sequence (little-endian) ||
+// 0 for requests or 1 for responses. Request plaintext is little-endian
+// int32 token IDs; response plaintext is the float32 embedding, sent under
+// the request's sequence. Sequences start at 1 and must be unique per
+// channel; the enclave rejects replays with a 64-entry sliding window and
+// accepts the rest out of order, since the host runs requests concurrently.
+
+#pragma pack(push, 1)
+struct SecureMessageHeader {
+    uint64_t channel_id;
+    uint64_t sequence;
+};
+#pragma pack(pop)
+
+constexpr size_t kChannelPublicKeyBytes = 65;
+constexpr size_t kSecureTagBytes = 16;
+constexpr size_t kSecureMessageOverhead = sizeof(SecureMessageHeader) + kSecureTagBytes;
+
+class SecureChannel;
+
+// A decrypted request and what it takes to answer it.
+struct SecureRequest {
+    std::shared_ptr<SecureChannel> channel;
+    SecureMessageHeader header;
+    std::vector<int64_t> tokens;
+};
+
+// Creates a channel for client_public_key. Fills enclave_public_key
+// (kChannelPublicKeyBytes) and the claims to bind into the channel's quote.
+oe_result_t open_secure_channel_keys(const uint8_t* client_public_key, size_t client_public_key_size,
+                                     uint8_t* enclave_public_key, std::vector<uint8_t>& claims,
+                                     uint64_t* channel_id);
+
+oe_result_t close_secure_channel_keys(uint64_t channel_id);
+
+// Authenticates and decrypts one request message into request.
+oe_result_t open_secure_request(const uint8_t* message, size_t message_size, SecureRequest& request);
+
+// Encrypts count floats as the response to request into out, which must
+// hold count * sizeof(float) + kSecureMessageOverhead bytes.
+oe_result_t seal_secure_response(const SecureRequest& request, const float* data, size_t count, uint8_t* out,
+                                 size_t out_capacity);
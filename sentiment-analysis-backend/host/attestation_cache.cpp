@@ -0,0 +1,129 @@
+// openenclave_ml_poc/host/attestation_cache.cpp
+#include "attestation_cache.h"
+
+#include <sys/random.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "enclave_u.h"
+#include "worker_protocol.h"
+
+namespace {
+
+constexpr size_t kNonceBytes = 32;
+constexpr auto kRetryDelay = std::chrono::seconds(5);
+
+uint64_t unix_ms(std::chrono::system_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
+}
+
+void fill_random(uint8_t* out, size_t bytes) {
+    while (bytes > 0) {
+        ssize_t n = getrandom(out, bytes, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("[Host] getrandom failed: ") + strerror(errno));
+        }
+        out += n;
+        bytes -= static_cast<size_t>(n);
+    }
+}
+
+}  // namespace
+
+AttestationCache::AttestationCache(oe_enclave_t* enclave, std::chrono::seconds lifetime)
+    : enclave_(enclave), lifetime_(lifetime), refresher_(&AttestationCache::refresh_loop, this) {}
+
+AttestationCache::~AttestationCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    refresher_.join();
+}
+
+std::shared_ptr<const AttestationEvidence> AttestationCache::current(std::chrono::milliseconds wait) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait_for(lock, wait, [&] { return current_ || failures_ > 0 || stopping_; });
+    if (!current_ || std::chrono::system_clock::now() >= current_->expires) return nullptr;
+    return current_;
+}
+
+uint64_t AttestationCache::generations() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return generations_;
+}
+
+uint64_t AttestationCache::failures() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failures_;
+}
+
+std::shared_ptr<const AttestationEvidence> AttestationCache::generate() {
+    auto evidence = std::make_shared<AttestationEvidence>();
+    evidence->generated = std::chrono::system_clock::now();
+    evidence->expires = evidence->generated + lifetime_;
+    evidence->claims.resize(kNonceBytes + sizeof(uint64_t));
+    fill_random(evidence->claims.data(), kNonceBytes);
+    uint64_t expires_s = unix_ms(evidence->expires) / 1000;
+    std::memcpy(evidence->claims.data() + kNonceBytes, &expires_s, sizeof(expires_s));
+
+    unsigned char* evidence_buffer = nullptr;
+    size_t evidence_size = 0;
+    oe_result_t ecall_ret_status = OE_FAILURE;
+    oe_result_t result = get_attestation_evidence_with_claims(
+        enclave_, &ecall_ret_status, evidence->claims.data(), evidence->claims.size(), &evidence_buffer,
+        &evidence_size);
+    if (result != OE_OK || ecall_ret_status != OE_OK) {
+        free(evidence_buffer);
+        throw std::runtime_error(std::string("[Host] get_attestation_evidence_with_claims failed with ") +
+                                 oe_result_str(result != OE_OK ? result : ecall_ret_status));
+    }
+    evidence->evidence.assign(evidence_buffer, evidence_buffer + evidence_size);
+    free(evidence_buffer);
+    return evidence;
+}
+
+void AttestationCache::refresh_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        std::shared_ptr<const AttestationEvidence> evidence;
+        try {
+            evidence = generate();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+        lock.lock();
+
+        // Scheduled on the steady clock, so a wall clock step can neither
+        // stall the refresh nor make it spin.
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+        if (evidence) {
+            current_ = evidence;
+            ++generations_;
+            next += lifetime_ * 3 / 4;
+        } else {
+            ++failures_;
+            next += kRetryDelay;
+        }
+        changed_.notify_all();
+        changed_.wait_until(lock, next, [&] { return stopping_; });
+    }
+}
+
+void encode_attestation_payload(const AttestationEvidence& evidence, std::string& out) {
+    WireAttestationHeader header = {unix_ms(evidence.generated), unix_ms(evidence.expires),
+                                    static_cast<uint32_t>(evidence.claims.size()),
+                                    static_cast<uint32_t>(evidence.evidence.size())};
+    out.resize(sizeof(header) + evidence.claims.size() + evidence.evidence.size());
+    char* p = &out[0];
+    std::memcpy(p, &header, sizeof(header));
+    std::memcpy(p + sizeof(header), evidence.claims.data(), evidence.claims.size());
+    std::memcpy(p + sizeof(header) + evidence.claims.size(), evidence.evidence.data(), evidence.evidence.size());
+}
@@ -0,0 +1,65 @@
+// openenclave_ml_poc/host/attestation_cache.h
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openenclave/host.h>
+
+// One generation of attestation evidence.
+struct AttestationEvidence {
+    std::chrono::system_clock::time_point generated;
+    std::chrono::system_clock::time_point expires;
+    // Bound into the quote as custom claims: a fresh 32-byte random nonce
+    // followed by the expiry as little-endian Unix seconds (uint64). The
+    // quote's report data is their SHA-256, so a verifier can check that
+    // the evidence it holds is of the generation it was told about and has
+    // not expired.
+    std::vector<uint8_t> claims;
+    std::vector<uint8_t> evidence;
+};
+
+// Keeps attestation evidence for a running worker's enclave, so serving it
+// costs a copy instead of an enclave lifecycle and a quote per caller. A
+// background thread generates the first evidence at construction and a
+// fresh one (with a new nonce) after three quarters of each lifetime, so the
+// cached evidence is replaced well before it expires. Failed generations are
+// retried every few seconds; the previous evidence is served until it
+// expires.
+class AttestationCache {
+public:
+    AttestationCache(oe_enclave_t* enclave, std::chrono::seconds lifetime);
+    ~AttestationCache();
+    AttestationCache(const AttestationCache&) = delete;
+    AttestationCache& operator=(const AttestationCache&) = delete;
+
+    // The current evidence, waiting up to wait for the first generation.
+    // nullptr if none is available or the last one expired.
+    std::shared_ptr<const AttestationEvidence> current(std::chrono::milliseconds wait);
+
+    uint64_t generations() const;
+    uint64_t failures() const;
+
+private:
+    void refresh_loop();
+    std::shared_ptr<const AttestationEvidence> generate();
+
+    oe_enclave_t* const enclave_;
+    const std::chrono::seconds lifetime_;
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::shared_ptr<const AttestationEvidence> current_;
+    uint64_t generations_ = 0;
+    uint64_t failures_ = 0;
+    bool stopping_ = false;
+    std::thread refresher_;
+};
+
+// Serialises evidence as a kFrameAttest payload (see worker_protocol.h).
+void encode_attestation_payload(const AttestationEvidence& evidence, std::string& out);
@@ -0,0 +1,239 @@
+// openenclave_ml_poc/host/bench.cpp
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "enclave_u.h"
+
+OcallStageTimes& thread_ocall_stage_times() {
+    thread_local OcallStageTimes times;
+    return times;
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Untimed requests per session before the run, to warm caches, the GGML
+// thread pools and the switchless workers.
+constexpr size_t kWarmupRequests = 16;
+constexpr size_t kPingRepetitions = 2000;
+
+void check(oe_result_t result, const char* fn) {
+    if (result != OE_OK) throw std::runtime_error(std::string("[Host] ") + fn + " failed with " + oe_result_str(result));
+}
+
+uint64_t elapsed_ns(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+// One timed ECALL and the host OCALL time observed during it.
+struct Sample {
+    uint64_t total_ns;
+    uint64_t ocalls;
+    uint64_t ocall_ns;
+    uint64_t forward_ns;
+};
+
+// Buffers of one client thread, reused by every request it makes.
+struct Client {
+    std::vector<int64_t> tokens;
+    std::vector<uint64_t> offsets;
+    std::vector<float> output;
+    std::vector<Sample> samples;
+};
+
+// Median round trip of enclave_ping(ocall_count).
+uint64_t median_ping_ns(oe_enclave_t* enclave, uint64_t ocall_count) {
+    std::vector<uint64_t> times(kPingRepetitions);
+    for (uint64_t& t : times) {
+        oe_result_t ecall_ret_status = OE_FAILURE;
+        Clock::time_point start = Clock::now();
+        check(enclave_ping(enclave, &ecall_ret_status, ocall_count), "enclave_ping");
+        t = elapsed_ns(start);
+        check(ecall_ret_status, "enclave_ping (enclave)");
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+// Request index carries corpus sequences index * batch onwards, wrapping
+// around at the end of the corpus.
+Sample issue_request(oe_enclave_t* enclave, uint64_t session, const std::vector<std::vector<int64_t>>& corpus,
+                     size_t index, size_t batch, size_t n_embd, Client& client) {
+    client.tokens.clear();
+    client.offsets.assign(1, 0);
+    for (size_t s = 0; s < batch; ++s) {
+        const std::vector<int64_t>& sequence = corpus[(index * batch + s) % corpus.size()];
+        client.tokens.insert(client.tokens.end(), sequence.begin(), sequence.end());
+        client.offsets.push_back(client.tokens.size());
+    }
+    client.output.resize(batch * n_embd);
+
+    const OcallStageTimes& stage_times = thread_ocall_stage_times();
+    OcallStageTimes before = stage_times;
+    oe_result_t ecall_ret_status = OE_FAILURE;
+    size_t actual_output_byte_size = 0;
+    Clock::time_point start = Clock::now();
+    oe_result_t result;
+    if (batch == 1) {
+        result = enclave_infer(
+            enclave, &ecall_ret_status, session,
+            client.tokens.data(), client.tokens.size() * sizeof(int64_t),
+            client.output.data(), client.output.size() * sizeof(float),
+            &actual_output_byte_size);
+    } else {
+        result = enclave_infer_batch(
+            enclave, &ecall_ret_status, session,
+            client.tokens.data(), client.tokens.size() * sizeof(int64_t),
+            client.offsets.data(), client.offsets.size(),
+            client.output.data(), client.output.size() * sizeof(float),
+            &actual_output_byte_size);
+    }
+    uint64_t total_ns = elapsed_ns(start);
+    check(result, batch == 1 ? "enclave_infer" : "enclave_infer_batch");
+    check(ecall_ret_status, batch == 1 ? "enclave_infer (enclave)" : "enclave_infer_batch (enclave)");
+    return Sample{total_ns, stage_times.ocalls - before.ocalls, stage_times.ocall_ns - before.ocall_ns,
+                  stage_times.forward_ns - before.forward_ns};
+}
+
+// Prints mean and percentiles of values (in ns) as microseconds, plus the
+// stage's share of the mean request latency.
+void print_stage(const char* name, std::vector<double> values, double mean_total) {
+    std::sort(values.begin(), values.end());
+    auto percentile = [&](double p) {
+        return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))] / 1e3;
+    };
+    double sum = 0;
+    for (double v : values) sum += v;
+    double mean = sum / values.size();
+    std::cout << "bench stage=" << name << " mean_us=" << mean / 1e3 << " p50_us=" << percentile(0.50)
+              << " p95_us=" << percentile(0.95) << " p99_us=" << percentile(0.99)
+              << " share=" << (mean_total > 0 ? 100.0 * mean / mean_total : 0.0) << "%" << std::endl;
+}
+
+}  // namespace
+
+std::vector<std::vector<int64_t>> load_bench_corpus(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("[Host] Failed to open bench corpus " + path);
+    std::vector<std::vector<int64_t>> corpus;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line);
+        std::string sequence_str;
+        while (std::getline(ss, sequence_str, ';')) {
+            std::vector<int64_t> sequence;
+            std::stringstream seq_ss(sequence_str);
+            std::string value_str;
+            while (std::getline(seq_ss, value_str, ',')) {
+                if (value_str.find_first_not_of(" \t\r") != std::string::npos) sequence.push_back(std::stoll(value_str));
+            }
+            if (!sequence.empty()) corpus.push_back(std::move(sequence));
+        }
+    }
+    if (corpus.empty()) throw std::runtime_error("[Host] Bench corpus " + path + " holds no sequences");
+    return corpus;
+}
+
+void run_bench(oe_enclave_t* enclave, const std::vector<uint64_t>& sessions, size_t n_embd,
+               const BenchOptions& options) {
+    std::vector<std::vector<int64_t>> corpus;
+    if (options.corpus_path.empty()) {
+        // [CLS] <seq_len - 2 filler tokens> [SEP] in the bert-base vocabulary.
+        std::vector<int64_t> sequence(std::max<size_t>(2, options.seq_len), 1996);
+        sequence.front() = 101;
+        sequence.back() = 102;
+        corpus.push_back(std::move(sequence));
+    } else {
+        corpus = load_bench_corpus(options.corpus_path);
+    }
+    size_t batch = std::max<size_t>(1, options.batch);
+
+    // Transition costs come from empty round trips; they are subtracted
+    // from every request rather than timed inside it, which would need a
+    // clock in the enclave.
+    uint64_t ecall_ns = median_ping_ns(enclave, 0);
+    uint64_t with_ocall_ns = median_ping_ns(enclave, 1);
+    uint64_t ocall_transition_ns = with_ocall_ns > ecall_ns ? with_ocall_ns - ecall_ns : 0;
+
+    std::vector<Client> clients(sessions.size());
+    for (size_t c = 0; c < sessions.size(); ++c) {
+        for (size_t i = 0; i < kWarmupRequests; ++i) issue_request(enclave, sessions[c], corpus, i, batch, n_embd, clients[c]);
+    }
+
+    std::atomic<size_t> next_request{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    for (size_t c = 0; c < sessions.size(); ++c) {
+        threads.emplace_back([&, c] {
+            Client& client = clients[c];
+            client.samples.reserve(options.requests / sessions.size() + 1);
+            try {
+                for (size_t i; (i = next_request.fetch_add(1)) < options.requests;) {
+                    client.samples.push_back(issue_request(enclave, sessions[c], corpus, i, batch, n_embd, client));
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                next_request = options.requests;
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+    double elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+    if (error) std::rethrow_exception(error);
+
+    std::vector<Sample> samples;
+    for (const Client& client : clients) samples.insert(samples.end(), client.samples.begin(), client.samples.end());
+    if (samples.empty()) return;
+
+    size_t sequences = samples.size() * batch;
+    size_t tokens = 0;
+    for (size_t i = 0; i < sequences; ++i) tokens += corpus[i % corpus.size()].size();
+    std::cout << "bench requests=" << samples.size() << " sequences=" << sequences << " tokens=" << tokens
+              << " concurrency=" << sessions.size() << " batch=" << batch << " elapsed_s=" << elapsed_s
+              << " requests_per_s=" << samples.size() / elapsed_s << " sequences_per_s=" << sequences / elapsed_s
+              << " tokens_per_s=" << tokens / elapsed_s << std::endl;
+
+    // Stages of each request: the median transition costs, the host OCALL
+    // time split into bert_forward and the rest (token conversion, waiting
+    // for a compute context), and marshalling as the remainder, which is
+    // OE copying buffers across the boundary plus the enclave's own work.
+    std::vector<double> total, ecall, ocall, forward, host_ocall, marshalling;
+    uint64_t observed_ocalls = 0;
+    for (const Sample& s : samples) {
+        double transitions = static_cast<double>(ecall_ns) + static_cast<double>(s.ocalls * ocall_transition_ns);
+        total.push_back(s.total_ns);
+        ecall.push_back(ecall_ns);
+        ocall.push_back(s.ocalls * ocall_transition_ns);
+        forward.push_back(s.forward_ns);
+        host_ocall.push_back(s.ocall_ns - s.forward_ns);
+        marshalling.push_back(std::max(0.0, s.total_ns - transitions - s.ocall_ns));
+        observed_ocalls += s.ocalls;
+    }
+    double mean_total = 0;
+    for (double t : total) mean_total += t;
+    mean_total /= total.size();
+    print_stage("total", total, mean_total);
+    print_stage("ecall_transition", ecall, mean_total);
+    print_stage("ocall_transition", ocall, mean_total);
+    print_stage("bert_forward", forward, mean_total);
+    print_stage("host_ocall", host_ocall, mean_total);
+    print_stage("marshalling", marshalling, mean_total);
+    if (observed_ocalls == 0) {
+        std::cout << "bench note: no host OCALLs ran on the client threads (in-enclave model or --switchless);"
+                  << " compute is counted under marshalling" << std::endl;
+    }
+}
@@ -0,0 +1,48 @@
+// openenclave_ml_poc/host/bench.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <openenclave/host.h>
+
+// Time the host OCALLs spend, and the share of it inside bert.cpp, added up
+// per thread. Without switchless calls an OCALL runs on the host thread that
+// made the ECALL, so the benchmark reads the counters back after every
+// request to split its latency into stages. The OCALLs feed them through
+// StageTimer (worker_metrics.h).
+struct OcallStageTimes {
+    uint64_t ocalls = 0;
+    uint64_t ocall_ns = 0;
+    uint64_t forward_ns = 0;
+};
+
+OcallStageTimes& thread_ocall_stage_times();
+
+struct BenchOptions {
+    // Timed ECALLs, shared by all client threads.
+    size_t requests = 1000;
+    // Client threads; each uses its own enclave session.
+    size_t concurrency = 1;
+    // Sequences per ECALL; above 1 requests go through enclave_infer_batch.
+    size_t batch = 1;
+    // Length of the synthetic sequence used when no corpus is given.
+    size_t seq_len = 8;
+    // Token corpus in the text protocol's input format; sequences are
+    // replayed in order and wrap around.
+    std::string corpus_path;
+};
+
+// Every sequence in path: one per line, or several per line separated by
+// ';', each a comma-separated list of token IDs. Throws if the file can't be
+// read or holds no sequences.
+std::vector<std::vector<int64_t>> load_bench_corpus(const std::string& path);
+
+// Replays the corpus against the enclave, one client thread per session,
+// and prints throughput, latency percentiles, and the split of latency into
+// ECALL transition, OCALL transition, bert_forward, the rest of the host
+// OCALL and marshalling. sessions must hold options.concurrency handles.
+void run_bench(oe_enclave_t* enclave, const std::vector<uint64_t>& sessions, size_t n_embd,
+               const BenchOptions& options);
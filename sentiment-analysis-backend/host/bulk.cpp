@@ -0,0 +1,403 @@
+// openenclave_ml_poc/host/bulk.cpp
+#include "bulk.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "enclave_u.h"
+#include "ggml.h"
+#include "wordpiece_tokenizer.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void check(oe_result_t result, const char* fn) {
+    if (result != OE_OK) throw std::runtime_error(std::string("[Host] ") + fn + " failed with " + oe_result_str(result));
+}
+
+std::runtime_error io_error(const std::string& what, const std::string& path) {
+    return std::runtime_error("[Host] " + what + " " + path + ": " + std::strerror(errno));
+}
+
+// Lines in the file at path, counting a last line without a newline, and
+// the file's size.
+size_t count_lines(const std::string& path, uint64_t& bytes) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) throw io_error("Failed to open bulk input", path);
+    std::vector<char> buffer(1 << 20);
+    size_t lines = 0;
+    bytes = 0;
+    char last = '\n';
+    for (size_t n; (n = std::fread(buffer.data(), 1, buffer.size(), file)) > 0;) {
+        for (const char* p = buffer.data(), *end = p + n; (p = static_cast<const char*>(std::memchr(p, '\n', end - p)));
+             ++p) {
+            ++lines;
+        }
+        bytes += n;
+        last = buffer[n - 1];
+    }
+    bool failed = std::ferror(file);
+    std::fclose(file);
+    if (failed) throw io_error("Failed to read bulk input", path);
+    return lines + (last != '\n');
+}
+
+// The output matrix, mapped shared so rows written through it reach the
+// file without a copy.
+class BulkOutput {
+public:
+    BulkOutput(const std::string& path, const BulkFileHeader& expected) : path_(path) {
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0) throw io_error("Failed to open bulk output", path);
+        row_bytes_ = expected.dim * (expected.dtype == 1 ? sizeof(ggml_fp16_t) : sizeof(float));
+        size_ = kBulkHeaderBytes + expected.count * row_bytes_;
+
+        struct stat st;
+        if (fstat(fd_, &st) != 0) throw io_error("Failed to stat bulk output", path);
+        bool resume = st.st_size > 0;
+        if (resume) {
+            BulkFileHeader existing;
+            if (pread(fd_, &existing, sizeof(existing), 0) != static_cast<ssize_t>(sizeof(existing)) ||
+                std::memcmp(existing.magic, kBulkMagic, sizeof(kBulkMagic)) != 0 ||
+                existing.version != kBulkVersion || existing.dtype != expected.dtype ||
+                existing.count != expected.count || existing.dim != expected.dim ||
+                existing.input_bytes != expected.input_bytes ||
+                std::memcmp(existing.model_digest, expected.model_digest, sizeof(existing.model_digest)) != 0 ||
+                static_cast<size_t>(st.st_size) != size_) {
+                close(fd_);
+                throw std::runtime_error("[Host] Bulk output " + path +
+                                         " exists but is not a checkpoint of this job; remove it to start over");
+            }
+        } else {
+            // Allocating every block up front turns a full disk into an
+            // error here rather than a SIGBUS on some row halfway through.
+            int err = posix_fallocate(fd_, 0, static_cast<off_t>(size_));
+            if (err != 0) {
+                close(fd_);
+                errno = err;
+                throw io_error("Failed to preallocate bulk output", path);
+            }
+        }
+
+        void* base = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (base == MAP_FAILED) {
+            close(fd_);
+            throw io_error("Failed to map bulk output", path);
+        }
+        base_ = static_cast<uint8_t*>(base);
+        if (!resume) {
+            std::memset(base_, 0, kBulkHeaderBytes);
+            std::memcpy(base_, &expected, sizeof(expected));
+            header()->completed = 0;
+            header()->failed = 0;
+            sync(0, 0);
+        }
+    }
+
+    ~BulkOutput() {
+        munmap(base_, size_);
+        close(fd_);
+    }
+    BulkOutput(const BulkOutput&) = delete;
+    BulkOutput& operator=(const BulkOutput&) = delete;
+
+    BulkFileHeader* header() { return reinterpret_cast<BulkFileHeader*>(base_); }
+    uint8_t* row(size_t index) { return base_ + kBulkHeaderBytes + index * row_bytes_; }
+    size_t row_bytes() const { return row_bytes_; }
+
+    // Flushes rows below completed, then records completed and the failed
+    // rows below it in the header and flushes that, so a checkpoint never
+    // covers rows still in memory.
+    void sync(size_t completed, size_t failed) {
+        if (msync(base_, kBulkHeaderBytes + completed * row_bytes_, MS_SYNC) != 0) {
+            throw io_error("Failed to flush bulk output", path_);
+        }
+        header()->completed = completed;
+        header()->failed = failed;
+        if (msync(base_, kBulkHeaderBytes, MS_SYNC) != 0) throw io_error("Failed to flush bulk output", path_);
+    }
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    uint8_t* base_ = nullptr;
+    size_t size_ = 0;
+    size_t row_bytes_ = 0;
+};
+
+// Appends the token IDs on line to tokens; false, with tokens unchanged
+// and error set, if the line is not a non-empty list of them.
+bool parse_token_line(const std::string& line, std::vector<int64_t>& tokens, std::string& error) {
+    size_t first = tokens.size();
+    const char* p = line.c_str();
+    while (*p) {
+        char* end = nullptr;
+        errno = 0;
+        long long value = std::strtoll(p, &end, 10);
+        if (end == p || errno != 0) {
+            tokens.resize(first);
+            error = "is not a comma-separated list of token IDs";
+            return false;
+        }
+        tokens.push_back(value);
+        p = end;
+        while (*p == ' ' || *p == '\t' || *p == '\r') ++p;
+        if (*p == ',') ++p;
+    }
+    if (tokens.size() == first) {
+        error = "holds no token IDs";
+        return false;
+    }
+    return true;
+}
+
+// Buffers of one worker thread, reused by every batch it runs.
+struct Worker {
+    std::vector<std::string> lines;
+    std::vector<int32_t> text_tokens;
+    std::vector<int64_t> tokens;
+    std::vector<uint64_t> offsets;
+    // Batch position of each sequence in tokens; lines that failed to parse
+    // have none.
+    std::vector<size_t> positions;
+    std::vector<bool> failed;
+    std::vector<uint64_t> single_offsets;
+    std::vector<float> output;
+};
+
+}  // namespace
+
+void run_bulk(oe_enclave_t* enclave, const std::vector<uint64_t>& sessions, size_t n_embd,
+              const Sha256::Digest& model_digest, const WordPieceTokenizer* tokenizer, const BulkOptions& options) {
+    if (options.text_input && !tokenizer) throw std::runtime_error("[Host] Bulk text input needs a tokenizer");
+
+    BulkFileHeader expected = {};
+    std::memcpy(expected.magic, kBulkMagic, sizeof(kBulkMagic));
+    expected.version = kBulkVersion;
+    expected.dtype = options.output_f16 ? 1 : 0;
+    expected.count = count_lines(options.input_path, expected.input_bytes);
+    expected.dim = n_embd;
+    std::memcpy(expected.model_digest, model_digest.data(), model_digest.size());
+    if (expected.count == 0) throw std::runtime_error("[Host] Bulk input " + options.input_path + " holds no lines");
+
+    BulkOutput output(options.output_path, expected);
+    const size_t count = expected.count;
+    const size_t resumed = output.header()->completed;
+    if (resumed >= count) {
+        std::cerr << "[Host] Bulk output " << options.output_path << " is already complete (" << count << " rows)"
+                  << std::endl;
+        return;
+    }
+    if (resumed > 0) std::cerr << "[Host] Resuming bulk job at row " << resumed << " of " << count << std::endl;
+
+    std::ifstream in(options.input_path);
+    if (!in) throw io_error("Failed to open bulk input", options.input_path);
+    for (size_t i = 0; i < resumed; ++i) in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+    const size_t batch = std::max<size_t>(1, options.batch);
+    const size_t checkpoint_rows = std::max<size_t>(1, options.checkpoint_rows);
+
+    // Batches finish out of order, so the checkpoint follows the end of the
+    // contiguous run of finished rows rather than the latest batch.
+    std::mutex input_mutex;
+    size_t next_row = resumed;
+    // Each finished batch maps its first row to its end and failed rows.
+    std::mutex progress_mutex;
+    std::map<size_t, std::pair<size_t, size_t>> finished;
+    size_t contiguous = resumed;
+    size_t contiguous_failed = output.header()->failed;
+    std::mutex checkpoint_mutex;
+    size_t checkpointed = resumed;
+    Clock::time_point start = Clock::now();
+
+    auto checkpoint = [&](size_t rows, size_t failed) {
+        output.sync(rows, failed);
+        checkpointed = rows;
+        double elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+        std::cerr << "[Host] Bulk: rows=" << rows << "/" << count << " failed=" << failed
+                  << " rows_per_s=" << (elapsed_s > 0 ? (rows - resumed) / elapsed_s : 0.0) << std::endl;
+    };
+
+    auto fail_row = [&](size_t row, const std::string& reason) {
+        std::cerr << "[Host] Bulk input line " << row + 1 << " " << reason << "; its row is left zero" << std::endl;
+    };
+
+    // Only a failed ECALL throws; the enclave's status is returned, since
+    // it rejects input it will not embed with OE_INVALID_PARAMETER.
+    auto infer = [&](uint64_t session, const int64_t* tokens, size_t num_tokens, const uint64_t* offsets,
+                     size_t num_sequences, float* out) {
+        size_t out_bytes = num_sequences * n_embd * sizeof(float);
+        oe_result_t ecall_ret_status = OE_FAILURE;
+        size_t actual_output_byte_size = 0;
+        check(enclave_infer_batch(enclave, &ecall_ret_status, session, tokens, num_tokens * sizeof(int64_t), offsets,
+                                  num_sequences + 1, out, out_bytes, &actual_output_byte_size),
+              "enclave_infer_batch");
+        if (ecall_ret_status == OE_OK && actual_output_byte_size != out_bytes) {
+            throw std::runtime_error("[Host] enclave_infer_batch returned " + std::to_string(actual_output_byte_size) +
+                                     " bytes, expected " + std::to_string(out_bytes));
+        }
+        return ecall_ret_status;
+    };
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    bool stop = false;
+    std::vector<std::thread> threads;
+    for (uint64_t session : sessions) {
+        threads.emplace_back([&, session] {
+            Worker worker;
+            try {
+                while (true) {
+                    size_t first;
+                    worker.lines.clear();
+                    {
+                        std::lock_guard<std::mutex> lock(input_mutex);
+                        if (stop) return;
+                        first = next_row;
+                        std::string line;
+                        while (worker.lines.size() < batch && next_row < count && std::getline(in, line)) {
+                            worker.lines.push_back(std::move(line));
+                            ++next_row;
+                        }
+                    }
+                    if (worker.lines.empty()) return;
+                    size_t rows = worker.lines.size();
+
+                    worker.tokens.clear();
+                    worker.offsets.assign(1, 0);
+                    worker.positions.clear();
+                    worker.failed.assign(rows, false);
+                    for (size_t i = 0; i < rows; ++i) {
+                        std::string error;
+                        if (options.text_input) {
+                            tokenizer->encode(worker.lines[i], worker.text_tokens);
+                            worker.tokens.insert(worker.tokens.end(), worker.text_tokens.begin(),
+                                                 worker.text_tokens.end());
+                            if (worker.text_tokens.empty()) error = "holds no tokens";
+                        } else {
+                            parse_token_line(worker.lines[i], worker.tokens, error);
+                        }
+                        if (!error.empty()) {
+                            fail_row(first + i, error);
+                            worker.failed[i] = true;
+                            continue;
+                        }
+                        worker.positions.push_back(i);
+                        worker.offsets.push_back(worker.tokens.size());
+                    }
+                    size_t sequences = worker.positions.size();
+
+                    // float32 rows of a batch without failed lines are the
+                    // ECALL's output buffer as they are; other batches go
+                    // through a buffer and are scattered.
+                    bool in_place = !options.output_f16 && sequences == rows;
+                    float* out = in_place ? reinterpret_cast<float*>(output.row(first)) : nullptr;
+                    if (!out) {
+                        worker.output.resize(sequences * n_embd);
+                        out = worker.output.data();
+                    }
+                    oe_result_t status = sequences == 0 ? OE_OK
+                                                        : infer(session, worker.tokens.data(), worker.tokens.size(),
+                                                                worker.offsets.data(), sequences, out);
+                    if (status == OE_INVALID_PARAMETER) {
+                        // Some sequence was refused; embed one at a time to
+                        // find which, so the rest of the batch still counts.
+                        worker.single_offsets.resize(2);
+                        worker.single_offsets[0] = 0;
+                        for (size_t k = 0; k < sequences; ++k) {
+                            size_t length = worker.offsets[k + 1] - worker.offsets[k];
+                            worker.single_offsets[1] = length;
+                            oe_result_t one = infer(session, worker.tokens.data() + worker.offsets[k], length,
+                                                    worker.single_offsets.data(), 1, out + k * n_embd);
+                            if (one == OE_INVALID_PARAMETER) {
+                                fail_row(first + worker.positions[k], "was refused by the enclave");
+                                worker.failed[worker.positions[k]] = true;
+                            } else {
+                                check(one, "enclave_infer_batch (enclave)");
+                            }
+                        }
+                    } else {
+                        check(status, "enclave_infer_batch (enclave)");
+                    }
+
+                    // A resumed job can find rows of an earlier attempt past
+                    // the checkpoint, so failed rows are zeroed explicitly.
+                    size_t failed_rows = 0;
+                    for (size_t k = 0; !in_place && k < sequences; ++k) {
+                        size_t i = worker.positions[k];
+                        if (worker.failed[i]) continue;
+                        if (options.output_f16) {
+                            ggml_fp32_to_fp16_row(out + k * n_embd,
+                                                  reinterpret_cast<ggml_fp16_t*>(output.row(first + i)),
+                                                  static_cast<int64_t>(n_embd));
+                        } else {
+                            std::memcpy(output.row(first + i), out + k * n_embd, n_embd * sizeof(float));
+                        }
+                    }
+                    for (size_t i = 0; i < rows; ++i) {
+                        if (!worker.failed[i]) continue;
+                        std::memset(output.row(first + i), 0, output.row_bytes());
+                        ++failed_rows;
+                    }
+
+                    size_t done;
+                    size_t done_failed;
+                    {
+                        std::lock_guard<std::mutex> lock(progress_mutex);
+                        finished.emplace(first, std::make_pair(first + rows, failed_rows));
+                        while (!finished.empty() && finished.begin()->first == contiguous) {
+                            contiguous = finished.begin()->second.first;
+                            contiguous_failed += finished.begin()->second.second;
+                            finished.erase(finished.begin());
+                        }
+                        done = contiguous;
+                        done_failed = contiguous_failed;
+                    }
+                    // Whoever finds a checkpoint running leaves it to that
+                    // thread and carries on computing.
+                    std::unique_lock<std::mutex> lock(checkpoint_mutex, std::try_to_lock);
+                    if (lock.owns_lock() && done < count && done - checkpointed >= checkpoint_rows) {
+                        checkpoint(done, done_failed);
+                    }
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                std::lock_guard<std::mutex> input_lock(input_mutex);
+                stop = true;
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+
+    // A failed job keeps what it finished, so rerunning it resumes there.
+    if (!error && contiguous < count) {
+        error = std::make_exception_ptr(std::runtime_error(
+            "[Host] Bulk input " + options.input_path + " ended at row " + std::to_string(contiguous) + " of " +
+            std::to_string(count) + "; it changed while the job ran"));
+    }
+    if (contiguous > checkpointed || contiguous == count) checkpoint(contiguous, contiguous_failed);
+    if (error) std::rethrow_exception(error);
+    if (contiguous_failed > 0) {
+        std::cerr << "[Host] Bulk output " << options.output_path << " has " << contiguous_failed
+                  << " zero rows for lines that could not be embedded" << std::endl;
+    }
+}
@@ -0,0 +1,70 @@
+// openenclave_ml_poc/host/bulk.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <openenclave/host.h>
+
+#include "sha256.h"
+
+class WordPieceTokenizer;
+
+// Header of a bulk embedding file, followed by count rows of dim float32 or
+// float16 values. The rows start at kBulkHeaderBytes, so a reader can map
+// the file and index the matrix directly; row i is line i of the input.
+//
+// completed is the checkpoint: rows below it were flushed to disk before it
+// was written. A file with completed < count is a job that stopped early and
+// is resumed by running the same --bulk command again.
+//
+// A line that cannot be embedded (not token IDs, no tokens, longer than the
+// model takes) is logged and gets an all-zero row, which no embedding is;
+// failed counts them below completed.
+#pragma pack(push, 1)
+struct BulkFileHeader {
+    char magic[8];
+    uint32_t version;
+    // 0 float32, 1 float16; the binary protocol's dtype values.
+    uint32_t dtype;
+    uint64_t count;
+    uint64_t dim;
+    uint64_t completed;
+    // Size of the input file, so a resume against a different corpus fails
+    // instead of mixing the two.
+    uint64_t input_bytes;
+    // SHA-256 of the model file the rows were computed with.
+    uint8_t model_digest[32];
+    uint64_t failed;
+};
+#pragma pack(pop)
+
+constexpr char kBulkMagic[8] = {'M', 'L', 'P', 'O', 'C', 'E', 'M', 'B'};
+constexpr uint32_t kBulkVersion = 1;
+constexpr size_t kBulkHeaderBytes = 128;
+static_assert(sizeof(BulkFileHeader) <= kBulkHeaderBytes, "bulk header outgrew its reserved space");
+
+struct BulkOptions {
+    std::string input_path;
+    std::string output_path;
+    // Input lines are raw text for the tokenizer instead of comma-separated
+    // token IDs.
+    bool text_input = false;
+    bool output_f16 = false;
+    // Sequences per enclave_infer_batch call.
+    size_t batch = 32;
+    // Rows between checkpoints; each one flushes the rows written so far.
+    size_t checkpoint_rows = 4096;
+};
+
+// Embeds every line of options.input_path into the matrix file at
+// options.output_path, with one enclave session per worker thread. The
+// input is read twice: once to count its lines and size the output, then
+// streamed in batches. If the output already holds a matching unfinished
+// job, only the rows past its checkpoint are computed. Throws on I/O errors,
+// a mismatching existing output or a failed ECALL; bad lines only fail
+// their own rows.
+void run_bulk(oe_enclave_t* enclave, const std::vector<uint64_t>& sessions, size_t n_embd,
+              const Sha256::Digest& model_digest, const WordPieceTokenizer* tokenizer, const BulkOptions& options);
@@ -0,0 +1,105 @@
+// openenclave_ml_poc/host/cpu_topology.cpp
+#include "cpu_topology.h"
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+
+namespace {
+
+// Parses sysfs CPU lists such as "0-3,8,10-11".
+std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty()) continue;
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        } catch (const std::exception&) {
+            // Ignore malformed entries rather than failing the whole list.
+        }
+    }
+    return cpus;
+}
+
+} // namespace
+
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<int> physical_core_cpus() {
+    std::vector<int> allowed = allowed_cpus();
+    std::set<int> allowed_set(allowed.begin(), allowed.end());
+    std::set<int> seen;
+    std::vector<int> cores;
+    for (int cpu : allowed) {
+        if (seen.count(cpu)) continue;
+        std::ifstream in("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+        std::string list;
+        std::vector<int> siblings = (in >> list) ? parse_cpu_list(list) : std::vector<int>{cpu};
+        int chosen = -1;
+        for (int sibling : siblings) {
+            seen.insert(sibling);
+            if (chosen < 0 && allowed_set.count(sibling)) chosen = sibling;
+        }
+        cores.push_back(chosen >= 0 ? chosen : cpu);
+    }
+    return cores;
+}
+
+bool pin_current_thread(const std::vector<int>& cpus) {
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+std::vector<int> numa_nodes() {
+    std::ifstream in("/sys/devices/system/node/online");
+    std::string list;
+    std::vector<int> nodes = (in >> list) ? parse_cpu_list(list) : std::vector<int>{};
+    if (nodes.empty()) nodes.push_back(0);
+    return nodes;
+}
+
+std::vector<int> numa_node_cpus(int node) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    if (!(in >> list)) return node == 0 ? allowed_cpus() : std::vector<int>{};
+    std::vector<int> allowed = allowed_cpus();
+    std::vector<int> cpus;
+    for (int cpu : parse_cpu_list(list)) {
+        if (std::binary_search(allowed.begin(), allowed.end(), cpu)) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+bool prefer_numa_node(int node) {
+    if (node < 0 || node >= 64) return false;
+    unsigned long mask = 1ul << node;
+    // No libnuma dependency for one syscall; maxnode counts bits of mask.
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) == 0;
+}
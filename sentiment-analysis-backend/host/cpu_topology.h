@@ -0,0 +1,28 @@
+// openenclave_ml_poc/host/cpu_topology.h
+#pragma once
+
+#include <vector>
+
+// Logical CPUs this process may run on (its current affinity mask).
+std::vector<int> allowed_cpus();
+
+// One logical CPU per physical core among the allowed CPUs: the first
+// hyperthread sibling of each core, as reported by sysfs.
+std::vector<int> physical_core_cpus();
+
+// Restricts the calling thread, and every thread it creates afterwards, to
+// the given CPUs. Returns false if the mask could not be applied.
+bool pin_current_thread(const std::vector<int>& cpus);
+
+// Online NUMA nodes, in ascending order; {0} on kernels without NUMA sysfs.
+std::vector<int> numa_nodes();
+
+// The allowed logical CPUs of one NUMA node.
+std::vector<int> numa_node_cpus(int node);
+
+// Makes node the preferred node for the calling thread's future memory
+// allocations (set_mempolicy MPOL_PREFERRED), inherited like the affinity
+// mask. Preferred rather than bound, so a full node falls back to remote
+// memory instead of failing allocations. Returns false if the kernel
+// refused the policy.
+bool prefer_numa_node(int node);
@@ -0,0 +1,88 @@
+// openenclave_ml_poc/host/embedding_cache.cpp
+#include "embedding_cache.h"
+
+#include <cstring>
+
+EmbeddingCache::EmbeddingCache(size_t max_bytes)
+    : shard_budget_(max_bytes / kShards), shards_(new Shard[kShards]) {}
+
+uint64_t EmbeddingCache::hash_tokens(const int32_t* tokens, size_t count) {
+    // Multiply-xorshift over whole tokens; much faster than a bytewise hash
+    // and plenty for bucketing, since hits are confirmed by full compare.
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ count;
+    for (size_t i = 0; i < count; ++i) {
+        h ^= static_cast<uint32_t>(tokens[i]);
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+    }
+    h *= 0x94D049BB133111EBull;
+    return h ^ (h >> 29);
+}
+
+size_t EmbeddingCache::entry_bytes(size_t count, size_t n_embd) {
+    // Payload plus list node, index slot and vector headers.
+    return count * sizeof(int32_t) + n_embd * sizeof(float) + sizeof(Entry) + 64;
+}
+
+bool EmbeddingCache::lookup(const int32_t* tokens, size_t count, std::vector<float>& out) {
+    uint64_t hash = hash_tokens(tokens, count);
+    Shard& s = shard(hash);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.index.find(hash);
+        if (it != s.index.end()) {
+            const Entry& entry = *it->second;
+            if (entry.tokens.size() == count &&
+                memcmp(entry.tokens.data(), tokens, count * sizeof(int32_t)) == 0) {
+                s.lru.splice(s.lru.begin(), s.lru, it->second);
+                out.assign(entry.embedding.begin(), entry.embedding.end());
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void EmbeddingCache::insert(const int32_t* tokens, size_t count, const float* embedding, size_t n_embd) {
+    size_t bytes = entry_bytes(count, n_embd);
+    if (bytes > shard_budget_) return;
+
+    uint64_t hash = hash_tokens(tokens, count);
+    Shard& s = shard(hash);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    // A concurrent miss on the same input may have inserted it already;
+    // on a hash collision the newer sequence replaces the older one.
+    auto it = s.index.find(hash);
+    if (it != s.index.end()) {
+        s.bytes -= entry_bytes(it->second->tokens.size(), it->second->embedding.size());
+        s.lru.erase(it->second);
+        s.index.erase(it);
+    }
+
+    while (s.bytes + bytes > shard_budget_ && !s.lru.empty()) {
+        const Entry& victim = s.lru.back();
+        s.bytes -= entry_bytes(victim.tokens.size(), victim.embedding.size());
+        s.index.erase(victim.hash);
+        s.lru.pop_back();
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    s.lru.push_front(Entry{hash, std::vector<int32_t>(tokens, tokens + count),
+                           std::vector<float>(embedding, embedding + n_embd)});
+    s.index.emplace(hash, s.lru.begin());
+    s.bytes += bytes;
+    insertions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+EmbeddingCache::Stats EmbeddingCache::stats() const {
+    Stats stats = {hits_.load(), misses_.load(), insertions_.load(), evictions_.load(), 0, 0};
+    for (size_t i = 0; i < kShards; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        stats.entries += shards_[i].lru.size();
+        stats.bytes += shards_[i].bytes;
+    }
+    return stats;
+}
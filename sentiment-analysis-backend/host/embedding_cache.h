@@ -0,0 +1,67 @@
+// openenclave_ml_poc/host/embedding_cache.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Bounded LRU cache of embeddings keyed by token sequence, so repeated
+// inputs skip the enclave round trip and the forward pass entirely. Entries
+// are found by a 64-bit hash of the tokens and confirmed by comparing the
+// full sequence, so a hash collision is a miss, never a wrong answer.
+// Sharded by hash so compute threads rarely contend; each shard runs its own
+// LRU over an equal share of the memory budget.
+class EmbeddingCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t insertions;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    explicit EmbeddingCache(size_t max_bytes);
+
+    // Copies the cached embedding for tokens into out and marks it most
+    // recently used. Returns false on a miss.
+    bool lookup(const int32_t* tokens, size_t count, std::vector<float>& out);
+    void insert(const int32_t* tokens, size_t count, const float* embedding, size_t n_embd);
+
+    Stats stats() const;
+
+    static uint64_t hash_tokens(const int32_t* tokens, size_t count);
+
+private:
+    static constexpr size_t kShards = 16;
+
+    struct Entry {
+        uint64_t hash;
+        std::vector<int32_t> tokens;
+        std::vector<float> embedding;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        // Most recently used first.
+        std::list<Entry> lru;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    static size_t entry_bytes(size_t count, size_t n_embd);
+    Shard& shard(uint64_t hash) { return shards_[(hash >> 56) % kShards]; }
+
+    const size_t shard_budget_;
+    std::unique_ptr<Shard[]> shards_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> insertions_{0};
+    std::atomic<uint64_t> evictions_{0};
+};
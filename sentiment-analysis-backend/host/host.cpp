@@ -4,21 +4,51 @@
 #include <string>
 #include <stdexcept>
 #include <filesystem>
+#include <memory>
 #include <map>
 #include <sstream>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <unistd.h>
 
 #include <openenclave/host.h>
 #include <openenclave/bits/result.h>
+#include "attestation_cache.h"
+#include "bench.h"
+#include "bulk.h"
 #include "bert.h"
+#include "classifier_head.h"
+#include "cpu_topology.h"
+#include "embedding_cache.h"
 #include "enclave_u.h"
+#include "model_file.h"
+#include "model_registry.h"
+#include "packed_batch.h"
+#include "scratch_arena.h"
+#include "session_table.h"
+#include "sha256.h"
+#include "shm_ring.h"
+#include "startup_profile.h"
+#include "supervisor.h"
+#include "worker_pipeline.h"
+#include "wordpiece_tokenizer.h"
+#include "worker_metrics.h"
+#include "worker_protocol.h"
 #include <cstdlib> // for free()
 
 // --- NEW INCLUDES for Attestation ---
 #include <iomanip> // For std::hex
 
 
+// NumTCS the enclave was built with (enclave/CMakeLists.txt passes the same
+// value to both targets).
+#ifndef ENCLAVE_NUM_TCS
+#define ENCLAVE_NUM_TCS 8
+#endif
+
 #define OE_HOST_CHECK(oe_result, fn) \
     do { \
         if ((oe_result) != OE_OK) { \
@@ -28,11 +58,52 @@
         } \
     } while (0)
 
-static std::map<uint64_t, bert_ctx*> g_sessions;
-static uint64_t g_next_session_handle = 1;
+// A host-side GGML session: a reference to the shared model plus the
+// compute settings it was created with. Forward passes borrow a compute
+// context from the model, so sessions are cheap to create and hold no
+// buffers of their own.
+typedef struct _host_ml_session {
+    std::shared_ptr<HostModel> model;
+    // Upper bound on GGML threads for one forward pass of this session.
+    int n_threads = 1;
+} host_ml_session_t;
+
+// OCALLs arrive concurrently from every enclave TCS, so sessions live in a
+// sharded table.
+static SessionTable<host_ml_session_t> g_sessions;
+// Models shared by all sessions, and the most compute contexts (full
+// bert_ctx copies) one model may hold. Defaults to the number of compute
+// threads, so each pipeline worker gets a context without waiting.
+static ModelRegistry g_models;
+static size_t g_max_model_contexts = 0;
+// Sequence lengths compute contexts may be sized for (--length-buckets);
+// empty sizes every context for the model maximum.
+static std::vector<int> g_length_buckets;
+// Embeddings of recently seen token sequences (--cache-mb); null when
+// caching is disabled.
+static std::unique_ptr<EmbeddingCache> g_embedding_cache;
+// Tokenizer for text requests (--tokenizer-dir); null when requests carry
+// token IDs only.
+static std::unique_ptr<WordPieceTokenizer> g_tokenizer;
+// Serialized classifier head (--head, common/classifier_head.h) given to
+// every enclave session; empty when there is none.
+static std::vector<uint8_t> g_head;
 static std::string g_model_path;
 // Set when the model is loaded to size output tensors appropriately
-static int g_embedding_dim = 0;
+static std::atomic<int> g_embedding_dim{0};
+// Number of sequences a single bert_forward_batch call may evaluate; the
+// compute buffers of every session are allocated for this many sequences.
+static int g_max_batch_size = 8;
+// GGML thread settings applied to sessions created by ocall_ggml_load_model.
+// A forward pass uses one thread per g_min_tokens_per_thread tokens, capped
+// at the session's n_threads, so short inputs skip thread spin-up costs.
+static int g_n_threads = 1;
+static int g_min_tokens_per_thread = 32;
+
+static int threads_for_tokens(const host_ml_session_t& session, size_t num_tokens) {
+    size_t wanted = num_tokens / static_cast<size_t>(g_min_tokens_per_thread);
+    return static_cast<int>(std::max<size_t>(1, std::min<size_t>(wanted, session.n_threads)));
+}
 
 
 // Helper function to convert a byte buffer to a hex string for printing
@@ -45,21 +116,97 @@ std::string to_hex_string(const unsigned char* buffer, size_t size) {
     return ss.str();
 }
 
-std::vector<unsigned char> load_file_to_buffer(const std::string& filepath) {
-    if (!std::filesystem::exists(filepath)) {
-        throw std::runtime_error("[Host] File not found: " + filepath);
+// Model files mapped by this process, keyed by path. A mapping stays alive
+// for the lifetime of the process so the weights remain resident in the
+// shared page cache and a restarted worker (or a sibling worker on the same
+// node) reloads them without touching the disk.
+static ModelMapOptions g_model_map_options;
+static std::map<std::string, std::unique_ptr<MappedModelFile>> g_model_files;
+static std::map<std::string, Sha256::Digest> g_model_digests;
+// Guards g_model_files and g_model_digests.
+static std::mutex g_model_files_mutex;
+
+static const MappedModelFile& map_model_file_locked(const std::string& model_path) {
+    auto it = g_model_files.find(model_path);
+    if (it == g_model_files.end()) {
+        it = g_model_files.emplace(
+            model_path, std::make_unique<MappedModelFile>(model_path, g_model_map_options)).first;
     }
-    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
-        throw std::runtime_error("[Host] Failed to open file: " + filepath);
+    return *it->second;
+}
+
+static const MappedModelFile& map_model_file(const std::string& model_path) {
+    std::lock_guard<std::mutex> lock(g_model_files_mutex);
+    return map_model_file_locked(model_path);
+}
+
+// Digests are cached next to the model as "<model>.sha256" together with the
+// file size and mtime, so a worker restart does not rehash hundreds of MB.
+static bool read_cached_digest(const MappedModelFile& file, Sha256::Digest& digest) {
+    std::ifstream in(file.path() + ".sha256");
+    std::string hex;
+    size_t size = 0;
+    int64_t mtime_ns = 0;
+    if (!(in >> hex >> size >> mtime_ns) || size != file.size() || mtime_ns != file.mtime_ns() ||
+        hex.size() != digest.size() * 2) {
+        return false;
     }
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    std::vector<unsigned char> buffer(static_cast<size_t>(size));
-    if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-        throw std::runtime_error("[Host] Failed to read file into buffer: " + filepath);
+    try {
+        for (size_t i = 0; i < digest.size(); ++i) {
+            digest[i] = static_cast<unsigned char>(std::stoul(hex.substr(i * 2, 2), nullptr, 16));
+        }
+    } catch (const std::exception&) {
+        return false;
     }
-    return buffer;
+    return true;
+}
+
+static void write_cached_digest(const MappedModelFile& file, const Sha256::Digest& digest) {
+    // Best effort: the model directory is often read-only in containers.
+    std::ofstream out(file.path() + ".sha256", std::ios::trunc);
+    if (out) {
+        out << digest_to_hex(digest.data(), digest.size()) << " " << file.size() << " "
+            << file.mtime_ns() << "\n";
+    }
+}
+
+static const Sha256::Digest& model_file_digest(const std::string& model_path) {
+    std::lock_guard<std::mutex> lock(g_model_files_mutex);
+    auto it = g_model_digests.find(model_path);
+    if (it == g_model_digests.end()) {
+        const MappedModelFile& file = map_model_file_locked(model_path);
+        Sha256::Digest digest;
+        if (!read_cached_digest(file, digest)) {
+            digest = Sha256::hash(file.data(), file.size());
+            write_cached_digest(file, digest);
+        }
+        it = g_model_digests.emplace(model_path, digest).first;
+    }
+    return it->second;
+}
+
+// Registers a host session for the model at model_path, loading the model
+// only if no other session holds it. Returns the session handle, or 0 if
+// loading failed.
+static uint64_t create_host_session(const std::string& model_path) {
+    // Map the file first so the loader below reads from the shared page
+    // cache and the pages stay resident for later restarts.
+    try {
+        map_model_file(model_path);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 0;
+    }
+
+    auto session = std::make_shared<host_ml_session_t>();
+    session->model = g_models.get_or_load(model_path, g_max_model_contexts, g_max_batch_size, g_length_buckets);
+    if (!session->model)
+        return 0;
+    session->n_threads = g_n_threads;
+
+    // Capture the embedding dimension from this model
+    g_embedding_dim = session->model->n_embd();
+    return g_sessions.insert(std::move(session));
 }
 
 oe_result_t ocall_ggml_load_model(
@@ -76,15 +223,52 @@ oe_result_t ocall_ggml_load_model(
     *host_return_value = OE_FAILURE;
     *host_session_handle_out = 0;
 
-    bert_ctx* ctx = bert_load_from_file(g_model_path.c_str(), true);
-    if (!ctx)
+    uint64_t handle = create_host_session(g_model_path);
+    if (handle == 0)
+        return OE_OK;
+
+    *host_session_handle_out = handle;
+    *host_return_value = OE_OK;
+    return OE_OK;
+}
+
+oe_result_t ocall_ggml_load_model_by_ref(
+    oe_result_t* ocall_host_ret,
+    oe_result_t* host_return_value,
+    uint64_t* host_session_handle_out,
+    const char* model_id,
+    const unsigned char* model_digest,
+    size_t model_digest_size)
+{
+    if (!ocall_host_ret || !host_return_value || !host_session_handle_out)
+        return OE_INVALID_PARAMETER;
+
+    *ocall_host_ret = OE_OK;
+    *host_return_value = OE_FAILURE;
+    *host_session_handle_out = 0;
+
+    if (!model_id || !model_digest || model_digest_size != Sha256::kDigestSize) {
+        *host_return_value = OE_INVALID_PARAMETER;
+        return OE_OK;
+    }
+
+    try {
+        const Sha256::Digest& digest = model_file_digest(model_id);
+        if (memcmp(digest.data(), model_digest, Sha256::kDigestSize) != 0) {
+            std::cerr << "[Host] Model digest mismatch for " << model_id << std::endl;
+            *host_return_value = OE_VERIFY_FAILED;
+            return OE_OK;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        *host_return_value = OE_NOT_FOUND;
+        return OE_OK;
+    }
+
+    uint64_t handle = create_host_session(model_id);
+    if (handle == 0)
         return OE_OK;
 
-    // Capture the embedding dimension from this model
-    g_embedding_dim = bert_n_embd(ctx);
-    bert_allocate_buffers(ctx, bert_n_max_tokens(ctx), 1);
-    uint64_t handle = g_next_session_handle++;
-    g_sessions[handle] = ctx;
     *host_session_handle_out = handle;
     *host_return_value = OE_OK;
     return OE_OK;
@@ -106,38 +290,154 @@ oe_result_t ocall_ggml_run_inference(
     *ocall_host_ret = OE_OK;
     *host_return_value = OE_FAILURE;
 
-    auto it = g_sessions.find(host_session_handle);
-    if (it == g_sessions.end()) {
+    OcallStageTimes& stage_times = thread_ocall_stage_times();
+    ++stage_times.ocalls;
+    StageTimer ocall_timer(worker_metrics().ocall, &stage_times.ocall_ns);
+
+    std::shared_ptr<host_ml_session_t> session = g_sessions.find(host_session_handle);
+    if (!session) {
         *host_return_value = OE_NOT_FOUND;
         return OE_OK;
     }
 
-    bert_ctx* ctx = it->second;
     size_t num_tokens = input_len_bytes / sizeof(int64_t);
     const int64_t* tokens64 = static_cast<const int64_t*>(input_data_from_enclave);
-    bert_tokens tokens;
-    tokens.reserve(num_tokens);
-    for (size_t i = 0; i < num_tokens; ++i) {
-        tokens.push_back(static_cast<bert_token>(tokens64[i]));
+
+    // The embedding is written straight into the marshalled output buffer,
+    // so check its size before doing any work.
+    size_t required = static_cast<size_t>(session->model->n_embd()) * sizeof(float);
+    if (actual_output_len_bytes_out)
+        *actual_output_len_bytes_out = required;
+    if (required > output_buf_len_bytes) {
+        *host_return_value = OE_BUFFER_TOO_SMALL;
+        return OE_OK;
+    }
+
+    if (num_tokens == 0 || num_tokens > static_cast<size_t>(session->model->n_max_tokens())) {
+        *host_return_value = OE_INVALID_PARAMETER;
+        return OE_OK;
     }
 
-    int n_embd = bert_n_embd(ctx);
-    std::vector<float> embeddings(n_embd);
-    bert_forward(ctx, tokens, embeddings.data(), 1);
+    HostModel::Lease ctx = session->model->acquire(num_tokens);
+    if (!ctx.get()) {
+        *host_return_value = OE_OUT_OF_MEMORY;
+        return OE_OK;
+    }
+    // bert.cpp takes the token vector by value and copies it; converting
+    // into the context's buffer at least keeps that the only allocation.
+    bert_tokens& tokens = ctx.tokens();
+    tokens.assign(tokens64, tokens64 + num_tokens);
+    {
+        StageTimer forward_timer(worker_metrics().forward, &stage_times.forward_ns);
+        bert_forward(ctx.get(), tokens, static_cast<float*>(output_data_to_enclave),
+                     threads_for_tokens(*session, num_tokens));
+        worker_metrics().forward_tokens.fetch_add(num_tokens, std::memory_order_relaxed);
+        worker_metrics().forward_padded_tokens.fetch_add(num_tokens, std::memory_order_relaxed);
+    }
+
+    *host_return_value = OE_OK;
+    return OE_OK;
+}
+
+oe_result_t ocall_ggml_run_inference_batch(
+    oe_result_t* ocall_host_ret,
+    oe_result_t* host_return_value,
+    uint64_t host_session_handle,
+    const void* input_data_from_enclave,
+    size_t input_len_bytes,
+    const uint64_t* sequence_offsets,
+    size_t offset_count,
+    void* output_data_to_enclave,
+    size_t output_buf_len_bytes,
+    size_t* actual_output_len_bytes_out)
+{
+    if (!ocall_host_ret || !host_return_value)
+        return OE_INVALID_PARAMETER;
+
+    *ocall_host_ret = OE_OK;
+    *host_return_value = OE_FAILURE;
+
+    OcallStageTimes& stage_times = thread_ocall_stage_times();
+    ++stage_times.ocalls;
+    StageTimer ocall_timer(worker_metrics().ocall, &stage_times.ocall_ns);
 
-    size_t required = embeddings.size() * sizeof(float);
+    std::shared_ptr<host_ml_session_t> session = g_sessions.find(host_session_handle);
+    if (!session) {
+        *host_return_value = OE_NOT_FOUND;
+        return OE_OK;
+    }
+
+    size_t num_tokens = input_len_bytes / sizeof(int64_t);
+    if (!sequence_offsets || offset_count < 2 || sequence_offsets[offset_count - 1] != num_tokens) {
+        *host_return_value = OE_INVALID_PARAMETER;
+        return OE_OK;
+    }
+
+    size_t num_sequences = offset_count - 1;
+    size_t n_embd = static_cast<size_t>(session->model->n_embd());
+    size_t required = num_sequences * n_embd * sizeof(float);
     if (actual_output_len_bytes_out)
         *actual_output_len_bytes_out = required;
-
-    if (required <= output_buf_len_bytes) {
-        memcpy(output_data_to_enclave, embeddings.data(), required);
-        *host_return_value = OE_OK;
-    } else {
+    if (required > output_buf_len_bytes) {
         *host_return_value = OE_BUFFER_TOO_SMALL;
+        return OE_OK;
+    }
+
+    const int64_t* tokens64 = static_cast<const int64_t*>(input_data_from_enclave);
+    size_t max_tokens = static_cast<size_t>(session->model->n_max_tokens());
+    float* output = static_cast<float*>(output_data_to_enclave);
+
+    for (size_t s = 0; s < num_sequences; ++s) {
+        uint64_t begin = sequence_offsets[s];
+        uint64_t end = sequence_offsets[s + 1];
+        if (end <= begin || end - begin > max_tokens) {
+            *host_return_value = OE_INVALID_PARAMETER;
+            return OE_OK;
+        }
+    }
+
+    // Each pass holds at most g_max_batch_size sequences of similar length,
+    // since that is what the compute buffers were allocated for, and runs on
+    // a context for its own longest sequence's bucket.
+    thread_local std::vector<size_t> order;
+    thread_local std::vector<PackedPass> passes;
+    plan_packed_passes(sequence_offsets, num_sequences, static_cast<size_t>(g_max_batch_size), order, passes);
+    for (const PackedPass& pass : passes) {
+        HostModel::Lease ctx = session->model->acquire(pass.longest);
+        if (!ctx.get()) {
+            *host_return_value = OE_OUT_OF_MEMORY;
+            return OE_OK;
+        }
+        bert_batch& batch = ctx.batch();
+        batch.resize(pass.last - pass.first);
+        for (size_t i = pass.first; i < pass.last; ++i) {
+            size_t s = order[i];
+            batch[i - pass.first].assign(tokens64 + sequence_offsets[s], tokens64 + sequence_offsets[s + 1]);
+        }
+        bool in_place = packed_pass_in_place(order, pass);
+        std::vector<float>& rows = ctx.rows();
+        if (!in_place) rows.resize(batch.size() * n_embd);
+        worker_metrics().forward_tokens.fetch_add(pass.tokens, std::memory_order_relaxed);
+        worker_metrics().forward_padded_tokens.fetch_add(batch.size() * pass.longest, std::memory_order_relaxed);
+        {
+            StageTimer forward_timer(worker_metrics().forward, &stage_times.forward_ns);
+            bert_forward_batch(ctx.get(), batch, in_place ? output + pass.first * n_embd : rows.data(),
+                               threads_for_tokens(*session, pass.tokens));
+        }
+        if (!in_place) {
+            for (size_t i = pass.first; i < pass.last; ++i) {
+                std::memcpy(output + order[i] * n_embd, rows.data() + (i - pass.first) * n_embd,
+                            n_embd * sizeof(float));
+            }
+        }
     }
+
+    *host_return_value = OE_OK;
     return OE_OK;
 }
 
+void ocall_ping() {}
+
 oe_result_t ocall_ggml_release_session(
     oe_result_t* ocall_host_ret,
     oe_result_t* host_return_value,
@@ -149,10 +449,8 @@ oe_result_t ocall_ggml_release_session(
     *ocall_host_ret = OE_OK;
     *host_return_value = OE_FAILURE;
 
-    auto it = g_sessions.find(host_session_handle);
-    if (it != g_sessions.end()) {
-        bert_free(it->second);
-        g_sessions.erase(it);
+    // The model is unloaded once no session or in-flight OCALL holds it.
+    if (g_sessions.erase(host_session_handle)) {
         *host_return_value = OE_OK;
     } else {
         *host_return_value = OE_NOT_FOUND;
@@ -160,13 +458,427 @@ oe_result_t ocall_ggml_release_session(
     return OE_OK;
 }
 
+// Text protocol: one line of comma-separated token IDs in, one line of
+// comma-separated floats out. With text_input, each line is raw text for
+// g_tokenizer instead.
+static void run_text_worker(oe_enclave_t* enclave, uint64_t enclave_ml_session_handle, bool text_input) {
+    oe_result_t ecall_ret_status;
+    std::string line;
+    std::vector<int32_t> text_tokens;
+    while (std::getline(std::cin, line)) {
+        if (line == "quit" || line == "exit")
+            break;
+        if (line.empty())
+            continue;
+
+        // A line holds one sequence of comma-separated token IDs, or
+        // several sequences separated by ';' which are evaluated in a
+        // single batched call and answered with one line each.
+        std::vector<int64_t> input_tensor_values;
+        std::vector<uint64_t> sequence_offsets{0};
+        if (text_input) {
+            g_tokenizer->encode(line, text_tokens);
+            input_tensor_values.assign(text_tokens.begin(), text_tokens.end());
+            sequence_offsets.push_back(input_tensor_values.size());
+        }
+        std::stringstream ss(text_input ? std::string() : line);
+        std::string sequence_str;
+        while (std::getline(ss, sequence_str, ';')) {
+            std::stringstream seq_ss(sequence_str);
+            std::string value_str;
+            while (std::getline(seq_ss, value_str, ',')) {
+                if (!value_str.empty()) {
+                    input_tensor_values.push_back(std::stoll(value_str));
+                }
+            }
+            if (input_tensor_values.size() > sequence_offsets.back())
+                sequence_offsets.push_back(input_tensor_values.size());
+        }
+        size_t num_sequences = sequence_offsets.size() - 1;
+        if (num_sequences == 0)
+            continue;
+
+        size_t input_data_byte_size = input_tensor_values.size() * sizeof(int64_t);
+        // Allocate buffer based on the model's embedding dimension
+        std::vector<float> output_tensor_values(num_sequences * g_embedding_dim);
+        size_t output_buffer_byte_size = output_tensor_values.size() * sizeof(float);
+        size_t actual_output_byte_size = 0;
+
+        // The line is answered from the cache only if every sequence on it
+        // hits; otherwise it goes to the enclave as a whole.
+        std::vector<int32_t> cache_key;
+        std::vector<float> cached;
+        bool all_cached = g_embedding_cache != nullptr;
+        for (size_t s = 0; s < num_sequences && all_cached; ++s) {
+            cache_key.assign(input_tensor_values.begin() + sequence_offsets[s],
+                             input_tensor_values.begin() + sequence_offsets[s + 1]);
+            all_cached = g_embedding_cache->lookup(cache_key.data(), cache_key.size(), cached) &&
+                         cached.size() == static_cast<size_t>(g_embedding_dim);
+            if (all_cached) std::copy(cached.begin(), cached.end(), output_tensor_values.begin() + s * g_embedding_dim);
+        }
+
+        if (all_cached) {
+            actual_output_byte_size = output_buffer_byte_size;
+        } else if (num_sequences == 1) {
+            OE_HOST_CHECK(enclave_infer(
+                enclave, &ecall_ret_status, enclave_ml_session_handle,
+                input_tensor_values.data(), input_data_byte_size,
+                output_tensor_values.data(), output_buffer_byte_size,
+                &actual_output_byte_size), "enclave_infer");
+            OE_HOST_CHECK(ecall_ret_status, "enclave_infer (enclave)");
+        } else {
+            OE_HOST_CHECK(enclave_infer_batch(
+                enclave, &ecall_ret_status, enclave_ml_session_handle,
+                input_tensor_values.data(), input_data_byte_size,
+                sequence_offsets.data(), sequence_offsets.size(),
+                output_tensor_values.data(), output_buffer_byte_size,
+                &actual_output_byte_size), "enclave_infer_batch");
+            OE_HOST_CHECK(ecall_ret_status, "enclave_infer_batch (enclave)");
+        }
+        size_t output_elements = actual_output_byte_size / sizeof(float) / num_sequences;
+        if (g_embedding_cache && !all_cached) {
+            for (size_t s = 0; s < num_sequences; ++s) {
+                cache_key.assign(input_tensor_values.begin() + sequence_offsets[s],
+                                 input_tensor_values.begin() + sequence_offsets[s + 1]);
+                g_embedding_cache->insert(cache_key.data(), cache_key.size(),
+                                          output_tensor_values.data() + s * output_elements, output_elements);
+            }
+        }
+        for (size_t s = 0; s < num_sequences; ++s) {
+            const float* row = output_tensor_values.data() + s * output_elements;
+            for (size_t i = 0; i < output_elements; ++i) {
+                std::cout << row[i] << (i == output_elements - 1 ? "" : ", ");
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+// A batch in the layout the batched inference ECALLs take: every sequence's
+// tokens one after another as int64, and cumulative offsets into them, one
+// more than there are sequences.
+struct PackedSequences {
+    const int64_t* tokens;
+    size_t num_tokens;
+    const uint64_t* offsets;
+};
+
+// Packs sequences into arena, which is reset first, so the result lives
+// until the arena's next use.
+static PackedSequences pack_sequences(ScratchArena& arena, const std::vector<const std::vector<int32_t>*>& sequences) {
+    arena.reset();
+    size_t num_tokens = 0;
+    for (const std::vector<int32_t>* tokens : sequences) num_tokens += tokens->size();
+    int64_t* tokens = arena.allocate_array<int64_t>(num_tokens);
+    uint64_t* offsets = arena.allocate_array<uint64_t>(sequences.size() + 1);
+    offsets[0] = 0;
+    for (size_t s = 0; s < sequences.size(); ++s) {
+        std::copy(sequences[s]->begin(), sequences[s]->end(), tokens + offsets[s]);
+        offsets[s + 1] = offsets[s] + sequences[s]->size();
+    }
+    return PackedSequences{tokens, num_tokens, offsets};
+}
+
+// Binary protocol (see worker_protocol.h): length-prefixed frames of int32
+// token IDs in, raw float32/float16 embeddings out. Requests are pipelined:
+// each compute thread owns one enclave session, and responses are written in
+// completion order. Queued requests are micro-batched into
+// enclave_infer_batch calls. Per-request failures are answered with an error
+// frame instead of terminating the worker. Attestation frames are answered
+// from an AttestationCache, so they cost no ECALL or quote of their own.
+static void run_binary_worker(oe_enclave_t* enclave, const std::vector<uint64_t>& enclave_ml_session_handles,
+                              WireStream& in, WireStream& out, size_t queue_capacity, const BatchingOptions& batching,
+                              std::chrono::seconds attestation_lifetime, StartupProfile* profile) {
+    std::unique_ptr<AttestationCache> attestation;
+    if (attestation_lifetime.count() > 0) attestation = std::make_unique<AttestationCache>(enclave, attestation_lifetime);
+    if (profile) {
+        // Normally the first evidence is generated in the background; the
+        // profile waits for it so attester initialisation and the first
+        // quote show up as a phase of their own.
+        if (attestation) {
+            attestation->current(std::chrono::seconds(60));
+            profile->mark("attestation");
+        }
+        // A two-token sequence ([CLS] [SEP]) stands in for the first
+        // request, which pays for first-touch page faults on the compute
+        // buffers.
+        std::vector<int64_t> warmup = {101, 102};
+        std::vector<float> embedding(g_embedding_dim);
+        size_t embedding_size = 0;
+        oe_result_t ecall_ret_status = OE_FAILURE;
+        OE_HOST_CHECK(enclave_infer(enclave, &ecall_ret_status, enclave_ml_session_handles[0], warmup.data(),
+                                    warmup.size() * sizeof(int64_t), embedding.data(),
+                                    embedding.size() * sizeof(float), &embedding_size), "enclave_infer");
+        OE_HOST_CHECK(ecall_ret_status, "enclave_infer (enclave)");
+        profile->mark("first_inference");
+        profile->report(enclave);
+    }
+
+    // One arena per compute thread for the packed ECALL inputs, reset on
+    // every call, so packing allocates nothing once the largest batch has
+    // been seen.
+    std::vector<ScratchArena> arenas(enclave_ml_session_handles.size());
+    WorkerPipeline pipeline(
+        in, out, enclave_ml_session_handles.size(), queue_capacity, batching,
+        [&](size_t worker_index, const std::vector<const std::vector<int32_t>*>& sequences,
+            std::vector<float>& embeddings, size_t& n_embd) {
+            PackedSequences packed = pack_sequences(arenas[worker_index], sequences);
+            embeddings.resize(sequences.size() * g_embedding_dim);
+            oe_result_t ecall_ret_status = OE_FAILURE;
+            size_t actual_output_byte_size = 0;
+            oe_result_t result;
+            StageTimer ecall_timer(worker_metrics().ecall);
+            if (sequences.size() == 1) {
+                result = enclave_infer(
+                    enclave, &ecall_ret_status, enclave_ml_session_handles[worker_index],
+                    packed.tokens, packed.num_tokens * sizeof(int64_t),
+                    embeddings.data(), embeddings.size() * sizeof(float),
+                    &actual_output_byte_size);
+            } else {
+                result = enclave_infer_batch(
+                    enclave, &ecall_ret_status, enclave_ml_session_handles[worker_index],
+                    packed.tokens, packed.num_tokens * sizeof(int64_t),
+                    packed.offsets, sequences.size() + 1,
+                    embeddings.data(), embeddings.size() * sizeof(float),
+                    &actual_output_byte_size);
+            }
+            if (result != OE_OK) return result;
+            if (ecall_ret_status != OE_OK) return ecall_ret_status;
+            n_embd = actual_output_byte_size / sizeof(float) / sequences.size();
+            return OE_OK;
+        },
+        g_embedding_cache.get(), g_tokenizer.get(),
+        [&](size_t /*worker_index*/, std::string& out) {
+            render_worker_metrics(out);
+            if (g_embedding_cache) {
+                EmbeddingCache::Stats stats = g_embedding_cache->stats();
+                render_counter(out, "ml_worker_cache_hits_total", "Embedding cache hits.", stats.hits);
+                render_counter(out, "ml_worker_cache_misses_total", "Embedding cache misses.", stats.misses);
+                render_counter(out, "ml_worker_cache_evictions_total", "Embedding cache evictions.", stats.evictions);
+                render_gauge(out, "ml_worker_cache_entries", "Embeddings held by the cache.", stats.entries);
+                render_gauge(out, "ml_worker_cache_bytes", "Bytes held by the cache.", stats.bytes);
+            }
+            // Only scrapes pay for this ECALL, on a thread that already
+            // owns a TCS slot.
+            enclave_stats_t enclave_stats;
+            oe_result_t ecall_ret_status = OE_FAILURE;
+            if (get_enclave_stats(enclave, &ecall_ret_status, &enclave_stats) == OE_OK && ecall_ret_status == OE_OK) {
+                render_counter(out, "ml_enclave_infer_calls_total", "Inference ECALLs handled by the enclave.",
+                               enclave_stats.infer_calls);
+                render_counter(out, "ml_enclave_sequences_total", "Sequences embedded by the enclave.",
+                               enclave_stats.sequences);
+                render_counter(out, "ml_enclave_tokens_total", "Tokens embedded by the enclave.", enclave_stats.tokens);
+                render_counter(out, "ml_enclave_failures_total", "Inference ECALLs that failed.",
+                               enclave_stats.failures);
+                render_gauge(out, "ml_enclave_heap_limit_bytes", "Enclave heap size.", enclave_stats.heap_limit_bytes);
+                render_gauge(out, "ml_enclave_heap_used_bytes", "Enclave heap in use.", enclave_stats.heap_used_bytes);
+                render_gauge(out, "ml_enclave_heap_peak_bytes", "Enclave heap high-water mark.",
+                             enclave_stats.heap_peak_bytes);
+            }
+            if (attestation) {
+                render_counter(out, "ml_worker_attestation_generations_total", "Attestation evidence generated.",
+                               attestation->generations());
+                render_counter(out, "ml_worker_attestation_failures_total", "Failed attestation evidence generations.",
+                               attestation->failures());
+            }
+        },
+        [&](std::string& out) {
+            if (!attestation) return OE_UNSUPPORTED;
+            // Only the first request after startup can wait, for the
+            // first quote.
+            std::shared_ptr<const AttestationEvidence> evidence = attestation->current(std::chrono::seconds(5));
+            if (!evidence) return OE_UNEXPECTED;
+            encode_attestation_payload(*evidence, out);
+            return OE_OK;
+        },
+        SecureChannelHandlers{
+            [&](const std::string& client_public_key, std::string& out) {
+                // An uncompressed P-256 point, as enclave/secure_channel.h
+                // defines it.
+                uint8_t enclave_public_key[65];
+                unsigned char* evidence_buffer = nullptr;
+                size_t evidence_size = 0;
+                uint64_t channel_id = 0;
+                oe_result_t ecall_ret_status = OE_FAILURE;
+                oe_result_t result = open_secure_channel(
+                    enclave, &ecall_ret_status, reinterpret_cast<const uint8_t*>(client_public_key.data()),
+                    client_public_key.size(), enclave_public_key, sizeof(enclave_public_key), &evidence_buffer,
+                    &evidence_size, &channel_id);
+                if (result == OE_OK) result = ecall_ret_status;
+                if (result != OE_OK) {
+                    free(evidence_buffer);
+                    return result;
+                }
+                WireChannelHeader header = {channel_id, sizeof(enclave_public_key),
+                                            static_cast<uint32_t>(evidence_size)};
+                out.resize(sizeof(header) + sizeof(enclave_public_key) + evidence_size);
+                std::memcpy(&out[0], &header, sizeof(header));
+                std::memcpy(&out[sizeof(header)], enclave_public_key, sizeof(enclave_public_key));
+                std::memcpy(&out[sizeof(header) + sizeof(enclave_public_key)], evidence_buffer, evidence_size);
+                free(evidence_buffer);
+                return OE_OK;
+            },
+            [&](uint64_t channel_id) {
+                oe_result_t ecall_ret_status = OE_FAILURE;
+                oe_result_t result = close_secure_channel(enclave, &ecall_ret_status, channel_id);
+                return result != OE_OK ? result : ecall_ret_status;
+            },
+            [&](size_t worker_index, const std::vector<const std::string*>& messages,
+                std::vector<std::string>& responses, std::vector<uint32_t>& statuses) {
+                // Each sealed response is an embedding plus the 32-byte
+                // message header and tag.
+                size_t sealed_size = g_embedding_dim * sizeof(float) + 32;
+                ScratchArena& arena = arenas[worker_index];
+                arena.reset();
+                size_t messages_size = 0;
+                for (const std::string* message : messages) messages_size += message->size();
+                uint8_t* packed = arena.allocate_array<uint8_t>(messages_size);
+                uint64_t* message_offsets = arena.allocate_array<uint64_t>(messages.size() + 1);
+                message_offsets[0] = 0;
+                for (size_t m = 0; m < messages.size(); ++m) {
+                    std::memcpy(packed + message_offsets[m], messages[m]->data(), messages[m]->size());
+                    message_offsets[m + 1] = message_offsets[m] + messages[m]->size();
+                }
+                uint8_t* output = arena.allocate_array<uint8_t>(messages.size() * sealed_size);
+                statuses.assign(messages.size(), OE_FAILURE);
+                oe_result_t ecall_ret_status = OE_FAILURE;
+                size_t actual_output_byte_size = 0;
+                oe_result_t result;
+                StageTimer ecall_timer(worker_metrics().ecall);
+                if (messages.size() == 1) {
+                    result = enclave_infer_secure(
+                        enclave, &ecall_ret_status, enclave_ml_session_handles[worker_index], packed,
+                        messages_size, output, sealed_size, &actual_output_byte_size);
+                    // For a single message the call's status is the
+                    // message's own.
+                    statuses[0] = ecall_ret_status;
+                    ecall_ret_status = OE_OK;
+                } else {
+                    result = enclave_infer_secure_batch(
+                        enclave, &ecall_ret_status, enclave_ml_session_handles[worker_index], packed,
+                        messages_size, message_offsets, messages.size() + 1, output,
+                        messages.size() * sealed_size, &actual_output_byte_size, statuses.data(),
+                        statuses.size());
+                }
+                if (result != OE_OK) return result;
+                if (ecall_ret_status != OE_OK) return ecall_ret_status;
+                responses.resize(messages.size());
+                for (size_t m = 0; m < messages.size(); ++m) {
+                    if (statuses[m] != OE_OK) continue;
+                    responses[m].assign(reinterpret_cast<const char*>(output + m * sealed_size), sealed_size);
+                }
+                return OE_OK;
+            }},
+        [&](size_t worker_index, const std::vector<const std::vector<int32_t>*>& sequences,
+            std::vector<uint32_t>& labels, std::vector<float>& scores, size_t& n_labels) {
+            // Without --head there is nothing to classify with, and no
+            // header to size the outputs from.
+            if (g_head.empty()) return OE_UNSUPPORTED;
+            PackedSequences packed = pack_sequences(arenas[worker_index], sequences);
+            // The head is fixed at startup, so its label count is known
+            // from the file and the outputs can be sized before the call.
+            ClassifierHeadHeader head_header;
+            std::memcpy(&head_header, g_head.data(), sizeof(head_header));
+            labels.resize(sequences.size());
+            scores.resize(sequences.size() * head_header.labels);
+            uint32_t labels_out = 0;
+            oe_result_t ecall_ret_status = OE_FAILURE;
+            StageTimer ecall_timer(worker_metrics().ecall);
+            oe_result_t result = enclave_classify(
+                enclave, &ecall_ret_status, enclave_ml_session_handles[worker_index], packed.tokens,
+                packed.num_tokens * sizeof(int64_t), packed.offsets, sequences.size() + 1, labels.data(), labels.size(),
+                scores.data(), scores.size(), &labels_out);
+            if (result != OE_OK) return result;
+            if (ecall_ret_status != OE_OK) return ecall_ret_status;
+            n_labels = labels_out;
+            return OE_OK;
+        },
+        ReferenceIndexHandlers{
+            [&](size_t worker_index, const std::vector<const std::vector<int32_t>*>& sequences, uint32_t k,
+                std::vector<uint64_t>& ids, std::vector<float>& scores, size_t& n_results) {
+                PackedSequences packed = pack_sequences(arenas[worker_index], sequences);
+                ids.resize(sequences.size() * k);
+                scores.resize(sequences.size() * k);
+                uint32_t results_out = 0;
+                oe_result_t ecall_ret_status = OE_FAILURE;
+                StageTimer ecall_timer(worker_metrics().ecall);
+                oe_result_t result = enclave_infer_topk(
+                    enclave, &ecall_ret_status, enclave_ml_session_handles[worker_index], packed.tokens,
+                    packed.num_tokens * sizeof(int64_t), packed.offsets, sequences.size() + 1, k, ids.data(),
+                    scores.data(), ids.size(), &results_out);
+                if (result != OE_OK) return result;
+                if (ecall_ret_status != OE_OK) return ecall_ret_status;
+                n_results = results_out;
+                return OE_OK;
+            },
+            [&](const std::string& update, uint64_t& rows) {
+                oe_result_t ecall_ret_status = OE_FAILURE;
+                oe_result_t result = update_reference_index(
+                    enclave, &ecall_ret_status, reinterpret_cast<const uint8_t*>(update.data()), update.size(), &rows);
+                return result != OE_OK ? result : ecall_ret_status;
+            }});
+    pipeline.run();
+}
+
+// Creates one enclave ML session, handing the model over either by
+// reference (path plus digest) or as an in-band copy.
+static uint64_t open_enclave_session(oe_enclave_t* enclave, bool model_by_ref) {
+    oe_result_t ecall_ret_status;
+    uint64_t enclave_ml_session_handle = 0;
+    if (model_by_ref) {
+        // Only the path and digest enter the enclave; the host maps
+        // the file itself when the enclave asks for it to be loaded.
+        const Sha256::Digest& digest = model_file_digest(g_model_path);
+        std::cerr << "[Host] Model " << g_model_path << " sha256="
+                  << digest_to_hex(digest.data(), digest.size()) << std::endl;
+        OE_HOST_CHECK(initialize_enclave_ml_context_by_ref(
+            enclave, &ecall_ret_status, g_model_path.c_str(), digest.data(),
+            digest.size(), &enclave_ml_session_handle), "initialize_enclave_ml_context_by_ref");
+        OE_HOST_CHECK(ecall_ret_status, "initialize_enclave_ml_context_by_ref (enclave)");
+    } else {
+        const MappedModelFile& model_file = map_model_file(g_model_path);
+        OE_HOST_CHECK(initialize_enclave_ml_context(
+            enclave, &ecall_ret_status, model_file.data(),
+            model_file.size(), &enclave_ml_session_handle), "initialize_enclave_ml_context");
+        OE_HOST_CHECK(ecall_ret_status, "initialize_enclave_ml_context (enclave)");
+    }
+
+    // An enclave built with ENCLAVE_INPROC_BERT loads by-ref models itself,
+    // so no OCALL told the host the embedding size.
+    if (g_embedding_dim == 0) {
+        uint64_t n_embd = 0;
+        OE_HOST_CHECK(get_enclave_ml_embedding_dim(
+            enclave, &ecall_ret_status, enclave_ml_session_handle, &n_embd), "get_enclave_ml_embedding_dim");
+        OE_HOST_CHECK(ecall_ret_status, "get_enclave_ml_embedding_dim (enclave)");
+        g_embedding_dim = static_cast<int>(n_embd);
+    }
+    if (!g_head.empty()) {
+        OE_HOST_CHECK(set_enclave_ml_head(enclave, &ecall_ret_status, enclave_ml_session_handle, g_head.data(),
+                                          g_head.size()), "set_enclave_ml_head");
+        OE_HOST_CHECK(ecall_ret_status, "set_enclave_ml_head (enclave)");
+    }
+    return enclave_ml_session_handle;
+}
+
 int main(int argc, char* argv[]) {
     oe_enclave_t* enclave = nullptr;
     int host_app_ret_val = 1;
-    uint64_t enclave_ml_session_handle = 0;
+    std::vector<uint64_t> enclave_ml_session_handles;
 
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <model_path> <enclave_path> [--use-stdin | --attest | --simulate]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <model_path> <enclave_path> [--use-stdin | --attest | --simulate] [--max-batch N] [--model-by-ref]"
+                  << " [--mmap-hugepages] [--mmap-lock] [--no-mmap-prefetch]"
+                  << " [--threads N|auto] [--min-tokens-per-thread N] [--pin-physical-cores]"
+                  << " [--protocol=text|binary] [--compute-threads N] [--queue-depth N]"
+                  << " [--batch-delay-us N] [--max-batch-tokens N] [--model-contexts N]"
+                  << " [--length-buckets N,N,...]"
+                  << " [--switchless] [--bench N] [--bench-tokens N] [--cache-mb N]"
+                  << " [--bench-corpus FILE] [--bench-concurrency N] [--bench-batch N]"
+                  << " [--tokenizer-dir DIR] [--text-input] [--model-variant f16|q8_0|q4_k]"
+                  << " [--supervisor N] [--attest-lifetime-s N] [--numa] [--numa-node N]"
+                  << " [--supervisor-routing queue-depth|round-robin]"
+                  << " [--bulk INPUT OUTPUT] [--bulk-f16] [--bulk-batch N] [--bulk-checkpoint-rows N]"
+                  << " [--head FILE] [--index FILE] [--transport=pipe|shm --shm-fd N] [--startup-profile]" << std::endl;
         return 1;
     }
     g_model_path = argv[1];
@@ -174,19 +886,323 @@ int main(int argc, char* argv[]) {
     bool use_stdin = false;
     bool simulate = false;
     bool do_attest = false; // New flag for attestation
+    bool model_by_ref = false;
+    bool auto_threads = false;
+    bool pin_physical_cores = false;
+    bool binary_protocol = false;
+    size_t compute_threads = 1;
+    size_t queue_capacity = 256;
+    BatchingOptions batching;
+    bool switchless = false;
+    bool run_benchmark = false;
+    BenchOptions bench;
+    bool run_bulk_job = false;
+    BulkOptions bulk;
+    std::string tokenizer_dir;
+    std::string head_path;
+    std::string index_path;
+    bool text_input = false;
+    std::string model_variant;
+    size_t supervisor_instances = 0;
+    bool numa_supervisor = false;
+    bool round_robin = false;
+    int numa_node = -1;
+    int attestation_lifetime_s = 300;
+    bool shm_transport = false;
+    bool profile_startup = false;
+    int shm_fd = -1;
 
     for (int i = 3; i < argc; ++i) {
         if (std::string(argv[i]) == "--use-stdin") use_stdin = true;
         else if (std::string(argv[i]) == "--simulate") simulate = true;
         else if (std::string(argv[i]) == "--attest") do_attest = true;
+        else if (std::string(argv[i]) == "--model-by-ref") model_by_ref = true;
+        else if (std::string(argv[i]) == "--mmap-hugepages") g_model_map_options.hugepages = true;
+        else if (std::string(argv[i]) == "--mmap-lock") g_model_map_options.lock = true;
+        else if (std::string(argv[i]) == "--no-mmap-prefetch") g_model_map_options.prefetch = false;
+        else if (std::string(argv[i]) == "--threads" && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (value == "auto") auto_threads = true;
+            else g_n_threads = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (std::string(argv[i]) == "--min-tokens-per-thread" && i + 1 < argc) {
+            g_min_tokens_per_thread = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--pin-physical-cores") pin_physical_cores = true;
+        else if (std::string(argv[i]) == "--protocol=binary") binary_protocol = true;
+        else if (std::string(argv[i]) == "--protocol=text") binary_protocol = false;
+        else if (std::string(argv[i]) == "--compute-threads" && i + 1 < argc) {
+            compute_threads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--queue-depth" && i + 1 < argc) {
+            queue_capacity = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--batch-delay-us" && i + 1 < argc) {
+            batching.max_delay = std::chrono::microseconds(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (std::string(argv[i]) == "--max-batch-tokens" && i + 1 < argc) {
+            batching.max_batch_tokens = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--switchless") switchless = true;
+        else if (std::string(argv[i]) == "--cache-mb" && i + 1 < argc) {
+            size_t cache_mb = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+            if (cache_mb > 0) g_embedding_cache = std::make_unique<EmbeddingCache>(cache_mb << 20);
+        }
+        else if (std::string(argv[i]) == "--bench" && i + 1 < argc) {
+            run_benchmark = true;
+            bench.requests = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--bench-tokens" && i + 1 < argc) {
+            bench.seq_len = std::max(2, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--bench-corpus" && i + 1 < argc) bench.corpus_path = argv[++i];
+        else if (std::string(argv[i]) == "--bench-concurrency" && i + 1 < argc) {
+            bench.concurrency = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--bench-batch" && i + 1 < argc) {
+            bench.batch = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--tokenizer-dir" && i + 1 < argc) tokenizer_dir = argv[++i];
+        else if (std::string(argv[i]) == "--head" && i + 1 < argc) head_path = argv[++i];
+        else if (std::string(argv[i]) == "--index" && i + 1 < argc) index_path = argv[++i];
+        else if (std::string(argv[i]) == "--text-input") text_input = true;
+        else if (std::string(argv[i]) == "--model-variant" && i + 1 < argc) model_variant = argv[++i];
+        else if (std::string(argv[i]) == "--model-contexts" && i + 1 < argc) {
+            g_max_model_contexts = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--length-buckets" && i + 1 < argc) {
+            std::istringstream buckets(argv[++i]);
+            for (std::string bucket; std::getline(buckets, bucket, ',');) {
+                int length = std::atoi(bucket.c_str());
+                if (length > 0) g_length_buckets.push_back(length);
+            }
+        }
+        else if (std::string(argv[i]) == "--max-batch" && i + 1 < argc) {
+            g_max_batch_size = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--attest-lifetime-s" && i + 1 < argc) {
+            attestation_lifetime_s = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--supervisor" && i + 1 < argc) {
+            supervisor_instances = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--numa") numa_supervisor = true;
+        else if (std::string(argv[i]) == "--numa-node" && i + 1 < argc) numa_node = std::atoi(argv[++i]);
+        else if (std::string(argv[i]) == "--supervisor-routing" && i + 1 < argc) {
+            round_robin = std::string(argv[++i]) == "round-robin";
+        }
+        else if (std::string(argv[i]) == "--bulk" && i + 2 < argc) {
+            run_bulk_job = true;
+            bulk.input_path = argv[++i];
+            bulk.output_path = argv[++i];
+        }
+        else if (std::string(argv[i]) == "--startup-profile") profile_startup = true;
+        else if (std::string(argv[i]) == "--transport=shm") shm_transport = true;
+        else if (std::string(argv[i]) == "--transport=pipe") shm_transport = false;
+        else if (std::string(argv[i]) == "--shm-fd" && i + 1 < argc) shm_fd = std::atoi(argv[++i]);
+        else if (std::string(argv[i]) == "--bulk-f16") bulk.output_f16 = true;
+        else if (std::string(argv[i]) == "--bulk-batch" && i + 1 < argc) {
+            bulk.batch = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--bulk-checkpoint-rows" && i + 1 < argc) {
+            bulk.checkpoint_rows = std::max(1, std::atoi(argv[++i]));
+        }
+    }
+
+    std::unique_ptr<StartupProfile> profile;
+    if (profile_startup) profile = std::make_unique<StartupProfile>();
+
+    // With --transport=shm the binary frames travel through the segment the
+    // backend passed as --shm-fd instead of stdin and stdout; stdin stays
+    // open only so the worker notices when the backend goes away.
+    std::unique_ptr<ShmTransport> shm;
+    if (shm_transport) {
+        if (!binary_protocol || !use_stdin || shm_fd < 0) {
+            std::cerr << "[Host] --transport=shm needs --use-stdin --protocol=binary --shm-fd N" << std::endl;
+            return 1;
+        }
+        try {
+            shm = std::make_unique<ShmTransport>(shm_fd);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        shm->close_requests_at_eof(STDIN_FILENO);
+    }
+    FdStream stdin_stream(STDIN_FILENO);
+
+    // --numa spreads the supervisor's instances over the NUMA nodes, one
+    // per node unless --supervisor says how many.
+    std::vector<int> nodes;
+    if (numa_supervisor) {
+        nodes = numa_nodes();
+        if (supervisor_instances == 0) supervisor_instances = nodes.size();
+    }
+
+    // The supervisor creates no enclave itself: each instance is this
+    // binary re-run with the same flags minus the supervisor ones.
+    if (supervisor_instances > 0) {
+        if (!binary_protocol || !use_stdin) {
+            std::cerr << "[Host] --supervisor and --numa need --use-stdin --protocol=binary" << std::endl;
+            return 1;
+        }
+        SupervisorOptions supervisor;
+        supervisor.instances = supervisor_instances;
+        supervisor.queue_capacity = queue_capacity;
+        supervisor.numa_nodes = nodes;
+        supervisor.round_robin = round_robin;
+        for (int i = 0; i < argc; ++i) {
+            std::string arg = argv[i];
+            // Instances talk to the supervisor over pipes whatever the
+            // backend uses.
+            if (arg == "--supervisor" || arg == "--supervisor-routing" || arg == "--numa-node" || arg == "--shm-fd") ++i;
+            else if (arg != "--numa" && arg.rfind("--transport=", 0) != 0) supervisor.instance_args.push_back(argv[i]);
+        }
+        FdStream stdout_stream(STDOUT_FILENO);
+        try {
+            if (shm) {
+                run_supervisor(shm->requests(), shm->responses(), supervisor);
+                shm->responses().close();
+            } else {
+                run_supervisor(stdin_stream, stdout_stream, supervisor);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Benchmark clients stand in for the pipeline's compute threads: one
+    // enclave session, switchless worker and model context each.
+    if (run_benchmark) compute_threads = bench.concurrency;
+    if (g_max_model_contexts == 0) {
+        g_max_model_contexts = binary_protocol || run_benchmark || run_bulk_job ? compute_threads : 1;
+    }
+
+    // An instance placed on a NUMA node keeps its threads there before it
+    // creates anything: every thread inherits the mask, GGML's included, the
+    // weights and buffers they allocate come from the node's memory, and the
+    // SGX driver backs enclave pages with EPC from the node that faults them
+    // in. Everything below, --threads auto and --pin-physical-cores
+    // included, then only sees the node's CPUs.
+    if (numa_node >= 0) {
+        if (!pin_current_thread(numa_node_cpus(numa_node))) {
+            std::cerr << "[Host] Failed to pin to NUMA node " << numa_node << "; continuing unpinned" << std::endl;
+        } else if (!prefer_numa_node(numa_node)) {
+            std::cerr << "[Host] Failed to prefer memory on NUMA node " << numa_node << std::endl;
+        } else {
+            std::cerr << "[Host] Running on NUMA node " << numa_node << std::endl;
+        }
+    }
+
+    // GGML creates its worker threads from the thread that runs the OCALL,
+    // so pinning the main thread before any compute confines all of them to
+    // one logical CPU per physical core.
+    std::vector<int> core_cpus = physical_core_cpus();
+    if (auto_threads) g_n_threads = std::max<int>(1, core_cpus.size());
+    if (pin_physical_cores && !pin_current_thread(core_cpus)) {
+        std::cerr << "[Host] Failed to pin to physical cores; continuing unpinned" << std::endl;
+    }
+
+    // Binary frames go to the original stdout. Everything else that prints
+    // to stdout (bert.cpp logs there while loading) is sent to stderr from
+    // here on, so it cannot corrupt the frame stream.
+    int protocol_out_fd = STDOUT_FILENO;
+    if (binary_protocol) {
+        protocol_out_fd = dup(STDOUT_FILENO);
+        if (protocol_out_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            std::cerr << "[Host] Failed to set up binary protocol output" << std::endl;
+            return 1;
+        }
     }
 
     try {
+        // Every later load (host sessions, by-reference digests, the
+        // in-enclave loader) goes through g_model_path.
+        if (!model_variant.empty()) {
+            g_model_path = model_variant_path(g_model_path, model_variant);
+            if (access(g_model_path.c_str(), R_OK) != 0) {
+                throw std::runtime_error("[Host] Model variant " + model_variant + " not found at " + g_model_path +
+                                         "; build the quantize_models target first");
+            }
+            std::cerr << "[Host] Using model variant " << model_variant << ": " << g_model_path << std::endl;
+        }
+        if (text_input && tokenizer_dir.empty()) tokenizer_dir = "tokenizer";
+        if (!tokenizer_dir.empty()) {
+            g_tokenizer = std::make_unique<WordPieceTokenizer>(tokenizer_dir);
+            std::cerr << "[Host] Loaded tokenizer from " << tokenizer_dir << " (" << g_tokenizer->vocab_size()
+                      << " tokens)" << std::endl;
+        }
+        if (!head_path.empty()) {
+            // The enclave validates the head; the host only needs its label
+            // count, to size classification outputs.
+            std::ifstream head_file(head_path, std::ios::binary);
+            g_head.assign(std::istreambuf_iterator<char>(head_file), std::istreambuf_iterator<char>());
+            ClassifierHeadHeader head_header;
+            if (!head_file.eof() || g_head.size() < sizeof(head_header)) {
+                throw std::runtime_error("[Host] Failed to read classifier head " + head_path);
+            }
+            std::memcpy(&head_header, g_head.data(), sizeof(head_header));
+            std::cerr << "[Host] Loaded classifier head from " << head_path << " (" << head_header.labels
+                      << " labels, dim " << head_header.dim << ")" << std::endl;
+        }
+
         uint32_t enclave_flags = OE_ENCLAVE_FLAG_DEBUG;
         if (simulate) enclave_flags |= OE_ENCLAVE_FLAG_SIMULATE;
+
+        // Switchless calls hand the inference ECALLs and OCALLs to worker
+        // threads polling shared memory instead of leaving or entering the
+        // enclave. One worker per compute thread on each side keeps every
+        // in-flight call switchless; each enclave worker occupies a TCS
+        // for the lifetime of the enclave, so ENCLAVE_NUM_TCS must cover
+        // them plus the threads making ordinary ECALLs.
+        oe_enclave_setting_context_switchless_t switchless_setting = {
+            static_cast<uint32_t>(compute_threads), static_cast<uint32_t>(compute_threads)};
+        oe_enclave_setting_t settings[1];
+        settings[0].setting_type = OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS;
+        settings[0].u.context_switchless_setting = &switchless_setting;
+
+        // One TCS per session thread, per switchless enclave worker and for
+        // the attestation refresh. Past NumTCS the enclave would start, then
+        // fail ECALLs with OE_OUT_OF_THREADS once they all ran at once.
+        bool refreshes_attestation = use_stdin && binary_protocol && attestation_lifetime_s > 0;
+        size_t tcs_needed = compute_threads + (switchless ? compute_threads : 0) + (refreshes_attestation ? 1 : 0);
+        if (tcs_needed > ENCLAVE_NUM_TCS) {
+            throw std::runtime_error("[Host] " + std::to_string(compute_threads) + " compute threads" +
+                                     (switchless ? " with --switchless" : "") +
+                                     (refreshes_attestation ? " and the attestation refresh" : "") + " need " +
+                                     std::to_string(tcs_needed) + " TCS, but the enclave is built with " +
+                                     std::to_string(ENCLAVE_NUM_TCS) +
+                                     "; lower --compute-threads or rebuild with a larger -DENCLAVE_NUM_TCS");
+        }
+        if (profile) {
+            profile->tcs_needed = tcs_needed;
+            profile->contexts_needed = compute_threads;
+            profile->mark("host_setup");
+        }
         OE_HOST_CHECK(oe_create_enclave_enclave(
             enclave_filepath.c_str(), OE_ENCLAVE_TYPE_AUTO,
-            enclave_flags, nullptr, 0, &enclave), "oe_create_enclave_enclave");
+            enclave_flags, switchless ? settings : nullptr, switchless ? 1 : 0,
+            &enclave), "oe_create_enclave_enclave");
+        if (profile) profile->mark("enclave_create");
+
+        if (!index_path.empty()) {
+            // An index file is one serialized update, normally a replace;
+            // the enclave validates it and keeps its own copy.
+            std::ifstream index_file(index_path, std::ios::binary);
+            std::vector<uint8_t> index_update((std::istreambuf_iterator<char>(index_file)),
+                                              std::istreambuf_iterator<char>());
+            if (!index_file.eof()) throw std::runtime_error("[Host] Failed to read reference index " + index_path);
+            oe_result_t ecall_ret_status = OE_FAILURE;
+            uint64_t index_rows = 0;
+            OE_HOST_CHECK(update_reference_index(enclave, &ecall_ret_status, index_update.data(),
+                                                 index_update.size(), &index_rows), "update_reference_index");
+            OE_HOST_CHECK(ecall_ret_status, "update_reference_index (enclave)");
+            std::cerr << "[Host] Loaded reference index from " << index_path << " (" << index_rows << " rows)"
+                      << std::endl;
+            if (profile) profile->mark("reference_index");
+        }
 
         // --- ATTESTATION LOGIC ---
         if (do_attest) {
@@ -207,47 +1223,64 @@ int main(int argc, char* argv[]) {
             free(evidence_buffer);
             host_app_ret_val = 0; // Success
 
-        // --- INFERENCE LOGIC (Unchanged) ---
+        } else if (run_benchmark) {
+            if (profile) profile->sessions_opening(enclave);
+            for (size_t i = 0; i < bench.concurrency; ++i) {
+                enclave_ml_session_handles.push_back(open_enclave_session(enclave, model_by_ref));
+            }
+            if (profile) {
+                profile->sessions_opened(enclave);
+                profile->report(enclave);
+            }
+            run_bench(enclave, enclave_ml_session_handles, g_embedding_dim, bench);
+            host_app_ret_val = 0;
+
+        } else if (run_bulk_job) {
+            // Bulk workers stand in for the pipeline's compute threads, like
+            // the benchmark clients: --compute-threads sets how many.
+            if (profile) profile->sessions_opening(enclave);
+            for (size_t i = 0; i < compute_threads; ++i) {
+                enclave_ml_session_handles.push_back(open_enclave_session(enclave, model_by_ref));
+            }
+            if (profile) {
+                profile->sessions_opened(enclave);
+                profile->report(enclave);
+            }
+            bulk.text_input = text_input;
+            run_bulk(enclave, enclave_ml_session_handles, g_embedding_dim, model_file_digest(g_model_path),
+                     g_tokenizer.get(), bulk);
+            host_app_ret_val = 0;
+
+        // --- INFERENCE LOGIC ---
         } else if (use_stdin) {
-            std::vector<unsigned char> model_buffer = load_file_to_buffer(g_model_path);
-            oe_result_t ecall_ret_status;
-            OE_HOST_CHECK(initialize_enclave_ml_context(
-                enclave, &ecall_ret_status, model_buffer.data(),
-                model_buffer.size(), &enclave_ml_session_handle), "initialize_enclave_ml_context");
-            OE_HOST_CHECK(ecall_ret_status, "initialize_enclave_ml_context (enclave)");
-
-            std::string line;
-            while (std::getline(std::cin, line)) {
-                if (line == "quit" || line == "exit")
-                    break;
-                if (line.empty())
-                    continue;
-
-                std::vector<int64_t> input_tensor_values;
-                std::stringstream ss(line);
-                std::string value_str;
-                while (std::getline(ss, value_str, ',')) {
-                    if (!value_str.empty()) {
-                        input_tensor_values.push_back(std::stoll(value_str));
-                    }
-                }
+            size_t session_count = binary_protocol ? compute_threads : 1;
+            if (profile) profile->sessions_opening(enclave);
+            for (size_t i = 0; i < session_count; ++i) {
+                enclave_ml_session_handles.push_back(open_enclave_session(enclave, model_by_ref));
+            }
+            if (profile) profile->sessions_opened(enclave);
 
-                size_t input_data_byte_size = input_tensor_values.size() * sizeof(int64_t);
-                // Allocate buffer based on the model's embedding dimension
-                std::vector<float> output_tensor_values(g_embedding_dim);
-                size_t output_buffer_byte_size = output_tensor_values.size() * sizeof(float);
-                size_t actual_output_byte_size = 0;
-                OE_HOST_CHECK(enclave_infer(
-                    enclave, &ecall_ret_status, enclave_ml_session_handle,
-                    input_tensor_values.data(), input_data_byte_size,
-                    output_tensor_values.data(), output_buffer_byte_size,
-                    &actual_output_byte_size), "enclave_infer");
-                OE_HOST_CHECK(ecall_ret_status, "enclave_infer (enclave)");
-                size_t output_elements = actual_output_byte_size / sizeof(float);
-                for (size_t i = 0; i < output_elements; ++i) {
-                    std::cout << output_tensor_values[i] << (i == output_elements - 1 ? "" : ", ");
-                }
-                std::cout << std::endl;
+            if (binary_protocol) {
+                batching.max_batch = g_max_batch_size;
+                FdStream out_stream(protocol_out_fd);
+                WireStream& in = shm ? static_cast<WireStream&>(shm->requests()) : stdin_stream;
+                WireStream& out = shm ? static_cast<WireStream&>(shm->responses()) : out_stream;
+                run_binary_worker(enclave, enclave_ml_session_handles, in, out, queue_capacity, batching,
+                                  std::chrono::seconds(attestation_lifetime_s), profile.get());
+                // The backend reads until the response ring is closed, as it
+                // would read a pipe until end of file.
+                if (shm) shm->responses().close();
+            } else {
+                if (profile) profile->report(enclave);
+                run_text_worker(enclave, enclave_ml_session_handles[0], text_input);
+            }
+            if (g_embedding_cache) {
+                EmbeddingCache::Stats stats = g_embedding_cache->stats();
+                uint64_t lookups = stats.hits + stats.misses;
+                std::cerr << "[Host] Embedding cache: hits=" << stats.hits << " misses=" << stats.misses
+                          << " hit_rate=" << (lookups ? 100.0 * stats.hits / lookups : 0.0) << "%"
+                          << " evictions=" << stats.evictions << " entries=" << stats.entries
+                          << " bytes=" << stats.bytes << std::endl;
             }
             host_app_ret_val = 0;
         }
@@ -258,8 +1291,8 @@ int main(int argc, char* argv[]) {
         host_app_ret_val = 1;
     }
 
-        // Tear down the enclave ML context if it was initialized.
-    if (enclave_ml_session_handle != 0) {
+    // Tear down the enclave ML contexts that were initialized.
+    for (uint64_t enclave_ml_session_handle : enclave_ml_session_handles) {
         oe_result_t ecall_ret_status = OE_FAILURE;
         oe_result_t result = terminate_enclave_ml_context(
             enclave, &ecall_ret_status, enclave_ml_session_handle);
@@ -0,0 +1,68 @@
+// openenclave_ml_poc/host/model_file.cpp
+#include "model_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+MappedModelFile::MappedModelFile(const std::string& path, const ModelMapOptions& options)
+    : path_(path), data_(nullptr), size_(0), mtime_ns_(0), locked_(false) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("[Host] Failed to open file: " + path + ": " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        throw std::runtime_error("[Host] Failed to stat file or file is empty: " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    mtime_ns_ = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::runtime_error("[Host] Failed to mmap file: " + path + ": " + strerror(errno));
+    }
+    data_ = static_cast<const unsigned char*>(addr);
+
+    // The hints are best effort: a kernel or filesystem that does not
+    // support one still leaves a perfectly usable mapping.
+    if (options.prefetch && madvise(addr, size_, MADV_WILLNEED) != 0) {
+        std::cerr << "[Host] madvise(MADV_WILLNEED) failed for " << path << ": " << strerror(errno) << std::endl;
+    }
+#ifdef MADV_HUGEPAGE
+    if (options.hugepages && madvise(addr, size_, MADV_HUGEPAGE) != 0) {
+        std::cerr << "[Host] madvise(MADV_HUGEPAGE) failed for " << path << ": " << strerror(errno) << std::endl;
+    }
+#endif
+    if (options.lock) {
+        if (mlock(addr, size_) == 0) {
+            locked_ = true;
+        } else {
+            std::cerr << "[Host] mlock failed for " << path << ": " << strerror(errno) << std::endl;
+        }
+    }
+}
+
+MappedModelFile::~MappedModelFile() {
+    if (!data_) return;
+    if (locked_) munlock(data_, size_);
+    munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+std::string model_variant_path(const std::string& base, const std::string& variant) {
+    if (variant == "f16") return base;
+    if (variant != "q8_0" && variant != "q4_k") {
+        throw std::runtime_error("[Host] Unknown model variant " + variant + " (expected f16, q8_0 or q4_k)");
+    }
+    size_t slash = base.find_last_of('/');
+    size_t dot = base.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return base + "-" + variant;
+    return base.substr(0, dot) + "-" + variant + base.substr(dot);
+}
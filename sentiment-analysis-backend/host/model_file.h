@@ -0,0 +1,49 @@
+// openenclave_ml_poc/host/model_file.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Page-cache hints applied to a model mapping.
+struct ModelMapOptions {
+    // MADV_WILLNEED: start reading the whole file into the page cache now.
+    bool prefetch = true;
+    // MADV_HUGEPAGE: ask for transparent huge pages where the filesystem
+    // supports them for file-backed mappings.
+    bool hugepages = false;
+    // mlock the mapping so the weights can never be evicted between worker
+    // restarts. Needs RLIMIT_MEMLOCK headroom; failure is only a warning.
+    bool lock = false;
+};
+
+// Read-only, shared mapping of a model file. Mapping instead of reading
+// keeps the weights in the page cache rather than in a private heap copy, so
+// every worker on the node maps the same physical pages.
+class MappedModelFile {
+public:
+    explicit MappedModelFile(const std::string& path, const ModelMapOptions& options = ModelMapOptions());
+    ~MappedModelFile();
+
+    MappedModelFile(const MappedModelFile&) = delete;
+    MappedModelFile& operator=(const MappedModelFile&) = delete;
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+    // Modification time in nanoseconds, used to validate cached digests.
+    int64_t mtime_ns() const { return mtime_ns_; }
+
+private:
+    std::string path_;
+    const unsigned char* data_;
+    size_t size_;
+    int64_t mtime_ns_;
+    bool locked_;
+};
+
+// Path of a quantised variant stored next to the shipped model, as written
+// by ml_quantize: model/bert.bin with "q8_0" is model/bert-q8_0.bin. "f16",
+// the shipped weights, is base itself. Throws std::runtime_error for any
+// other variant name.
+std::string model_variant_path(const std::string& base, const std::string& variant);
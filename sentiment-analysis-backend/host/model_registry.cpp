@@ -0,0 +1,144 @@
+// openenclave_ml_poc/host/model_registry.cpp
+#include "model_registry.h"
+
+#include <algorithm>
+#include <chrono>
+
+HostModel::HostModel(const std::string& path, size_t max_contexts, int max_batch)
+    : path_(path), max_contexts_(std::max<size_t>(1, max_contexts)), max_batch_(std::max(1, max_batch)) {}
+
+HostModel::~HostModel() {
+    // Leases hold a raw pointer to the model, and sessions keep the model
+    // alive while they can issue forward passes, so every context is idle
+    // by now.
+    for (const std::unique_ptr<ComputeContext>& ctx : all_) bert_free(ctx->ctx);
+}
+
+std::shared_ptr<HostModel> HostModel::load(const std::string& path, size_t max_contexts, int max_batch,
+                                           const std::vector<int>& length_buckets) {
+    std::shared_ptr<HostModel> model(new HostModel(path, max_contexts, max_batch));
+    std::unique_ptr<ComputeContext> ctx = model->create_context(0);
+    if (!ctx) return nullptr;
+    model->n_embd_ = bert_n_embd(ctx->ctx);
+    model->n_max_tokens_ = bert_n_max_tokens(ctx->ctx);
+    for (int bucket : length_buckets) {
+        if (bucket > 0 && bucket < model->n_max_tokens_) model->buckets_.push_back(bucket);
+    }
+    model->buckets_.push_back(model->n_max_tokens_);
+    std::sort(model->buckets_.begin(), model->buckets_.end());
+    model->buckets_.erase(std::unique(model->buckets_.begin(), model->buckets_.end()), model->buckets_.end());
+    model->reserved_ = 1;
+    model->idle_.push_back(ctx.get());
+    model->all_.push_back(std::move(ctx));
+
+    // With buckets the whole pool is created here, shortest buckets first
+    // and round-robin after that, beside the full-length first context.
+    // Creating a context means reading the weights again and allocating
+    // its buffers, which takes seconds; doing it on the request path to
+    // swap one bucket for another would make mixed traffic thrash.
+    for (size_t i = 0; model->buckets_.size() > 1 && model->reserved_ < model->max_contexts_; ++i) {
+        std::unique_ptr<ComputeContext> bucket = model->create_context(model->buckets_[i % model->buckets_.size()]);
+        if (!bucket) return nullptr;
+        ++model->reserved_;
+        model->idle_.push_back(bucket.get());
+        model->all_.push_back(std::move(bucket));
+    }
+    return model;
+}
+
+ModelLoadTimes& model_load_times() {
+    static ModelLoadTimes times;
+    return times;
+}
+
+namespace {
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+}  // namespace
+
+// max_tokens <= 0 sizes the context for the model's maximum length.
+std::unique_ptr<HostModel::ComputeContext> HostModel::create_context(int max_tokens) {
+    auto start = std::chrono::steady_clock::now();
+    bert_ctx* ctx = bert_load_from_file(path_.c_str(), true);
+    model_load_times().weights_ns.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+    if (!ctx) return nullptr;
+    if (max_tokens <= 0 || max_tokens > bert_n_max_tokens(ctx)) max_tokens = bert_n_max_tokens(ctx);
+    // GGML compute buffers are allocated once here for the largest batch of
+    // the bucket's length and reused by every forward pass on this context.
+    start = std::chrono::steady_clock::now();
+    bert_allocate_buffers(ctx, max_tokens, max_batch_);
+    model_load_times().buffers_ns.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+    std::unique_ptr<ComputeContext> context(new ComputeContext());
+    context->ctx = ctx;
+    context->max_tokens = max_tokens;
+    context->tokens.reserve(max_tokens);
+    return context;
+}
+
+int HostModel::bucket_for(size_t num_tokens) const {
+    for (int bucket : buckets_) {
+        if (num_tokens <= static_cast<size_t>(bucket)) return bucket;
+    }
+    return n_max_tokens_;
+}
+
+HostModel::Lease HostModel::acquire(size_t num_tokens) {
+    // Longer inputs fail in bert.cpp whichever context runs them; clamp so
+    // they don't wait for a context longer than any there is.
+    num_tokens = std::min(num_tokens, static_cast<size_t>(n_max_tokens_));
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        auto best = idle_.end();
+        for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+            if (static_cast<size_t>((*it)->max_tokens) >= num_tokens &&
+                (best == idle_.end() || (*it)->max_tokens < (*best)->max_tokens))
+                best = it;
+        }
+        if (best != idle_.end()) {
+            ComputeContext* ctx = *best;
+            idle_.erase(best);
+            return Lease(this, ctx);
+        }
+        if (reserved_ < max_contexts_) break;
+        // The pool is full and every idle context is too short. One that
+        // fits comes back when its pass ends; the first context covers the
+        // model maximum, so there always is one.
+        context_released_.wait(lock);
+    }
+
+    // Load outside the lock; other threads keep using the existing contexts.
+    ++reserved_;
+    lock.unlock();
+    std::unique_ptr<ComputeContext> ctx = create_context(bucket_for(num_tokens));
+    lock.lock();
+    if (!ctx) {
+        --reserved_;
+        return Lease(this, nullptr);
+    }
+    all_.push_back(std::move(ctx));
+    return Lease(this, all_.back().get());
+}
+
+void HostModel::release(ComputeContext* ctx) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(ctx);
+    // Waiters need different lengths, so the one woken might not fit this
+    // context while another would.
+    context_released_.notify_all();
+}
+
+std::shared_ptr<HostModel> ModelRegistry::get_or_load(const std::string& path, size_t max_contexts, int max_batch,
+                                                      const std::vector<int>& length_buckets) {
+    // Held across the load so concurrent first sessions load the model once.
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<HostModel> model = models_[path].lock();
+    if (!model) {
+        model = HostModel::load(path, max_contexts, max_batch, length_buckets);
+        if (model) models_[path] = model;
+        else models_.erase(path);
+    }
+    return model;
+}
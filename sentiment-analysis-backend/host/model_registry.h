@@ -0,0 +1,130 @@
+// openenclave_ml_poc/host/model_registry.h
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bert.h"
+
+// One loaded model shared by every session that uses it.
+//
+// bert.cpp keeps weights and compute buffers in the same bert_ctx and has no
+// way to share tensors between contexts, so a HostModel owns a small pool of
+// bert_ctx compute contexts instead of one per session. Sessions borrow a
+// context for the duration of a forward pass; the pool grows lazily up to
+// max_contexts, so its size follows actual concurrency rather than the number
+// of open sessions.
+//
+// With length buckets, each context's compute buffers are allocated for one
+// bucket's sequence length instead of the model maximum, and a forward pass
+// borrows the smallest idle context that fits its input. Short requests then
+// stop tying up a context sized for 512 tokens. The pool is then created in
+// full when the model loads, so the request path never loads a context.
+class HostModel {
+public:
+    // A bert_ctx plus conversion buffers reused by every forward pass on
+    // it, so steady-state requests do not allocate them again.
+    struct ComputeContext {
+        bert_ctx* ctx = nullptr;
+        // Longest sequence the compute buffers were allocated for.
+        int max_tokens = 0;
+        bert_tokens tokens;
+        bert_batch batch;
+        // Rows of a pass evaluated out of input order, before they are
+        // scattered to their place in the output.
+        std::vector<float> rows;
+    };
+
+    // Exclusive use of one compute context; returns it to the pool when
+    // destroyed.
+    class Lease {
+    public:
+        Lease(HostModel* model, ComputeContext* ctx) : model_(model), ctx_(ctx) {}
+        Lease(Lease&& other) noexcept : model_(other.model_), ctx_(other.ctx_) { other.ctx_ = nullptr; }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() {
+            if (ctx_) model_->release(ctx_);
+        }
+
+        bert_ctx* get() const { return ctx_ ? ctx_->ctx : nullptr; }
+        bert_tokens& tokens() const { return ctx_->tokens; }
+        bert_batch& batch() const { return ctx_->batch; }
+        std::vector<float>& rows() const { return ctx_->rows; }
+
+    private:
+        HostModel* model_;
+        ComputeContext* ctx_;
+    };
+
+    // Loads the first compute context, sized for the model's maximum
+    // length. length_buckets lists the sequence lengths later contexts may
+    // be sized for; lengths above the model maximum are dropped. Returns
+    // nullptr if the model can't be loaded.
+    static std::shared_ptr<HostModel> load(const std::string& path, size_t max_contexts, int max_batch,
+                                           const std::vector<int>& length_buckets = {});
+    ~HostModel();
+
+    HostModel(const HostModel&) = delete;
+    HostModel& operator=(const HostModel&) = delete;
+
+    // Blocks until a compute context that fits num_tokens is free, taking
+    // the shortest idle one that does. Without buckets a new context is
+    // loaded while the pool is below max_contexts. The lease is empty if
+    // loading failed.
+    Lease acquire(size_t num_tokens);
+
+    const std::string& path() const { return path_; }
+    int n_embd() const { return n_embd_; }
+    int n_max_tokens() const { return n_max_tokens_; }
+
+private:
+    HostModel(const std::string& path, size_t max_contexts, int max_batch);
+    std::unique_ptr<ComputeContext> create_context(int max_tokens);
+    int bucket_for(size_t num_tokens) const;
+    void release(ComputeContext* ctx);
+
+    const std::string path_;
+    const size_t max_contexts_;
+    const int max_batch_;
+    int n_embd_ = 0;
+    int n_max_tokens_ = 0;
+    // Ascending; the last entry is always n_max_tokens_.
+    std::vector<int> buckets_;
+
+    std::mutex mutex_;
+    std::condition_variable context_released_;
+    std::vector<ComputeContext*> idle_;
+    std::vector<std::unique_ptr<ComputeContext>> all_;
+    // Contexts created or being created; bounds the pool.
+    size_t reserved_ = 0;
+};
+
+// Time spent creating compute contexts since the process started, for the
+// startup profile: reading weights in bert_load_from_file, and allocating
+// compute buffers in bert_allocate_buffers.
+struct ModelLoadTimes {
+    std::atomic<uint64_t> weights_ns{0};
+    std::atomic<uint64_t> buffers_ns{0};
+};
+
+ModelLoadTimes& model_load_times();
+
+// Loaded models keyed by path. Entries are weak, so a model is unloaded when
+// its last session is released and reloaded by the next session that asks.
+class ModelRegistry {
+public:
+    std::shared_ptr<HostModel> get_or_load(const std::string& path, size_t max_contexts, int max_batch,
+                                           const std::vector<int>& length_buckets = {});
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::weak_ptr<HostModel>> models_;
+};
@@ -0,0 +1,108 @@
+// openenclave_ml_poc/host/quantize_model.cpp
+// Offline tool that writes a quantised copy of the f16 GGUF model for
+// --model-variant:
+//
+//   ml_quantize <input.gguf> <output.gguf> <q8_0|q4_k>
+//
+// Metadata is copied unchanged. The weight matrices are re-encoded, and
+// biases and layer norms stay in their original type, as llama.cpp's
+// quantize does.
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ggml.h"
+
+namespace {
+
+struct QuantType {
+    const char* name;
+    ggml_type type;
+};
+
+const QuantType kQuantTypes[] = {
+    {"q8_0", GGML_TYPE_Q8_0},
+    {"q4_k", GGML_TYPE_Q4_K},
+};
+
+// Only 2D float matrices whose rows are a whole number of quantisation
+// blocks are converted; everything else is copied as is.
+bool should_quantize(const ggml_tensor* t, ggml_type type) {
+    return ggml_n_dims(t) == 2 && (t->type == GGML_TYPE_F16 || t->type == GGML_TYPE_F32) &&
+           t->ne[0] % ggml_blck_size(type) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <input.gguf> <output.gguf> <q8_0|q4_k>" << std::endl;
+        return 1;
+    }
+    const QuantType* quant = nullptr;
+    for (const QuantType& q : kQuantTypes) {
+        if (std::strcmp(argv[3], q.name) == 0) quant = &q;
+    }
+    if (!quant) {
+        std::cerr << "[Quantize] Unknown type " << argv[3] << std::endl;
+        return 1;
+    }
+
+    ggml_context* data_ctx = nullptr;
+    gguf_init_params params = {/*no_alloc=*/false, &data_ctx};
+    gguf_context* in = gguf_init_from_file(argv[1], params);
+    if (!in) {
+        std::cerr << "[Quantize] Failed to read " << argv[1] << std::endl;
+        return 1;
+    }
+
+    gguf_context* out = gguf_init_empty();
+    gguf_set_kv(out, in);
+
+    // Quantised tensor data must outlive gguf_write_to_file; unconverted
+    // tensors keep pointing into data_ctx.
+    std::vector<std::vector<char>> buffers;
+    std::vector<float> f32;
+    size_t in_bytes = 0;
+    size_t out_bytes = 0;
+    int converted = 0;
+    int n_tensors = static_cast<int>(gguf_get_n_tensors(in));
+    buffers.reserve(n_tensors);
+    for (int i = 0; i < n_tensors; ++i) {
+        const char* name = gguf_get_tensor_name(in, i);
+        ggml_tensor* t = ggml_get_tensor(data_ctx, name);
+        gguf_add_tensor(out, t);
+        in_bytes += ggml_nbytes(t);
+        if (!should_quantize(t, quant->type)) {
+            out_bytes += ggml_nbytes(t);
+            continue;
+        }
+
+        int64_t n = ggml_nelements(t);
+        int64_t n_per_row = t->ne[0];
+        int64_t nrows = n / n_per_row;
+        f32.resize(n);
+        if (t->type == GGML_TYPE_F16) {
+            ggml_fp16_to_fp32_row(static_cast<const ggml_fp16_t*>(t->data), f32.data(), n);
+        } else {
+            std::memcpy(f32.data(), t->data, n * sizeof(float));
+        }
+        buffers.emplace_back(ggml_row_size(quant->type, n_per_row) * nrows);
+        size_t size = ggml_quantize_chunk(quant->type, f32.data(), buffers.back().data(), 0, nrows, n_per_row, nullptr);
+        gguf_set_tensor_type(out, name, quant->type);
+        gguf_set_tensor_data(out, name, buffers.back().data(), size);
+        out_bytes += size;
+        ++converted;
+    }
+
+    gguf_write_to_file(out, argv[2], /*only_meta=*/false);
+    std::cerr << "[Quantize] " << argv[2] << ": " << converted << " of " << n_tensors << " tensors as "
+              << quant->name << ", " << in_bytes / (1 << 20) << " MiB -> " << out_bytes / (1 << 20) << " MiB"
+              << std::endl;
+
+    gguf_free(out);
+    gguf_free(in);
+    ggml_free(data_ctx);
+    return 0;
+}
@@ -0,0 +1,230 @@
+// openenclave_ml_poc/host/shm_ring.cpp
+#include "shm_ring.h"
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+// Polls before sleeping: a request usually follows the previous one within
+// microseconds under load, and a futex round trip costs about as much.
+constexpr int kSpins = 2000;
+// Sleepers wake up this often even without a wake, so a peer that died
+// mid-write cannot leave them asleep for ever.
+constexpr long kWaitNanos = 100 * 1000 * 1000;
+
+size_t round_up(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+std::atomic<uint32_t>& record_word(uint8_t* data, size_t pos) {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(data + pos);
+}
+
+// The words are shared with another process, so these are not
+// FUTEX_PRIVATE_FLAG futexes.
+void futex_wait(std::atomic<uint32_t>& word, uint32_t expected) {
+    struct timespec timeout = {0, kWaitNanos};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+void futex_wake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// Bumps seq and wakes its sleepers if there are any. Both are sequentially
+// consistent, as is a sleeper's count-then-recheck, so either the waker sees
+// the sleeper or the sleeper sees the change.
+void notify(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiters) {
+    seq.fetch_add(1);
+    if (waiters.load() > 0) futex_wake(seq);
+}
+
+// Sleeps on seq until ready() holds, spinning briefly first.
+template <typename Ready>
+void wait_until(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiters, Ready ready) {
+    for (int spin = 0; spin < kSpins; ++spin) {
+        if (ready()) return;
+        __builtin_ia32_pause();
+    }
+    while (!ready()) {
+        waiters.fetch_add(1);
+        uint32_t seen = seq.load();
+        if (!ready()) futex_wait(seq, seen);
+        waiters.fetch_sub(1);
+    }
+}
+
+void close_ring(ShmRingControl& control) {
+    control.closed.store(1);
+    notify(control.data_seq, control.data_waiters);
+    notify(control.space_seq, control.space_waiters);
+}
+
+}  // namespace
+
+ShmRing::ShmRing(ShmRingControl* control, uint8_t* data, size_t capacity)
+    : control_(control), data_(data), capacity_(capacity) {}
+
+bool ShmRing::wait_for_record() {
+    for (;;) {
+        size_t pos = control_->tail.load(std::memory_order_relaxed) % capacity_;
+        std::atomic<uint32_t>& word = record_word(data_, pos);
+        wait_until(control_->data_seq, control_->data_waiters, [&] {
+            return word.load(std::memory_order_acquire) != 0 || control_->closed.load() != 0;
+        });
+        uint32_t length = word.load(std::memory_order_acquire);
+        if (length == 0) return false;
+        if (length & kShmPaddingFlag) {
+            if (pos + (length & ~kShmPaddingFlag) != capacity_) {
+                throw std::runtime_error("[Host] Corrupt shared-memory ring padding");
+            }
+            // The rest of a padding record was free space, already zero.
+            word.store(0, std::memory_order_relaxed);
+            release_record(length & ~kShmPaddingFlag);
+            continue;
+        }
+        if (pos + kShmRecordHeader + length > capacity_ || length > capacity_ / 2) {
+            throw std::runtime_error("[Host] Corrupt shared-memory ring record");
+        }
+        frame_pos_ = pos + kShmRecordHeader;
+        frame_left_ = length;
+        record_bytes_ = kShmRecordHeader + round_up(length, kShmRecordHeader);
+        return true;
+    }
+}
+
+void ShmRing::release_record(size_t record_bytes) {
+    control_->tail.fetch_add(record_bytes, std::memory_order_release);
+    notify(control_->space_seq, control_->space_waiters);
+}
+
+size_t ShmRing::read(void* buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        if (frame_left_ == 0 && !wait_for_record()) break;
+        size_t n = std::min(len - done, frame_left_);
+        std::memcpy(static_cast<char*>(buf) + done, data_ + frame_pos_, n);
+        done += n;
+        frame_pos_ += n;
+        frame_left_ -= n;
+        if (frame_left_ == 0) {
+            // Released as soon as it is read: a writer may be waiting for
+            // the space while this thread waits for the next frame.
+            size_t pos = control_->tail.load(std::memory_order_relaxed) % capacity_;
+            std::memset(data_ + pos, 0, record_bytes_);
+            release_record(record_bytes_);
+        }
+    }
+    return done;
+}
+
+void ShmRing::write(struct iovec* iov, int iovcnt) {
+    size_t length = 0;
+    for (int i = 0; i < iovcnt; ++i) length += iov[i].iov_len;
+    size_t record_bytes = kShmRecordHeader + round_up(length, kShmRecordHeader);
+    if (length == 0 || record_bytes > capacity_ / 2) {
+        throw std::runtime_error("[Host] Frame of " + std::to_string(length) +
+                                 " bytes does not fit the shared-memory ring");
+    }
+
+    uint64_t head;
+    size_t pos;
+    size_t padding;
+    for (;;) {
+        if (control_->closed.load() != 0) throw std::runtime_error("[Host] write failed: shared-memory ring closed");
+        head = control_->head.load(std::memory_order_relaxed);
+        uint64_t tail = control_->tail.load(std::memory_order_acquire);
+        pos = head % capacity_;
+        padding = pos + record_bytes <= capacity_ ? 0 : capacity_ - pos;
+        if (head + padding + record_bytes - tail > capacity_) {
+            // Another producer moving head means this reservation has to be
+            // worked out again; past it, tail may be ahead of this head.
+            wait_until(control_->space_seq, control_->space_waiters, [&] {
+                return control_->head.load(std::memory_order_relaxed) != head ||
+                       head + padding + record_bytes - control_->tail.load(std::memory_order_acquire) <= capacity_ ||
+                       control_->closed.load() != 0;
+            });
+            continue;
+        }
+        if (control_->head.compare_exchange_weak(head, head + padding + record_bytes, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    if (padding > 0) {
+        record_word(data_, pos).store(kShmPaddingFlag | static_cast<uint32_t>(padding), std::memory_order_release);
+        pos = 0;
+    }
+    uint8_t* out = data_ + pos + kShmRecordHeader;
+    for (int i = 0; i < iovcnt; ++i) {
+        std::memcpy(out, iov[i].iov_base, iov[i].iov_len);
+        out += iov[i].iov_len;
+    }
+    record_word(data_, pos).store(static_cast<uint32_t>(length), std::memory_order_release);
+    notify(control_->data_seq, control_->data_waiters);
+}
+
+void ShmRing::close() {
+    close_ring(*control_);
+}
+
+ShmTransport::ShmTransport(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("[Host] Shared-memory segment: " + std::string(strerror(errno)));
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* base = size >= kShmDataOffset ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    int map_errno = errno;
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        throw std::runtime_error("[Host] Failed to map shared-memory segment: " +
+                                 std::string(size < kShmDataOffset ? "too small" : strerror(map_errno)));
+    }
+    mapping_ = std::shared_ptr<void>(base, [size](void* p) { munmap(p, size); });
+
+    ShmSegmentHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    size_t ring_bytes = header.ring_bytes;
+    if (std::memcmp(header.magic, kShmMagic, sizeof(kShmMagic)) != 0 || header.version != kShmVersion) {
+        throw std::runtime_error("[Host] Shared-memory segment has the wrong magic or version");
+    }
+    if (ring_bytes < kShmMinRingBytes || ring_bytes > kShmMaxRingBytes || (ring_bytes & (ring_bytes - 1)) != 0 ||
+        size < kShmDataOffset + 2 * ring_bytes) {
+        throw std::runtime_error("[Host] Shared-memory segment has an invalid ring size");
+    }
+    uint8_t* bytes = static_cast<uint8_t*>(base);
+    requests_ = std::make_unique<ShmRing>(reinterpret_cast<ShmRingControl*>(bytes + kShmRequestControlOffset),
+                                          bytes + kShmDataOffset, ring_bytes);
+    responses_ = std::make_unique<ShmRing>(reinterpret_cast<ShmRingControl*>(bytes + kShmResponseControlOffset),
+                                           bytes + kShmDataOffset + ring_bytes, ring_bytes);
+}
+
+void ShmTransport::close_requests_at_eof(int fd) {
+    std::shared_ptr<void> mapping = mapping_;
+    ShmRingControl* control =
+        reinterpret_cast<ShmRingControl*>(static_cast<uint8_t*>(mapping.get()) + kShmRequestControlOffset);
+    std::thread([fd, mapping, control] {
+        char buf[256];
+        for (;;) {
+            ssize_t n = ::read(fd, buf, sizeof(buf));
+            if (n == 0 || (n < 0 && errno != EINTR)) break;
+        }
+        close_ring(*control);
+    }).detach();
+}
@@ -0,0 +1,133 @@
+// openenclave_ml_poc/host/shm_ring.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "worker_protocol.h"
+
+// Shared-memory transport for the binary protocol (--transport=shm). The
+// backend creates a segment, passes it to the worker as an inherited file
+// descriptor (--shm-fd N), and both sides then exchange the same frames as
+// over the pipes through two rings in it: requests from the backend,
+// responses from the worker. Writing a frame is a reservation on the ring's
+// head and a copy; nothing enters the kernel unless a side has to sleep, for
+// which the rings carry futex words. backend/shm_ring.go is the Go side of
+// this layout.
+//
+// Segment layout: a ShmSegmentHeader at 0, the request ring's control block
+// at kShmRequestControlOffset, the response ring's at
+// kShmResponseControlOffset, then the request ring's ring_bytes of data at
+// kShmDataOffset followed by the response ring's.
+//
+// A ring is a sequence of records over head and tail, byte counters that
+// only grow; a record starts at offset % ring_bytes and never wraps. It is
+// an 8-byte header, whose first uint32 is the frame's length (the frame
+// length prefix included) and 0 while the record is being written, then the
+// frame, padded to 8 bytes. A record that does not fit before the end of the
+// data is preceded by a padding record, kShmPaddingFlag | its size, that the
+// consumer skips. Producers reserve with a compare-and-swap on head, copy,
+// then publish the length with a release store, so several can write at once
+// and finish in any order; the consumer reads records in order, zeroes them
+// (free space is always zero, so a stale length is never mistaken for a new
+// one) and advances tail.
+
+constexpr char kShmMagic[8] = {'M', 'L', 'P', 'O', 'C', 'S', 'H', 'M'};
+constexpr uint32_t kShmVersion = 1;
+constexpr size_t kShmRequestControlOffset = 64;
+constexpr size_t kShmResponseControlOffset = 256;
+constexpr size_t kShmDataOffset = 4096;
+constexpr size_t kShmRecordHeader = 8;
+constexpr uint32_t kShmPaddingFlag = 1u << 31;
+// Rings are a power of two in this range; a frame may take at most half of
+// one, so a ring that drains always has room for it.
+constexpr size_t kShmMinRingBytes = 64u << 10;
+constexpr size_t kShmMaxRingBytes = 1u << 30;
+
+struct ShmSegmentHeader {
+    char magic[8];
+    uint32_t version;
+    // Data bytes of each ring.
+    uint32_t ring_bytes;
+};
+
+// The cursors sit on their own cache lines, so producers reserving and the
+// consumer releasing do not contend for one line.
+struct alignas(64) ShmRingControl {
+    // Bytes reserved by producers.
+    std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    // Futex words. data_seq is bumped after a record is published and
+    // space_seq after one is released; a side about to sleep counts itself
+    // in the matching waiters word, so the other side only makes the wake
+    // syscall when someone sleeps.
+    alignas(64) std::atomic<uint32_t> data_seq;
+    std::atomic<uint32_t> data_waiters;
+    std::atomic<uint32_t> space_seq;
+    std::atomic<uint32_t> space_waiters;
+    // Set when no more frames will be written.
+    std::atomic<uint32_t> closed;
+};
+
+static_assert(sizeof(ShmSegmentHeader) <= kShmRequestControlOffset, "segment header overlaps the request ring");
+static_assert(kShmRequestControlOffset + sizeof(ShmRingControl) <= kShmResponseControlOffset,
+              "request ring control overlaps the response ring's");
+static_assert(kShmResponseControlOffset + sizeof(ShmRingControl) <= kShmDataOffset,
+              "response ring control overlaps the ring data");
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "ring atomics must be lock-free to work across processes");
+
+// One direction of the segment, as a WireStream. Any number of threads may
+// write; one thread reads.
+class ShmRing : public WireStream {
+public:
+    ShmRing(ShmRingControl* control, uint8_t* data, size_t capacity);
+
+    // Blocks until len bytes have arrived or the ring is closed and empty.
+    size_t read(void* buf, size_t len) override;
+    // Copies one frame into the ring, waiting while it is full. Throws once
+    // the ring is closed or if the frame exceeds half the ring.
+    void write(struct iovec* iov, int iovcnt) override;
+    // Ends the stream: the reader sees end of input and writers fail.
+    void close();
+
+private:
+    // Waits until the record at tail is published; false once the ring is
+    // closed with nothing left to read.
+    bool wait_for_record();
+    // Zeroes the record at tail and advances tail past it.
+    void release_record(size_t record_bytes);
+
+    ShmRingControl* const control_;
+    uint8_t* const data_;
+    const size_t capacity_;
+    // Reader state: the frame being read, as a position in data_.
+    size_t frame_pos_ = 0;
+    size_t frame_left_ = 0;
+    size_t record_bytes_ = 0;
+};
+
+// The segment passed to the worker.
+class ShmTransport {
+public:
+    // Maps and validates the segment behind fd, which it closes so instances
+    // started by a supervisor do not inherit it. Throws std::runtime_error
+    // on a bad segment.
+    explicit ShmTransport(int fd);
+
+    ShmRing& requests() { return *requests_; }
+    ShmRing& responses() { return *responses_; }
+
+    // Closes the request ring once fd reaches end of input. The backend
+    // keeps the worker's stdin open for as long as it runs, so a worker
+    // whose backend died drains and exits as it would at the end of a pipe.
+    void close_requests_at_eof(int fd);
+
+private:
+    // The mapping outlives the transport while the EOF watcher runs.
+    std::shared_ptr<void> mapping_;
+    std::unique_ptr<ShmRing> requests_;
+    std::unique_ptr<ShmRing> responses_;
+};
@@ -0,0 +1,78 @@
+// openenclave_ml_poc/host/startup_profile.cpp
+#include "startup_profile.h"
+
+#include <iostream>
+
+#include "enclave_u.h"
+#include "model_registry.h"
+
+namespace {
+
+constexpr uint64_t kPageSize = 4096;
+// Suggested heaps are rounded up to whole MiB.
+constexpr uint64_t kHeapPageGranularity = 256;
+
+double to_ms(std::chrono::nanoseconds ns) {
+    return ns.count() / 1e6;
+}
+
+bool enclave_stats(oe_enclave_t* enclave, enclave_stats_t& stats) {
+    oe_result_t ecall_ret_status = OE_FAILURE;
+    return get_enclave_stats(enclave, &ecall_ret_status, &stats) == OE_OK && ecall_ret_status == OE_OK;
+}
+
+}  // namespace
+
+StartupProfile::StartupProfile() : start_(std::chrono::steady_clock::now()), last_(start_) {}
+
+void StartupProfile::mark(const std::string& name) {
+    auto now = std::chrono::steady_clock::now();
+    phases_.emplace_back(name, now - last_);
+    last_ = now;
+}
+
+void StartupProfile::sessions_opening(oe_enclave_t* enclave) {
+    enclave_stats_t stats{};
+    if (enclave_stats(enclave, stats)) heap_before_sessions_ = stats.heap_used_bytes;
+}
+
+void StartupProfile::sessions_opened(oe_enclave_t* enclave) {
+    mark("sessions");
+    enclave_stats_t stats{};
+    if (enclave_stats(enclave, stats) && stats.heap_used_bytes > heap_before_sessions_)
+        context_bytes_ = stats.heap_used_bytes - heap_before_sessions_;
+}
+
+void StartupProfile::report(oe_enclave_t* enclave) const {
+    for (const auto& phase : phases_) {
+        std::cerr << "[Host] startup phase=" << phase.first << " ms=" << to_ms(phase.second) << std::endl;
+    }
+    // Host-side model contexts only; an in-enclave model loads inside the
+    // session phase where the host cannot see it.
+    const ModelLoadTimes& load = model_load_times();
+    uint64_t weights_ns = load.weights_ns.load(std::memory_order_relaxed);
+    uint64_t buffers_ns = load.buffers_ns.load(std::memory_order_relaxed);
+    if (weights_ns + buffers_ns > 0) {
+        std::cerr << "[Host] startup model weights_ms=" << to_ms(std::chrono::nanoseconds(weights_ns))
+                  << " buffers_ms=" << to_ms(std::chrono::nanoseconds(buffers_ns)) << std::endl;
+    }
+    std::cerr << "[Host] startup total_ms=" << to_ms(last_ - start_) << std::endl;
+
+    enclave_stats_t stats{};
+    if (!enclave_stats(enclave, stats)) {
+        std::cerr << "[Host] startup profile: get_enclave_stats failed; no enclave config suggested" << std::endl;
+        return;
+    }
+    // The sessions loaded one context; the others load under load, and only
+    // if the heap has room for them.
+    uint64_t wanted = stats.heap_peak_bytes + (contexts_needed > 1 ? (contexts_needed - 1) * context_bytes_ : 0);
+    wanted += wanted * kHeapHeadroomPercent / 100;
+    uint64_t heap_pages = (wanted + kPageSize - 1) / kPageSize;
+    heap_pages = (heap_pages + kHeapPageGranularity - 1) / kHeapPageGranularity * kHeapPageGranularity;
+    std::cerr << "[Host] startup enclave heap_peak_bytes=" << stats.heap_peak_bytes
+              << " heap_limit_bytes=" << stats.heap_limit_bytes << " context_bytes=" << context_bytes_
+              << " contexts_needed=" << contexts_needed << std::endl;
+    std::cerr << "[Host] startup suggested enclave config: -DENCLAVE_NUM_HEAP_PAGES=" << heap_pages
+              << " -DENCLAVE_NUM_TCS=" << tcs_needed << " (currently "
+              << stats.heap_limit_bytes / kPageSize << " heap pages)" << std::endl;
+}
@@ -0,0 +1,61 @@
+// openenclave_ml_poc/host/startup_profile.h
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <openenclave/host.h>
+
+// Wall-clock breakdown of a worker's cold start (--startup-profile): how
+// long each phase took from the start of main to the first inference, and
+// an enclave configuration sized from what start-up actually used.
+//
+// Enclave creation adds and measures every heap and stack page listed in
+// enclave.conf. OE 0.19 has no EDMM support, so nothing can be committed
+// lazily; the heap the enclave reserves is paid for in full before the
+// model starts loading, and it is the part of start-up a smaller
+// NumHeapPages shortens.
+class StartupProfile {
+public:
+    StartupProfile();
+
+    // Ends the phase running since the previous mark (or construction)
+    // under name.
+    void mark(const std::string& name);
+
+    // Bracket the opening of the worker's sessions; sessions_opened ends the
+    // "sessions" phase. The enclave heap the sessions take is one model
+    // context in ENCLAVE_INPROC_BERT builds, where the sessions share the
+    // model and its later contexts load on demand, and next to nothing
+    // otherwise.
+    void sessions_opening(oe_enclave_t* enclave);
+    void sessions_opened(oe_enclave_t* enclave);
+
+    // Prints the phases, their total, and NumHeapPages and NumTCS values
+    // for this workload. The heap is the enclave's high-water mark plus
+    // room for the contexts start-up did not load, contexts_needed in all
+    // at the size the sessions took, plus kHeapHeadroomPercent; an
+    // in-enclave pool only grows while the heap has room for another
+    // context. The peak only covers start-up and whatever ran before the
+    // report; ml_enclave_heap_peak_bytes in the stats frame gives the
+    // figure after a load test.
+    void report(oe_enclave_t* enclave) const;
+
+    // TCS the worker's threads can occupy at once, filled in by main.
+    size_t tcs_needed = 0;
+    // Forward passes that can run at once, one model context each.
+    size_t contexts_needed = 1;
+
+    static constexpr uint64_t kHeapHeadroomPercent = 25;
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point last_;
+    std::vector<std::pair<std::string, std::chrono::nanoseconds>> phases_;
+    uint64_t heap_before_sessions_ = 0;
+    uint64_t context_bytes_ = 0;
+};
@@ -0,0 +1,701 @@
+// openenclave_ml_poc/host/supervisor.cpp
+#include "supervisor.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <openenclave/bits/result.h>
+
+#include "worker_metrics.h"
+#include "worker_pipeline.h"
+#include "worker_protocol.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Frame = std::shared_ptr<const std::vector<char>>;
+
+// Request IDs with the top bit set belong to the supervisor's own probes and
+// stats scrapes; client IDs must leave it clear.
+constexpr uint64_t kInternalRequestBit = 1ull << 63;
+constexpr int kMaxAttempts = 2;
+// Requests waiting for a ready instance fail after this long.
+constexpr auto kPendingTimeout = std::chrono::seconds(30);
+constexpr auto kStatsTimeout = std::chrono::seconds(2);
+constexpr auto kMinRestartDelay = std::chrono::milliseconds(100);
+constexpr auto kMaxRestartDelay = std::chrono::seconds(5);
+// An instance that ran at least this long is replaced without backoff.
+constexpr auto kStableUptime = std::chrono::seconds(10);
+
+WireRequestHeader request_header_of(const std::vector<char>& frame) {
+    WireRequestHeader header;
+    std::memcpy(&header, frame.data() + sizeof(uint32_t), sizeof(header));
+    return header;
+}
+
+Frame empty_request_frame(uint64_t request_id, uint16_t type) {
+    uint32_t length = sizeof(WireRequestHeader);
+    WireRequestHeader header = {request_id, type, 0, 0};
+    auto frame = std::make_shared<std::vector<char>>(sizeof(length) + length);
+    std::memcpy(frame->data(), &length, sizeof(length));
+    std::memcpy(frame->data() + sizeof(length), &header, sizeof(header));
+    return frame;
+}
+
+// Instances export the same metric families, and Prometheus wants each
+// family once, so their samples are regrouped under one HELP/TYPE header
+// and tagged with an instance label.
+void merge_instance_metrics(const std::vector<std::pair<size_t, std::string>>& texts, std::string& out) {
+    struct Family {
+        size_t owner;
+        std::string header;
+        std::string samples;
+    };
+    std::vector<std::string> order;
+    std::map<std::string, Family> families;
+    for (size_t t = 0; t < texts.size(); ++t) {
+        std::string label = "instance=\"" + std::to_string(texts[t].first) + "\"";
+        std::istringstream in(texts[t].second);
+        Family* current = nullptr;
+        for (std::string line; std::getline(in, line);) {
+            if (line.empty()) continue;
+            if (line.rfind("# HELP ", 0) == 0 || line.rfind("# TYPE ", 0) == 0) {
+                std::string name = line.substr(7, line.find(' ', 7) - 7);
+                auto inserted = families.emplace(name, Family{t, {}, {}});
+                if (inserted.second) order.push_back(name);
+                current = &inserted.first->second;
+                if (current->owner == t) current->header += line + '\n';
+                continue;
+            }
+            if (line[0] == '#' || !current) continue;
+            size_t pos = line.find_first_of("{ ");
+            if (pos == std::string::npos) continue;
+            if (line[pos] == '{') line.insert(pos + 1, line[pos + 1] == '}' ? label : label + ",");
+            else line.insert(pos, "{" + label + "}");
+            current->samples += line + '\n';
+        }
+    }
+    for (const std::string& name : order) {
+        out += families[name].header;
+        out += families[name].samples;
+    }
+}
+
+struct Instance {
+    size_t index = 0;
+    // NUMA node the instance is pinned to, or -1.
+    int numa_node = -1;
+    std::vector<std::string> args;
+    std::vector<char*> argv;
+    // Guarded by Supervisor::mutex_.
+    pid_t pid = -1;
+    bool alive = false;
+    bool ready = false;
+    size_t in_flight = 0;
+    uint64_t generation = 0;
+    Clock::time_point started;
+    Clock::time_point restart_at;
+    Clock::duration restart_delay = Clock::duration::zero();
+    // Guards the pipe to the instance and fd_generation, so a send never
+    // races with the fds being closed and reused by a restart.
+    std::mutex write_mutex;
+    int to_child = -1;
+    uint64_t fd_generation = 0;
+    // Owned by the reader thread while it runs.
+    int from_child = -1;
+    std::thread reader;
+};
+
+struct InFlight {
+    Frame frame;
+    size_t instance;
+    int attempts;
+    // Secure channel frames only make sense to the enclave holding the
+    // channel, so they fail with their instance instead of failing over.
+    bool pinned;
+};
+
+// Where a secure channel lives: its keys exist only in this generation of
+// this instance's enclave.
+struct ChannelOwner {
+    size_t instance;
+    uint64_t generation;
+};
+
+struct Pending {
+    Frame frame;
+    int attempts;
+    Clock::time_point queued;
+};
+
+struct Send {
+    Instance* instance;
+    uint64_t generation;
+    Frame frame;
+};
+
+// Work decided under the lock and done after releasing it, since sends and
+// responses can block on a slow pipe.
+struct Actions {
+    std::vector<Send> sends;
+    // Frames to answer with the given status.
+    std::vector<std::pair<Frame, uint32_t>> failed;
+};
+
+class Supervisor {
+public:
+    Supervisor(WireStream& in, WireStream& out, const SupervisorOptions& options)
+        : in_(in), out_(out), options_(options), scrapes_(16) {
+        for (size_t i = 0; i < std::max<size_t>(1, options.instances); ++i) {
+            instances_.push_back(std::make_unique<Instance>());
+            Instance& instance = *instances_.back();
+            instance.index = i;
+            instance.args = options_.instance_args;
+            if (!options_.numa_nodes.empty()) {
+                instance.numa_node = options_.numa_nodes[i % options_.numa_nodes.size()];
+                instance.args.push_back("--numa-node");
+                instance.args.push_back(std::to_string(instance.numa_node));
+            }
+            for (const std::string& arg : instance.args) instance.argv.push_back(const_cast<char*>(arg.c_str()));
+            instance.argv.push_back(nullptr);
+        }
+    }
+
+    void run();
+
+private:
+    void spawn(Instance& instance);
+    void reap(Instance& instance);
+    void reader_loop(Instance& instance, uint64_t generation, int fd);
+    void handle_response(Instance& instance, uint64_t generation, std::vector<char>& frame);
+    void instance_died_locked(Instance& instance, uint64_t generation, Actions& actions);
+    void dispatch_locked(Actions& actions);
+    // Sends a secure channel frame to the instance holding its channel.
+    void dispatch_pinned_locked(Frame frame, Actions& actions);
+    void perform(Actions& actions);
+    void notify_if_idle_locked();
+    void monitor_loop();
+    void scrape_loop();
+    std::string render_stats();
+    uint64_t next_internal_id_locked() { return kInternalRequestBit | ++internal_ids_; }
+
+    WireStream& in_;
+    WireStream& out_;
+    const SupervisorOptions options_;
+    std::vector<std::unique_ptr<Instance>> instances_;
+
+    std::mutex mutex_;
+    std::condition_variable monitor_cv_;
+    std::condition_variable idle_cv_;
+    std::map<uint64_t, InFlight> in_flight_;
+    std::deque<Pending> pending_;
+    // Outstanding readiness probes and stats scrapes, by internal ID.
+    std::map<uint64_t, size_t> probes_;
+    std::map<uint64_t, std::pair<size_t, std::promise<std::string>>> stats_waiters_;
+    // Open secure channels, learnt from channel open responses.
+    std::map<uint64_t, ChannelOwner> channels_;
+    uint64_t internal_ids_ = 0;
+    // Where the search for the next instance starts, so ties rotate.
+    size_t next_instance_ = 0;
+    uint64_t restarts_ = 0;
+    uint64_t failovers_ = 0;
+    uint64_t failed_ = 0;
+    bool shutting_down_ = false;
+
+    std::mutex out_mutex_;
+    BlockingQueue<WireRequestHeader> scrapes_;
+};
+
+void Supervisor::spawn(Instance& instance) {
+    int to_child[2];
+    int from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) != 0) throw std::runtime_error("[Host] pipe failed: " + std::string(strerror(errno)));
+    if (pipe2(from_child, O_CLOEXEC) != 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        throw std::runtime_error("[Host] pipe failed: " + std::string(strerror(errno)));
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Only async-signal-safe calls between fork and exec.
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        execv("/proc/self/exe", instance.argv.data());
+        _exit(127);
+    }
+    close(to_child[0]);
+    close(from_child[1]);
+    if (pid < 0) {
+        close(to_child[1]);
+        close(from_child[0]);
+        throw std::runtime_error("[Host] fork failed: " + std::string(strerror(errno)));
+    }
+
+    Actions actions;
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation = ++instance.generation;
+        instance.pid = pid;
+        instance.alive = true;
+        instance.ready = false;
+        instance.in_flight = 0;
+        instance.started = Clock::now();
+        uint64_t probe_id = next_internal_id_locked();
+        probes_[probe_id] = instance.index;
+        actions.sends.push_back(Send{&instance, generation, empty_request_frame(probe_id, kFrameReady)});
+    }
+    {
+        std::lock_guard<std::mutex> lock(instance.write_mutex);
+        instance.to_child = to_child[1];
+        instance.fd_generation = generation;
+    }
+    instance.from_child = from_child[0];
+    instance.reader = std::thread(&Supervisor::reader_loop, this, std::ref(instance), generation, from_child[0]);
+    std::cerr << "[Host] Started instance " << instance.index << " (pid " << pid;
+    if (instance.numa_node >= 0) std::cerr << ", NUMA node " << instance.numa_node;
+    std::cerr << ")" << std::endl;
+    perform(actions);
+}
+
+// Called once the instance's reader has seen EOF: releases its pipes and
+// collects the process.
+void Supervisor::reap(Instance& instance) {
+    if (instance.reader.joinable()) instance.reader.join();
+    {
+        std::lock_guard<std::mutex> lock(instance.write_mutex);
+        if (instance.to_child >= 0) close(instance.to_child);
+        instance.to_child = -1;
+        instance.fd_generation = 0;
+    }
+    if (instance.from_child >= 0) close(instance.from_child);
+    instance.from_child = -1;
+
+    pid_t pid;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pid = instance.pid;
+    }
+    if (pid <= 0) return;
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    instance.pid = -1;
+    if (shutting_down_) return;
+    // Back off while instances die young, so a broken enclave or model
+    // does not turn into a fork loop.
+    if (Clock::now() - instance.started >= kStableUptime || instance.restart_delay == Clock::duration::zero()) {
+        instance.restart_delay = kMinRestartDelay;
+    } else {
+        instance.restart_delay = std::min<Clock::duration>(instance.restart_delay * 2, kMaxRestartDelay);
+    }
+    instance.restart_at = Clock::now() + instance.restart_delay;
+    std::cerr << "[Host] Instance " << instance.index << " (pid " << pid << ") exited with "
+              << (WIFSIGNALED(status) ? "signal " + std::to_string(WTERMSIG(status))
+                                      : "status " + std::to_string(WEXITSTATUS(status)))
+              << "; restarting in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(instance.restart_delay).count() << " ms"
+              << std::endl;
+}
+
+void Supervisor::reader_loop(Instance& instance, uint64_t generation, int fd) {
+    try {
+        FdStream stream(fd);
+        std::vector<char> frame;
+        while (read_raw_frame(stream, frame)) handle_response(instance, generation, frame);
+    } catch (const std::exception& e) {
+        std::cerr << "[Host] Instance " << instance.index << ": " << e.what() << std::endl;
+    }
+    Actions actions;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        instance_died_locked(instance, generation, actions);
+    }
+    monitor_cv_.notify_all();
+    perform(actions);
+}
+
+void Supervisor::handle_response(Instance& instance, uint64_t generation, std::vector<char>& frame) {
+    if (frame.size() < sizeof(uint32_t) + sizeof(WireResponseHeader)) {
+        throw std::runtime_error("[Host] Truncated response header");
+    }
+    WireResponseHeader header;
+    std::memcpy(&header, frame.data() + sizeof(uint32_t), sizeof(header));
+
+    Actions actions;
+    bool deliver = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (header.request_id & kInternalRequestBit) {
+            auto probe = probes_.find(header.request_id);
+            if (probe != probes_.end()) {
+                probes_.erase(probe);
+                if (header.status == OE_OK && instance.alive && instance.generation == generation) {
+                    instance.ready = true;
+                    std::cerr << "[Host] Instance " << instance.index << " ready" << std::endl;
+                    dispatch_locked(actions);
+                }
+            }
+            auto waiter = stats_waiters_.find(header.request_id);
+            if (waiter != stats_waiters_.end()) {
+                size_t payload = frame.size() - sizeof(uint32_t) - sizeof(WireResponseHeader);
+                waiter->second.second.set_value(
+                    header.status == OE_OK ? std::string(frame.end() - payload, frame.end()) : std::string());
+                stats_waiters_.erase(waiter);
+            }
+        } else {
+            auto it = in_flight_.find(header.request_id);
+            if (it != in_flight_.end() && it->second.instance == instance.index) {
+                Frame request = std::move(it->second.frame);
+                in_flight_.erase(it);
+                --instance.in_flight;
+                deliver = true;
+                size_t payload = frame.size() - sizeof(uint32_t) - sizeof(WireResponseHeader);
+                if (header.type == kFrameChannelOpen && header.status == OE_OK && payload >= sizeof(uint64_t)) {
+                    uint64_t channel_id;
+                    std::memcpy(&channel_id, frame.data() + sizeof(uint32_t) + sizeof(WireResponseHeader),
+                                sizeof(channel_id));
+                    channels_[channel_id] = ChannelOwner{instance.index, generation};
+                } else if (header.type == kFrameChannelClose && header.status == OE_OK) {
+                    uint64_t channel_id;
+                    std::memcpy(&channel_id, request->data() + sizeof(uint32_t) + sizeof(WireRequestHeader),
+                                sizeof(channel_id));
+                    channels_.erase(channel_id);
+                }
+            }
+        }
+    }
+    if (deliver) {
+        std::lock_guard<std::mutex> lock(out_mutex_);
+        write_raw_frame(out_, frame);
+    }
+    perform(actions);
+    if (deliver) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        notify_if_idle_locked();
+    }
+}
+
+void Supervisor::instance_died_locked(Instance& instance, uint64_t generation, Actions& actions) {
+    if (instance.generation != generation) return;
+    instance.alive = false;
+    instance.ready = false;
+    instance.in_flight = 0;
+    for (auto it = in_flight_.begin(); it != in_flight_.end();) {
+        if (it->second.instance != instance.index) {
+            ++it;
+            continue;
+        }
+        if (it->second.pinned) {
+            actions.failed.emplace_back(it->second.frame, OE_NOT_FOUND);
+        } else if (it->second.attempts >= kMaxAttempts) {
+            actions.failed.emplace_back(it->second.frame, OE_FAILURE);
+        } else {
+            pending_.push_front(Pending{it->second.frame, it->second.attempts, Clock::now()});
+            ++failovers_;
+        }
+        it = in_flight_.erase(it);
+    }
+    for (auto it = probes_.begin(); it != probes_.end();) {
+        it = it->second == instance.index ? probes_.erase(it) : std::next(it);
+    }
+    for (auto it = stats_waiters_.begin(); it != stats_waiters_.end();) {
+        if (it->second.first != instance.index) {
+            ++it;
+            continue;
+        }
+        it->second.second.set_value(std::string());
+        it = stats_waiters_.erase(it);
+    }
+    for (auto it = channels_.begin(); it != channels_.end();) {
+        it = it->second.instance == instance.index ? channels_.erase(it) : std::next(it);
+    }
+    dispatch_locked(actions);
+}
+
+void Supervisor::dispatch_locked(Actions& actions) {
+    while (!pending_.empty()) {
+        Instance* best = nullptr;
+        for (size_t k = 0; k < instances_.size(); ++k) {
+            Instance* instance = instances_[(next_instance_ + k) % instances_.size()].get();
+            if (!instance->ready) continue;
+            if (!best || (!options_.round_robin && instance->in_flight < best->in_flight)) best = instance;
+            if (options_.round_robin) break;
+        }
+        if (!best) return;
+        next_instance_ = best->index + 1;
+        Pending pending = std::move(pending_.front());
+        pending_.pop_front();
+        uint64_t request_id = request_header_of(*pending.frame).request_id;
+        in_flight_[request_id] = InFlight{pending.frame, best->index, pending.attempts + 1, false};
+        ++best->in_flight;
+        actions.sends.push_back(Send{best, best->generation, std::move(pending.frame)});
+    }
+}
+
+void Supervisor::dispatch_pinned_locked(Frame frame, Actions& actions) {
+    // Both frame types lead their payload with the channel ID. A channel
+    // that is unknown, or whose enclave was restarted since, is gone: the
+    // client has to open a new one.
+    uint64_t channel_id = 0;
+    if (frame->size() >= sizeof(uint32_t) + sizeof(WireRequestHeader) + sizeof(channel_id)) {
+        std::memcpy(&channel_id, frame->data() + sizeof(uint32_t) + sizeof(WireRequestHeader), sizeof(channel_id));
+    }
+    auto channel = channels_.find(channel_id);
+    Instance* owner = channel == channels_.end() ? nullptr : instances_[channel->second.instance].get();
+    if (!owner || !owner->ready || owner->generation != channel->second.generation) {
+        actions.failed.emplace_back(std::move(frame), OE_NOT_FOUND);
+        return;
+    }
+    in_flight_[request_header_of(*frame).request_id] = InFlight{frame, owner->index, 1, true};
+    ++owner->in_flight;
+    actions.sends.push_back(Send{owner, owner->generation, std::move(frame)});
+}
+
+void Supervisor::perform(Actions& actions) {
+    for (const Send& send : actions.sends) {
+        std::lock_guard<std::mutex> lock(send.instance->write_mutex);
+        if (send.instance->fd_generation != send.generation) continue;
+        try {
+            FdStream stream(send.instance->to_child);
+            write_raw_frame(stream, *send.frame);
+        } catch (const std::exception&) {
+            // The instance is exiting; its reader sees EOF and resends
+            // whatever this was.
+        }
+    }
+    if (actions.failed.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(out_mutex_);
+        for (const auto& failed : actions.failed) {
+            write_error_response(out_, request_header_of(*failed.first), failed.second);
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed_ += actions.failed.size();
+    notify_if_idle_locked();
+}
+
+void Supervisor::notify_if_idle_locked() {
+    if (in_flight_.empty() && pending_.empty()) idle_cv_.notify_all();
+}
+
+void Supervisor::monitor_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!shutting_down_) {
+        monitor_cv_.wait_for(lock, std::chrono::seconds(1));
+        if (shutting_down_) break;
+        Clock::time_point now = Clock::now();
+
+        Actions actions;
+        while (!pending_.empty() && now - pending_.front().queued >= kPendingTimeout) {
+            actions.failed.emplace_back(std::move(pending_.front().frame), OE_FAILURE);
+            pending_.pop_front();
+        }
+        for (auto& owned : instances_) {
+            Instance& instance = *owned;
+            if (instance.alive) continue;
+            if (instance.pid > 0) {
+                lock.unlock();
+                reap(instance);
+                lock.lock();
+            }
+            if (!shutting_down_ && instance.pid <= 0 && Clock::now() >= instance.restart_at) {
+                ++restarts_;
+                lock.unlock();
+                try {
+                    spawn(instance);
+                } catch (const std::exception& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+                lock.lock();
+            }
+        }
+        lock.unlock();
+        perform(actions);
+        lock.lock();
+    }
+}
+
+void Supervisor::scrape_loop() {
+    WireRequestHeader request;
+    while (scrapes_.pop(request)) {
+        std::string text = render_stats();
+        std::lock_guard<std::mutex> lock(out_mutex_);
+        write_text_response(out_, request, text);
+    }
+}
+
+std::string Supervisor::render_stats() {
+    std::vector<std::pair<size_t, std::future<std::string>>> replies;
+    std::vector<uint64_t> ids;
+    Actions actions;
+    std::string out;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t ready = 0;
+        for (auto& instance : instances_) {
+            if (!instance->ready) continue;
+            ++ready;
+            uint64_t id = next_internal_id_locked();
+            std::promise<std::string> promise;
+            replies.emplace_back(instance->index, promise.get_future());
+            stats_waiters_.emplace(id, std::make_pair(instance->index, std::move(promise)));
+            ids.push_back(id);
+            actions.sends.push_back(Send{instance.get(), instance->generation, empty_request_frame(id, kFrameStats)});
+        }
+        render_gauge(out, "ml_supervisor_instances", "Enclave instances the supervisor keeps running.",
+                     instances_.size());
+        render_gauge(out, "ml_supervisor_ready_instances", "Instances with a warm enclave session.", ready);
+        render_gauge(out, "ml_supervisor_in_flight_requests", "Requests sent to an instance and not yet answered.",
+                     in_flight_.size());
+        render_gauge(out, "ml_supervisor_pending_requests", "Requests waiting for a ready instance.",
+                     pending_.size());
+        render_counter(out, "ml_supervisor_restarts_total", "Instances replaced after exiting.", restarts_);
+        render_counter(out, "ml_supervisor_failovers_total", "Requests resent after their instance died.",
+                       failovers_);
+        render_counter(out, "ml_supervisor_failed_requests_total",
+                       "Requests failed by the supervisor after retries, a timeout or a lost channel.", failed_);
+    }
+    perform(actions);
+
+    std::vector<std::pair<size_t, std::string>> texts;
+    Clock::time_point deadline = Clock::now() + kStatsTimeout;
+    for (auto& reply : replies) {
+        if (reply.second.wait_until(deadline) == std::future_status::ready) {
+            std::string text = reply.second.get();
+            if (!text.empty()) texts.emplace_back(reply.first, std::move(text));
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (uint64_t id : ids) stats_waiters_.erase(id);
+    }
+    merge_instance_metrics(texts, out);
+    return out;
+}
+
+void Supervisor::run() {
+    // A write to an instance that just died must fail, not kill the
+    // supervisor.
+    signal(SIGPIPE, SIG_IGN);
+    for (auto& instance : instances_) spawn(*instance);
+    std::thread monitor(&Supervisor::monitor_loop, this);
+    std::thread scraper(&Supervisor::scrape_loop, this);
+
+    std::exception_ptr error;
+    try {
+        std::vector<char> frame;
+        while (read_raw_frame(in_, frame)) {
+            if (frame.size() < sizeof(uint32_t) + sizeof(WireRequestHeader)) {
+                // Too short for a header, but its length was valid and it
+                // starts with the request ID, so only this request fails.
+                WireRequestHeader header = {};
+                std::memcpy(&header.request_id, frame.data() + sizeof(uint32_t), sizeof(header.request_id));
+                std::lock_guard<std::mutex> lock(out_mutex_);
+                write_error_response(out_, header, OE_INVALID_PARAMETER);
+                continue;
+            }
+            WireRequestHeader header = request_header_of(frame);
+            if (header.request_id & kInternalRequestBit) {
+                // Its response would be taken for a probe's and never
+                // delivered, leaving it in flight for ever.
+                std::lock_guard<std::mutex> lock(out_mutex_);
+                write_error_response(out_, header, OE_INVALID_PARAMETER);
+                continue;
+            }
+            if (header.type == kFrameReady) {
+                uint32_t ready = 0;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    for (auto& instance : instances_) ready += instance->ready ? 1 : 0;
+                }
+                std::lock_guard<std::mutex> lock(out_mutex_);
+                write_ready_response(out_, header, ready);
+                continue;
+            }
+            if (header.type == kFrameStats) {
+                scrapes_.push(header);
+                continue;
+            }
+            if (header.type == kFrameIndexUpdate) {
+                // Each instance has its own index, and frames sent to
+                // different instances from different threads have no
+                // common order, so updates could apply in a different
+                // order per instance or miss one being restarted. With a
+                // supervisor the index comes from --index, which every
+                // instance loads when it starts.
+                std::lock_guard<std::mutex> lock(out_mutex_);
+                write_error_response(out_, header, OE_UNSUPPORTED);
+                continue;
+            }
+
+            Actions actions;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto shared = std::make_shared<const std::vector<char>>(std::move(frame));
+                if (header.type == kFrameInferSecure || header.type == kFrameChannelClose) {
+                    dispatch_pinned_locked(std::move(shared), actions);
+                } else if (pending_.size() >= options_.queue_capacity) {
+                    actions.failed.emplace_back(std::move(shared), OE_FAILURE);
+                } else {
+                    pending_.push_back(Pending{std::move(shared), 0, Clock::now()});
+                    dispatch_locked(actions);
+                }
+            }
+            frame = {};
+            perform(actions);
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    scrapes_.close();
+    scraper.join();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_cv_.wait(lock, [&] { return in_flight_.empty() && pending_.empty(); });
+        shutting_down_ = true;
+    }
+    monitor_cv_.notify_all();
+    monitor.join();
+
+    // Closing an instance's input lets it drain and exit like a worker at
+    // the end of its input.
+    for (auto& instance : instances_) {
+        std::lock_guard<std::mutex> lock(instance->write_mutex);
+        if (instance->to_child >= 0) close(instance->to_child);
+        instance->to_child = -1;
+        instance->fd_generation = 0;
+    }
+    for (auto& instance : instances_) reap(*instance);
+    if (error) std::rethrow_exception(error);
+}
+
+}  // namespace
+
+void run_supervisor(WireStream& in, WireStream& out, const SupervisorOptions& options) {
+    if (options.instance_args.empty()) throw std::runtime_error("[Host] Supervisor needs an instance command line");
+    Supervisor(in, out, options).run();
+}
@@ -0,0 +1,50 @@
+// openenclave_ml_poc/host/supervisor.h
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "worker_protocol.h"
+
+struct SupervisorOptions {
+    // Warm enclave instances to keep running.
+    size_t instances = 2;
+    // Command line of one instance, argv[0] included: this binary in binary
+    // protocol worker mode, without --supervisor.
+    std::vector<std::string> instance_args;
+    // Requests held while no instance is ready; beyond that they fail at once.
+    size_t queue_capacity = 256;
+    // NUMA nodes to place instances on, round-robin; instance i runs with
+    // --numa-node numa_nodes[i % size]. Empty leaves placement to the kernel.
+    std::vector<int> numa_nodes;
+    // Send each request to the next ready instance in turn instead of the
+    // one with the fewest requests in flight.
+    bool round_robin = false;
+};
+
+// Supervisor mode (--supervisor N). Keeps N worker processes of this binary
+// running, each with its own enclave and open sessions, and relays binary
+// protocol frames between in/out and them:
+//  - requests go to the ready instance with the fewest in flight (ties, or
+//    every request with round_robin, rotate through the instances);
+//  - when an instance dies, its in-flight requests are resent to another
+//    one (a request is tried at most twice, so a request that crashes the
+//    enclave cannot take the whole pool down) and a replacement is started
+//    in the background, with backoff if instances keep dying young;
+//  - an instance counts as ready once it has answered a kFrameReady probe,
+//    which it only reads after its enclave and sessions are up, so no
+//    request ever waits for enclave creation while another instance is warm;
+//  - secure channel frames go to the instance whose enclave opened the
+//    channel, learnt from its kFrameChannelOpen response; they never fail
+//    over, since no other enclave has the keys, and fail with OE_NOT_FOUND
+//    once that instance has died;
+//  - kFrameReady is answered by the supervisor itself with the number of
+//    ready instances, and kFrameStats merges every ready instance's metrics,
+//    labelled by instance, with the supervisor's own;
+//  - kFrameIndexUpdate fails with OE_UNSUPPORTED: instances load their
+//    reference index from --index instead.
+//  - request IDs with the top bit set are reserved for the supervisor's own
+//    probes and scrapes, and fail with OE_INVALID_PARAMETER.
+// Blocks until in reaches EOF and every accepted request is answered.
+void run_supervisor(WireStream& in, WireStream& out, const SupervisorOptions& options);
@@ -0,0 +1,121 @@
+// openenclave_ml_poc/host/vocab_table.cpp
+#include "vocab_table.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ull;
+constexpr uint64_t kFnvPrime = 0x100000001b3ull;
+
+constexpr uint64_t fnv1a(uint64_t state, const char* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        state = (state ^ static_cast<unsigned char>(data[i])) * kFnvPrime;
+    }
+    return state;
+}
+
+// Hash state after the "##" continuation prefix, so continuation pieces are
+// hashed without building the prefixed string.
+constexpr uint64_t kContinuationState = fnv1a(kFnvOffset, "##", 2);
+
+uint64_t hash_piece(std::string_view piece, bool continuation) {
+    return fnv1a(continuation ? kContinuationState : kFnvOffset, piece.data(), piece.size());
+}
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// Maps a uniform 64-bit value onto [0, n) with a multiply instead of a
+// division.
+size_t reduce(uint64_t x, size_t n) {
+    return static_cast<size_t>((static_cast<unsigned __int128>(x) * n) >> 64);
+}
+
+// Average tokens per bucket, and slots per token. Small buckets keep the
+// seed search short; 25% spare slots make it converge for every bucket.
+constexpr size_t kTokensPerBucket = 4;
+constexpr uint32_t kMaxSeedAttempts = 1u << 24;
+
+}  // namespace
+
+// The bucket index is taken from mix(hash); offsetting the seed keeps slot
+// positions independent of it.
+size_t VocabTable::slot_for(uint64_t hash, uint32_t seed) const {
+    return reduce(mix(hash + (seed + 1ull) * 0x9e3779b97f4a7c15ull), slots_.size());
+}
+
+void VocabTable::build(const std::vector<std::string_view>& tokens) {
+    storage_.clear();
+    offsets_.assign(1, 0);
+    max_token_bytes_ = 0;
+    for (std::string_view t : tokens) {
+        storage_.append(t.data(), t.size());
+        offsets_.push_back(static_cast<uint32_t>(storage_.size()));
+        max_token_bytes_ = std::max(max_token_bytes_, t.size());
+    }
+
+    size_t n = tokens.size();
+    seeds_.assign(std::max<size_t>(1, n / kTokensPerBucket), 0);
+    slots_.assign(std::max<size_t>(1, n + n / 4), -1);
+
+    std::vector<uint64_t> hashes(n);
+    std::vector<std::vector<uint32_t>> buckets(seeds_.size());
+    for (uint32_t id = 0; id < n; ++id) {
+        hashes[id] = hash_piece(token(id), false);
+        std::vector<uint32_t>& bucket = buckets[reduce(mix(hashes[id]), seeds_.size())];
+        // Equal tokens always share a bucket; keep only the first ID.
+        bool duplicate = std::any_of(bucket.begin(), bucket.end(),
+                                     [&](uint32_t other) { return token(other) == token(id); });
+        if (!duplicate) bucket.push_back(id);
+    }
+
+    // Place the largest buckets first, while most slots are still free.
+    std::vector<uint32_t> order(buckets.size());
+    for (uint32_t b = 0; b < order.size(); ++b) order[b] = b;
+    std::sort(order.begin(), order.end(),
+              [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+    std::vector<size_t> placed;
+    for (uint32_t b : order) {
+        const std::vector<uint32_t>& bucket = buckets[b];
+        if (bucket.empty()) break;
+        uint32_t seed = 0;
+        for (;; ++seed) {
+            if (seed == kMaxSeedAttempts) throw std::runtime_error("[Host] Failed to build the vocabulary hash table");
+            placed.clear();
+            bool fits = true;
+            for (uint32_t id : bucket) {
+                size_t slot = slot_for(hashes[id], seed);
+                if (slots_[slot] >= 0 || std::find(placed.begin(), placed.end(), slot) != placed.end()) {
+                    fits = false;
+                    break;
+                }
+                placed.push_back(slot);
+            }
+            if (fits) break;
+        }
+        seeds_[b] = seed;
+        for (size_t i = 0; i < bucket.size(); ++i) slots_[placed[i]] = static_cast<int32_t>(bucket[i]);
+    }
+}
+
+int32_t VocabTable::find(std::string_view piece, bool continuation) const {
+    if (offsets_.size() <= 1) return -1;
+    uint64_t hash = hash_piece(piece, continuation);
+    int32_t id = slots_[slot_for(hash, seeds_[reduce(mix(hash), seeds_.size())])];
+    if (id < 0) return -1;
+    std::string_view candidate = token(static_cast<uint32_t>(id));
+    size_t prefix = continuation ? 2 : 0;
+    if (candidate.size() != piece.size() + prefix) return -1;
+    if (continuation && (candidate[0] != '#' || candidate[1] != '#')) return -1;
+    return std::memcmp(candidate.data() + prefix, piece.data(), piece.size()) == 0 ? id : -1;
+}
@@ -0,0 +1,41 @@
+// openenclave_ml_poc/host/vocab_table.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only map from WordPiece token to ID, built once at startup as a
+// perfect hash (hash-and-displace): every token owns exactly one slot, so a
+// lookup is one hash, two array reads and one key comparison, with no probing
+// and no per-entry allocations. Token bytes are packed into a single string.
+class VocabTable {
+public:
+    // Builds the table from tokens in ID order. A token that appears more
+    // than once keeps its first ID.
+    void build(const std::vector<std::string_view>& tokens);
+
+    // ID of piece, or of "##" + piece when continuation is set; -1 if the
+    // vocabulary has no such token.
+    int32_t find(std::string_view piece, bool continuation = false) const;
+
+    size_t size() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+    // Length in bytes of the longest token, which bounds WordPiece matching.
+    size_t max_token_bytes() const { return max_token_bytes_; }
+
+private:
+    std::string_view token(uint32_t id) const {
+        return std::string_view(storage_).substr(offsets_[id], offsets_[id + 1] - offsets_[id]);
+    }
+    size_t slot_for(uint64_t hash, uint32_t seed) const;
+
+    // Token bytes back to back; token i is storage_[offsets_[i], offsets_[i + 1]).
+    std::string storage_;
+    std::vector<uint32_t> offsets_;
+    // Per-bucket displacement seed, and the token ID in each slot.
+    std::vector<uint32_t> seeds_;
+    std::vector<int32_t> slots_;
+    size_t max_token_bytes_ = 0;
+};
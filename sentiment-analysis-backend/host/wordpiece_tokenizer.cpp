@@ -0,0 +1,523 @@
+// openenclave_ml_poc/host/wordpiece_tokenizer.cpp
+#include "wordpiece_tokenizer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t kMaxInputCharsPerWord = 100;
+constexpr uint32_t kReplacementChar = 0xFFFD;
+
+// Decodes one code point at text[pos], advancing pos. Malformed sequences
+// decode to U+FFFD one byte at a time, which the normaliser then drops.
+uint32_t next_code_point(std::string_view text, size_t& pos) {
+    unsigned char c = static_cast<unsigned char>(text[pos++]);
+    if (c < 0x80) return c;
+    size_t extra;
+    uint32_t cp;
+    if ((c & 0xE0) == 0xC0) { extra = 1; cp = c & 0x1F; }
+    else if ((c & 0xF0) == 0xE0) { extra = 2; cp = c & 0x0F; }
+    else if ((c & 0xF8) == 0xF0) { extra = 3; cp = c & 0x07; }
+    else return kReplacementChar;
+    if (pos + extra > text.size()) return kReplacementChar;
+    for (size_t i = 0; i < extra; ++i) {
+        unsigned char cc = static_cast<unsigned char>(text[pos + i]);
+        if ((cc & 0xC0) != 0x80) return kReplacementChar;
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    pos += extra;
+    static const uint32_t kMinForLength[] = {0, 0x80, 0x800, 0x10000};
+    if (cp < kMinForLength[extra] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return kReplacementChar;
+    return cp;
+}
+
+void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+struct Range {
+    uint32_t first;
+    uint32_t last;
+};
+
+template <size_t N>
+bool in_ranges(uint32_t cp, const Range (&ranges)[N]) {
+    for (const Range& r : ranges) {
+        if (cp < r.first) return false;
+        if (cp <= r.last) return true;
+    }
+    return false;
+}
+
+// Unicode Zs, the line/paragraph separators Python's str.split() breaks on,
+// and the ASCII whitespace BERT treats as separators.
+bool is_whitespace(uint32_t cp) {
+    static const Range kRanges[] = {
+        {0x09, 0x0A}, {0x0D, 0x0D}, {0x20, 0x20}, {0xA0, 0xA0}, {0x1680, 0x1680},
+        {0x2000, 0x200A}, {0x2028, 0x2029}, {0x202F, 0x202F}, {0x205F, 0x205F}, {0x3000, 0x3000},
+    };
+    return in_ranges(cp, kRanges);
+}
+
+// Cc, Cf and Co categories, minus tab/newline/CR (which are whitespace).
+bool is_control(uint32_t cp) {
+    static const Range kRanges[] = {
+        {0x00, 0x08}, {0x0B, 0x0C}, {0x0E, 0x1F}, {0x7F, 0x9F}, {0xAD, 0xAD},
+        {0x600, 0x605}, {0x61C, 0x61C}, {0x6DD, 0x6DD}, {0x70F, 0x70F}, {0x180E, 0x180E},
+        {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x206F},
+        {0xE000, 0xF8FF}, {0xFEFF, 0xFEFF}, {0xFFF9, 0xFFFB}, {0x110BD, 0x110BD},
+        {0x1BCA0, 0x1BCA3}, {0x1D173, 0x1D17A}, {0xE0001, 0xE0001}, {0xE0020, 0xE007F},
+        {0xF0000, 0x10FFFF},
+    };
+    return in_ranges(cp, kRanges);
+}
+
+// BERT counts all non-alphanumeric printable ASCII as punctuation, plus the
+// Unicode P* categories.
+bool is_punctuation(uint32_t cp) {
+    if ((cp >= 33 && cp <= 47) || (cp >= 58 && cp <= 64) || (cp >= 91 && cp <= 96) || (cp >= 123 && cp <= 126))
+        return true;
+    if (cp < 0xA1) return false;
+    static const Range kRanges[] = {
+        {0xA1, 0xA1}, {0xA7, 0xA7}, {0xAB, 0xAB}, {0xB6, 0xB7}, {0xBB, 0xBB}, {0xBF, 0xBF},
+        {0x37E, 0x37E}, {0x387, 0x387}, {0x55A, 0x55F}, {0x589, 0x58A}, {0x5BE, 0x5BE},
+        {0x5C0, 0x5C0}, {0x5C3, 0x5C3}, {0x5C6, 0x5C6}, {0x5F3, 0x5F4}, {0x609, 0x60A},
+        {0x60C, 0x60D}, {0x61B, 0x61B}, {0x61D, 0x61F}, {0x66A, 0x66D}, {0x6D4, 0x6D4},
+        {0x964, 0x965}, {0x970, 0x970}, {0xE4F, 0xE4F}, {0xE5A, 0xE5B}, {0x10FB, 0x10FB},
+        {0x1360, 0x1368}, {0x166E, 0x166E}, {0x169B, 0x169C}, {0x16EB, 0x16ED},
+        {0x2010, 0x2027}, {0x2030, 0x2043}, {0x2045, 0x2051}, {0x2053, 0x205E},
+        {0x207D, 0x207E}, {0x208D, 0x208E}, {0x2308, 0x230B}, {0x2329, 0x232A},
+        {0x2768, 0x2775}, {0x27C5, 0x27C6}, {0x27E6, 0x27EF}, {0x2983, 0x2998},
+        {0x29D8, 0x29DB}, {0x29FC, 0x29FD}, {0x2CF9, 0x2CFC}, {0x2CFE, 0x2CFF},
+        {0x2E00, 0x2E2E}, {0x2E30, 0x2E4F}, {0x3001, 0x3003}, {0x3008, 0x3011},
+        {0x3014, 0x301F}, {0x3030, 0x3030}, {0x303D, 0x303D}, {0x30A0, 0x30A0},
+        {0x30FB, 0x30FB}, {0xFE10, 0xFE19}, {0xFE30, 0xFE52}, {0xFE54, 0xFE61},
+        {0xFE63, 0xFE63}, {0xFE68, 0xFE68}, {0xFE6A, 0xFE6B}, {0xFF01, 0xFF03},
+        {0xFF05, 0xFF0A}, {0xFF0C, 0xFF0F}, {0xFF1A, 0xFF1B}, {0xFF1F, 0xFF20},
+        {0xFF3B, 0xFF3D}, {0xFF3F, 0xFF3F}, {0xFF5B, 0xFF5B}, {0xFF5D, 0xFF5D},
+        {0xFF5F, 0xFF65},
+    };
+    return in_ranges(cp, kRanges);
+}
+
+// CJK ideographs are split into single-character words.
+bool is_chinese_char(uint32_t cp) {
+    static const Range kRanges[] = {
+        {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xF900, 0xFAFF}, {0x20000, 0x2A6DF},
+        {0x2A700, 0x2B73F}, {0x2B740, 0x2B81F}, {0x2B820, 0x2CEAF}, {0x2F800, 0x2FA1F},
+    };
+    return in_ranges(cp, kRanges);
+}
+
+// Mn (nonspacing marks), which accent stripping removes after NFD.
+bool is_nonspacing_mark(uint32_t cp) {
+    static const Range kRanges[] = {
+        {0x300, 0x36F}, {0x483, 0x487}, {0x591, 0x5BD}, {0x5BF, 0x5BF}, {0x5C1, 0x5C2},
+        {0x5C4, 0x5C5}, {0x5C7, 0x5C7}, {0x610, 0x61A}, {0x64B, 0x65F}, {0x670, 0x670},
+        {0x6D6, 0x6DC}, {0x6DF, 0x6E4}, {0x6E7, 0x6E8}, {0x6EA, 0x6ED}, {0xE31, 0xE31},
+        {0xE34, 0xE3A}, {0xE47, 0xE4E}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+        {0x20D0, 0x20DC}, {0x20E1, 0x20E1}, {0x20E5, 0x20F0}, {0x302A, 0x302D},
+        {0xFE20, 0xFE2F},
+    };
+    return in_ranges(cp, kRanges);
+}
+
+// Rough test for a cased letter in the scripts to_lower handles; only the
+// final-sigma rule below needs it.
+bool is_cased_letter(uint32_t cp) {
+    if (cp < 0x80) return (cp | 32) >= 'a' && (cp | 32) <= 'z';
+    return cp >= 0xC0 && cp < 0x530 && cp != 0xD7 && cp != 0xF7 && !is_nonspacing_mark(cp) &&
+           !is_punctuation(cp);
+}
+
+uint32_t to_lower(uint32_t cp) {
+    if (cp < 0x80) return (cp >= 'A' && cp <= 'Z') ? cp + 32 : cp;
+    if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) return cp + 32;
+    if (cp >= 0x100 && cp <= 0x17F) {
+        if (cp == 0x130) return 'i';  // İ lowercases to i + U+0307, which is then stripped.
+        if (cp == 0x178) return 0xFF;
+        bool odd_is_upper = (cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E);
+        bool even_is_upper = (cp <= 0x137 && cp != 0x131) || (cp >= 0x14A && cp <= 0x177);
+        if (odd_is_upper && (cp & 1)) return cp + 1;
+        if (even_is_upper && !(cp & 1)) return cp + 1;
+        return cp;
+    }
+    if (cp >= 0x386 && cp <= 0x3AB) {
+        if (cp >= 0x391 && cp != 0x3A2) return cp + 32;
+        if (cp == 0x386) return 0x3AC;
+        if (cp >= 0x388 && cp <= 0x38A) return cp + 37;
+        if (cp == 0x38C) return 0x3CC;
+        if (cp == 0x38E || cp == 0x38F) return cp + 63;
+        return cp;
+    }
+    if (cp >= 0x400 && cp <= 0x4BF) {
+        if (cp <= 0x40F) return cp + 80;
+        if (cp <= 0x42F) return cp + 32;
+        if (((cp >= 0x460 && cp <= 0x481) || (cp >= 0x48A && cp <= 0x4BF)) && !(cp & 1)) return cp + 1;
+        return cp;
+    }
+    if (cp >= 0xFF21 && cp <= 0xFF3A) return cp + 32;
+    return cp;
+}
+
+// Base letter of a lowercase precomposed character in Latin-1 or Latin
+// Extended-A (what NFD followed by dropping marks leaves), 0 if it has no
+// canonical decomposition.
+const char kLatin1Bases[] = "aaaaaa\0ceeeeiiii\0nooooo\0\0uuuuy\0y";  // U+00E0..U+00FF
+const char kLatinExtABases[] =  // U+0100..U+017F
+    "aaaaaaccccccccdd\0\0eeeeeeeeeegggggggghh\0\0iiiiiiiii\0\0\0jjkk\0llllll\0\0\0\0"
+    "nnnnnn\0\0\0oooooo\0\0rrrrrrsssssssstttt\0\0uuuuuuuuuuuuwwyyyzzzzzz\0";
+
+void strip_accent(uint32_t cp, std::string& out) {
+    uint32_t base = 0;
+    if (cp >= 0xE0 && cp <= 0xFF) base = static_cast<unsigned char>(kLatin1Bases[cp - 0xE0]);
+    else if (cp >= 0x100 && cp <= 0x17F) base = static_cast<unsigned char>(kLatinExtABases[cp - 0x100]);
+    else if (cp >= 0x3AC && cp <= 0x3CE) {
+        switch (cp) {
+            case 0x3AC: base = 0x3B1; break;
+            case 0x3AD: base = 0x3B5; break;
+            case 0x3AE: base = 0x3B7; break;
+            case 0x3AF: case 0x3CA: base = 0x3B9; break;
+            case 0x3B0: case 0x3CB: case 0x3CD: base = 0x3C5; break;
+            case 0x3CC: base = 0x3BF; break;
+            case 0x3CE: base = 0x3C9; break;
+        }
+    } else if (cp == 0x390) {
+        base = 0x3B9;
+    } else if (cp >= 0x450 && cp <= 0x45E) {
+        switch (cp) {
+            case 0x450: case 0x451: base = 0x435; break;
+            case 0x453: base = 0x433; break;
+            case 0x457: base = 0x456; break;
+            case 0x45C: base = 0x43A; break;
+            case 0x45D: base = 0x438; break;
+            case 0x45E: base = 0x443; break;
+        }
+    } else if (cp == 0x439) {
+        base = 0x438;
+    } else if (cp >= 0xAC00 && cp <= 0xD7A3) {
+        // Hangul syllables decompose algorithmically into conjoining jamo.
+        uint32_t s = cp - 0xAC00;
+        append_utf8(out, 0x1100 + s / 588);
+        append_utf8(out, 0x1161 + (s % 588) / 28);
+        if (s % 28) append_utf8(out, 0x11A7 + s % 28);
+        return;
+    }
+    append_utf8(out, base ? base : cp);
+}
+
+// Pulls "key": value out of a flat JSON object; enough for the two scalar
+// settings we read from tokenizer_config.json.
+bool json_scalar(const std::string& json, const std::string& key, std::string& value) {
+    size_t pos = json.find("\"" + key + "\"");
+    if (pos == std::string::npos) return false;
+    pos = json.find(':', pos);
+    if (pos == std::string::npos) return false;
+    pos = json.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos) return false;
+    size_t end = json.find_first_of(",}\r\n", pos);
+    value = json.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.pop_back();
+    return true;
+}
+
+// --- ASCII fast path ---
+
+// Classification of the leading ASCII bytes of a block. Bit i of each mask
+// describes byte i; bytes that are neither word, space nor punctuation are
+// control characters and dropped.
+struct AsciiBlock {
+    // Leading ASCII bytes covered, at most kAsciiBlockBytes; 0 if the
+    // first byte starts a multi-byte sequence.
+    size_t length;
+    uint32_t word;   // letters and digits
+    uint32_t alpha;  // letters only, for the final-sigma rule
+    uint32_t space;
+    uint32_t punct;
+    // The block, lowercased when lowercasing is on.
+    alignas(32) char lowered[32];
+};
+
+constexpr size_t kAsciiBlockBytes = 32;
+
+void finish_block(AsciiBlock& block, uint32_t non_ascii) {
+    block.length = non_ascii ? static_cast<size_t>(__builtin_ctz(non_ascii)) : kAsciiBlockBytes;
+    uint32_t valid = block.length == 32 ? ~0u : (1u << block.length) - 1;
+    block.word &= valid;
+    block.alpha &= valid;
+    block.space &= valid;
+    block.punct &= valid;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Range tests use signed compares, which are exact here because ASCII bytes
+// are non-negative and anything else is cut off by the non-ASCII mask.
+#define WORDPIECE_CLASSIFY_BODY(V, PREFIX, SUFFIX)                                                  \
+    V upper = PREFIX##and_##SUFFIX(PREFIX##cmpgt_epi8(v, PREFIX##set1_epi8('A' - 1)),               \
+                                   PREFIX##cmpgt_epi8(PREFIX##set1_epi8('Z' + 1), v));              \
+    V lower = PREFIX##and_##SUFFIX(PREFIX##cmpgt_epi8(v, PREFIX##set1_epi8('a' - 1)),               \
+                                   PREFIX##cmpgt_epi8(PREFIX##set1_epi8('z' + 1), v));              \
+    V digit = PREFIX##and_##SUFFIX(PREFIX##cmpgt_epi8(v, PREFIX##set1_epi8('0' - 1)),               \
+                                   PREFIX##cmpgt_epi8(PREFIX##set1_epi8('9' + 1), v));              \
+    V alpha = PREFIX##or_##SUFFIX(upper, lower);                                                    \
+    V word = PREFIX##or_##SUFFIX(alpha, digit);                                                     \
+    V space = PREFIX##or_##SUFFIX(                                                                  \
+        PREFIX##or_##SUFFIX(PREFIX##cmpeq_epi8(v, PREFIX##set1_epi8(' ')),                          \
+                            PREFIX##cmpeq_epi8(v, PREFIX##set1_epi8('\t'))),                        \
+        PREFIX##or_##SUFFIX(PREFIX##cmpeq_epi8(v, PREFIX##set1_epi8('\n')),                         \
+                            PREFIX##cmpeq_epi8(v, PREFIX##set1_epi8('\r'))));                       \
+    V printable = PREFIX##and_##SUFFIX(PREFIX##cmpgt_epi8(v, PREFIX##set1_epi8(' ')),               \
+                                       PREFIX##cmpgt_epi8(PREFIX##set1_epi8(0x7F), v));             \
+    V punct = PREFIX##andnot_##SUFFIX(word, printable);                                             \
+    V out = lowercase ? PREFIX##or_##SUFFIX(v, PREFIX##and_##SUFFIX(upper, PREFIX##set1_epi8(0x20))) \
+                      : v;
+
+__attribute__((target("avx2"))) void classify_ascii_avx2(const char* p, bool lowercase, AsciiBlock& block) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    WORDPIECE_CLASSIFY_BODY(__m256i, _mm256_, si256)
+    _mm256_store_si256(reinterpret_cast<__m256i*>(block.lowered), out);
+    block.word = static_cast<uint32_t>(_mm256_movemask_epi8(word));
+    block.alpha = static_cast<uint32_t>(_mm256_movemask_epi8(alpha));
+    block.space = static_cast<uint32_t>(_mm256_movemask_epi8(space));
+    block.punct = static_cast<uint32_t>(_mm256_movemask_epi8(punct));
+    finish_block(block, static_cast<uint32_t>(_mm256_movemask_epi8(v)));
+}
+
+// SSE2 is part of x86-64, so this needs no dispatch; two 16-byte halves
+// make up one block.
+void classify_ascii_sse2(const char* p, bool lowercase, AsciiBlock& block) {
+    block.word = block.alpha = block.space = block.punct = 0;
+    uint32_t non_ascii = 0;
+    for (int half = 0; half < 2; ++half) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * half));
+        WORDPIECE_CLASSIFY_BODY(__m128i, _mm_, si128)
+        _mm_store_si128(reinterpret_cast<__m128i*>(block.lowered + 16 * half), out);
+        int shift = 16 * half;
+        block.word |= static_cast<uint32_t>(_mm_movemask_epi8(word)) << shift;
+        block.alpha |= static_cast<uint32_t>(_mm_movemask_epi8(alpha)) << shift;
+        block.space |= static_cast<uint32_t>(_mm_movemask_epi8(space)) << shift;
+        block.punct |= static_cast<uint32_t>(_mm_movemask_epi8(punct)) << shift;
+        non_ascii |= static_cast<uint32_t>(_mm_movemask_epi8(v)) << shift;
+    }
+    finish_block(block, non_ascii);
+}
+
+#undef WORDPIECE_CLASSIFY_BODY
+
+void classify_ascii(const char* p, bool lowercase, AsciiBlock& block) {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) classify_ascii_avx2(p, lowercase, block);
+    else classify_ascii_sse2(p, lowercase, block);
+}
+
+#else
+
+void classify_ascii(const char* p, bool lowercase, AsciiBlock& block) {
+    block.word = block.alpha = block.space = block.punct = 0;
+    uint32_t non_ascii = 0;
+    for (size_t i = 0; i < kAsciiBlockBytes; ++i) {
+        unsigned char c = static_cast<unsigned char>(p[i]);
+        uint32_t bit = 1u << i;
+        bool upper = c >= 'A' && c <= 'Z';
+        bool alpha = upper || (c >= 'a' && c <= 'z');
+        bool word = alpha || (c >= '0' && c <= '9');
+        if (c >= 0x80) non_ascii |= bit;
+        if (alpha) block.alpha |= bit;
+        if (word) block.word |= bit;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') block.space |= bit;
+        if (c > ' ' && c < 0x7F && !word) block.punct |= bit;
+        block.lowered[i] = static_cast<char>(lowercase && upper ? c + 32 : c);
+    }
+    finish_block(block, non_ascii);
+}
+
+#endif
+
+}  // namespace
+
+WordPieceTokenizer::WordPieceTokenizer(const std::string& dir) {
+    std::ifstream vocab_file(dir + "/vocab.txt", std::ios::binary);
+    if (!vocab_file) throw std::runtime_error("[Host] Cannot open " + dir + "/vocab.txt");
+    std::stringstream contents;
+    contents << vocab_file.rdbuf();
+    std::string text = contents.str();
+
+    // One token per line; the line number is the token ID.
+    std::vector<std::string_view> tokens;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        size_t len = end - start;
+        if (len > 0 && text[start + len - 1] == '\r') --len;
+        tokens.push_back(std::string_view(text).substr(start, len));
+        start = end + 1;
+    }
+    vocab_.build(tokens);
+
+    cls_id_ = vocab_.find("[CLS]");
+    sep_id_ = vocab_.find("[SEP]");
+    unk_id_ = vocab_.find("[UNK]");
+    if (cls_id_ < 0 || sep_id_ < 0 || unk_id_ < 0) {
+        throw std::runtime_error("[Host] " + dir + "/vocab.txt lacks [CLS], [SEP] or [UNK]");
+    }
+
+    std::ifstream config_file(dir + "/tokenizer_config.json");
+    if (config_file) {
+        std::stringstream config;
+        config << config_file.rdbuf();
+        std::string value;
+        if (json_scalar(config.str(), "do_lower_case", value)) lowercase_ = value != "false";
+        if (json_scalar(config.str(), "model_max_length", value)) {
+            long long n = std::atoll(value.c_str());
+            // Configs without a real limit store a huge sentinel here.
+            if (n >= 2 && n <= 1 << 20) max_length_ = static_cast<size_t>(n);
+        }
+    }
+}
+
+void WordPieceTokenizer::encode_word(std::string_view word, std::vector<int32_t>& ids) const {
+    size_t chars = 0;
+    for (char c : word) chars += (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+    if (chars > kMaxInputCharsPerWord) {
+        ids.push_back(unk_id_);
+        return;
+    }
+
+    // Greedy longest-match-first; continuation pieces carry a "##" prefix.
+    // A word with any unmatched remainder becomes a single [UNK].
+    // No candidate is longer than the longest vocabulary entry.
+    auto is_continuation_byte = [&](size_t i) { return (static_cast<unsigned char>(word[i]) & 0xC0) == 0x80; };
+    size_t first_piece = ids.size();
+    size_t start = 0;
+    while (start < word.size()) {
+        size_t end = std::min(word.size(), start + vocab_.max_token_bytes());
+        while (end < word.size() && end > start && is_continuation_byte(end)) --end;
+        int32_t match = -1;
+        while (end > start) {
+            match = vocab_.find(word.substr(start, end - start), start > 0);
+            if (match >= 0) break;
+            // Step back one code point.
+            do { --end; } while (end > start && is_continuation_byte(end));
+        }
+        if (match < 0) {
+            ids.resize(first_piece);
+            ids.push_back(unk_id_);
+            return;
+        }
+        ids.push_back(match);
+        start = end;
+    }
+}
+
+void WordPieceTokenizer::encode(std::string_view text, std::vector<int32_t>& ids) const {
+    ids.clear();
+    ids.push_back(cls_id_);
+
+    std::string word;
+    auto flush_word = [&]() {
+        if (!word.empty()) {
+            encode_word(word, ids);
+            word.clear();
+        }
+    };
+
+    AsciiBlock block;
+    char tail[kAsciiBlockBytes];
+    size_t pos = 0;
+    bool prev_cased = false;
+    while (pos < text.size() && ids.size() < max_length_) {
+        // Classify the next block; a short tail is padded with a non-ASCII
+        // byte so the block stops where the text does.
+        const char* p = text.data() + pos;
+        size_t left = text.size() - pos;
+        if (left < kAsciiBlockBytes) {
+            std::memcpy(tail, p, left);
+            std::memset(tail + left, 0x80, kAsciiBlockBytes - left);
+            p = tail;
+        }
+        classify_ascii(p, lowercase_, block);
+
+        for (size_t i = 0; i < block.length;) {
+            uint32_t bit = 1u << i;
+            if (block.word & bit) {
+                uint32_t rest = ~(block.word >> i);
+                size_t run = rest ? static_cast<size_t>(__builtin_ctz(rest)) : block.length - i;
+                word.append(block.lowered + i, run);
+                prev_cased = (block.alpha >> (i + run - 1)) & 1;
+                i += run;
+                continue;
+            }
+            if (block.space & bit) {
+                flush_word();
+            } else if (block.punct & bit) {
+                flush_word();
+                word.push_back(block.lowered[i]);
+                flush_word();
+            }
+            prev_cased = false;
+            ++i;
+        }
+        pos += block.length;
+        if (block.length == kAsciiBlockBytes || pos >= text.size()) continue;
+
+        // One non-ASCII code point.
+        uint32_t cp = next_code_point(text, pos);
+        if (cp == kReplacementChar || is_control(cp)) continue;
+        if (is_whitespace(cp)) {
+            flush_word();
+            prev_cased = false;
+            continue;
+        }
+        if (lowercase_) {
+            if (is_nonspacing_mark(cp)) continue;
+            bool cased = is_cased_letter(cp);
+            if (cp == 0x3A3) {
+                // Capital sigma lowercases to final sigma at the end of a
+                // word, as Python's str.lower() does.
+                size_t next = pos;
+                bool followed = next < text.size() && is_cased_letter(next_code_point(text, next));
+                cp = prev_cased && !followed ? 0x3C2 : 0x3C3;
+            } else {
+                cp = to_lower(cp);
+            }
+            prev_cased = cased;
+        }
+        if (is_punctuation(cp) || is_chinese_char(cp)) {
+            flush_word();
+            append_utf8(word, cp);
+            flush_word();
+            continue;
+        }
+        if (lowercase_) strip_accent(cp, word);
+        else append_utf8(word, cp);
+    }
+    flush_word();
+
+    if (ids.size() > max_length_ - 1) ids.resize(max_length_ - 1);
+    ids.push_back(sep_id_);
+}
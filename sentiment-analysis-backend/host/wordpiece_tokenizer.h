@@ -0,0 +1,51 @@
+// openenclave_ml_poc/host/wordpiece_tokenizer.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "vocab_table.h"
+
+// BERT WordPiece tokenizer, equivalent to the HuggingFace BertTokenizer that
+// tokenize_script.py loads from tokenizer/ for the models we ship. Loaded
+// once per worker so requests can carry raw UTF-8 text instead of waiting
+// on a Python process per request.
+//
+// Normalisation follows BertNormalizer/BertPreTokenizer: drop control
+// characters, split on whitespace, isolate punctuation and CJK ideographs,
+// then (for uncased vocabularies) lowercase and strip accents. Lowercasing
+// and accent stripping cover Latin-1, Latin Extended-A, Greek, basic
+// Cyrillic and Hangul; other scripts pass through unchanged.
+//
+// Runs of ASCII, the bulk of our traffic, are classified and lowercased 16
+// or 32 bytes at a time with SSE2/AVX2; everything else goes through the
+// per-code-point path.
+class WordPieceTokenizer {
+public:
+    // Loads dir/vocab.txt and, if present, do_lower_case and
+    // model_max_length from dir/tokenizer_config.json. Throws
+    // std::runtime_error if the vocabulary can't be read or lacks the
+    // special tokens.
+    explicit WordPieceTokenizer(const std::string& dir);
+
+    // Replaces ids with [CLS] <word pieces of text> [SEP], truncated to
+    // max_length() tokens.
+    void encode(std::string_view text, std::vector<int32_t>& ids) const;
+
+    size_t vocab_size() const { return vocab_.size(); }
+    size_t max_length() const { return max_length_; }
+
+private:
+    // Appends the word pieces of one pre-tokenized word.
+    void encode_word(std::string_view word, std::vector<int32_t>& ids) const;
+
+    VocabTable vocab_;
+    int32_t cls_id_ = -1;
+    int32_t sep_id_ = -1;
+    int32_t unk_id_ = -1;
+    bool lowercase_ = true;
+    size_t max_length_ = 512;
+};
@@ -0,0 +1,75 @@
+// openenclave_ml_poc/host/worker_metrics.cpp
+#include "worker_metrics.h"
+
+#include <cstdio>
+
+namespace {
+
+void render_header(std::string& out, const char* name, const char* help, const char* type) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void render_sample(std::string& out, const char* name, const char* suffix, const char* labels, double value) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), " %.15g\n", value);
+    out += name;
+    out += suffix;
+    out += labels;
+    out += buf;
+}
+
+}  // namespace
+
+void LatencyHistogram::render(std::string& out, const char* name, const char* help) const {
+    render_header(out, name, help, "histogram");
+    uint64_t cumulative = 0;
+    char labels[32];
+    for (size_t i = 0; i < kBuckets; ++i) {
+        cumulative += buckets_[i].load(std::memory_order_relaxed);
+        std::snprintf(labels, sizeof(labels), "{le=\"%g\"}", static_cast<double>(1ull << i) * 1e-6);
+        render_sample(out, name, "_bucket", labels, static_cast<double>(cumulative));
+    }
+    cumulative += buckets_[kBuckets].load(std::memory_order_relaxed);
+    render_sample(out, name, "_bucket", "{le=\"+Inf\"}", static_cast<double>(cumulative));
+    render_sample(out, name, "_sum", "", sum_ns_.load(std::memory_order_relaxed) * 1e-9);
+    render_sample(out, name, "_count", "", static_cast<double>(cumulative));
+}
+
+WorkerMetrics& worker_metrics() {
+    static WorkerMetrics metrics;
+    return metrics;
+}
+
+void render_counter(std::string& out, const char* name, const char* help, uint64_t value) {
+    render_header(out, name, help, "counter");
+    render_sample(out, name, "", "", static_cast<double>(value));
+}
+
+void render_gauge(std::string& out, const char* name, const char* help, uint64_t value) {
+    render_header(out, name, help, "gauge");
+    render_sample(out, name, "", "", static_cast<double>(value));
+}
+
+void render_worker_metrics(std::string& out) {
+    const WorkerMetrics& m = worker_metrics();
+    render_counter(out, "ml_worker_requests_total", "Request frames read.", m.requests.load());
+    render_counter(out, "ml_worker_sequences_total", "Sequences sent to the enclave.", m.sequences.load());
+    render_counter(out, "ml_worker_tokens_total", "Tokens in sequences sent to the enclave.", m.tokens.load());
+    render_counter(out, "ml_worker_request_failures_total", "Requests answered with an error.", m.failures.load());
+    render_counter(out, "ml_worker_forward_tokens_total", "Real tokens evaluated by forward passes.",
+                   m.forward_tokens.load());
+    render_counter(out, "ml_worker_forward_padded_tokens_total", "Token slots of forward passes, padding included.",
+                   m.forward_padded_tokens.load());
+    m.tokenize.render(out, "ml_worker_tokenize_seconds", "Tokenization time of text frames.");
+    m.ecall.render(out, "ml_worker_ecall_seconds", "Inference ECALL round trips.");
+    m.ocall.render(out, "ml_worker_ocall_seconds", "Time inside host inference OCALLs.");
+    m.forward.render(out, "ml_worker_forward_seconds", "bert_forward time inside OCALLs.");
+}
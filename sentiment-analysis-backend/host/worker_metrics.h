@@ -0,0 +1,81 @@
+// openenclave_ml_poc/host/worker_metrics.h
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Latency histogram with power-of-two microsecond buckets (1 us .. ~4 s plus
+// an overflow bucket). observe() is a few relaxed atomic adds, so it is safe
+// on the request path from any thread; readers see a slightly torn but
+// monotonic snapshot, which is all a scrape needs.
+class LatencyHistogram {
+public:
+    static constexpr size_t kBuckets = 23;
+
+    void observe_ns(uint64_t ns) {
+        uint64_t us = (ns + 999) / 1000;
+        size_t bucket = us <= 1 ? 0 : static_cast<size_t>(64 - __builtin_clzll(us - 1));
+        buckets_[bucket < kBuckets ? bucket : kBuckets].fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    // Appends the histogram in Prometheus text format, in seconds.
+    void render(std::string& out, const char* name, const char* help) const;
+
+private:
+    std::atomic<uint64_t> buckets_[kBuckets + 1] = {};
+    std::atomic<uint64_t> sum_ns_{0};
+};
+
+// Records the lifetime of the enclosing scope in a histogram and, when
+// given, adds it to a plain per-thread counter as well.
+class StageTimer {
+public:
+    explicit StageTimer(LatencyHistogram& histogram, uint64_t* total_ns = nullptr)
+        : histogram_(histogram), total_ns_(total_ns), start_(std::chrono::steady_clock::now()) {}
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+    ~StageTimer() {
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_)
+                          .count();
+        histogram_.observe_ns(ns);
+        if (total_ns_) *total_ns_ += ns;
+    }
+
+private:
+    LatencyHistogram& histogram_;
+    uint64_t* total_ns_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Process-wide worker counters, updated on the request path and rendered on
+// demand by the stats frame (kFrameStats).
+struct WorkerMetrics {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> sequences{0};
+    std::atomic<uint64_t> tokens{0};
+    std::atomic<uint64_t> failures{0};
+    // Real tokens and token slots (padding included) of the bert_forward
+    // passes, so their ratio is the FLOPs spent on padding.
+    std::atomic<uint64_t> forward_tokens{0};
+    std::atomic<uint64_t> forward_padded_tokens{0};
+    // Reader thread, text frames only.
+    LatencyHistogram tokenize;
+    // Whole enclave_infer / enclave_infer_batch calls, as seen by the host.
+    LatencyHistogram ecall;
+    // Host OCALL bodies, and the bert_forward part of them.
+    LatencyHistogram ocall;
+    LatencyHistogram forward;
+};
+
+WorkerMetrics& worker_metrics();
+
+// Append one sample in Prometheus text format.
+void render_counter(std::string& out, const char* name, const char* help, uint64_t value);
+void render_gauge(std::string& out, const char* name, const char* help, uint64_t value);
+
+// Appends every WorkerMetrics field.
+void render_worker_metrics(std::string& out);
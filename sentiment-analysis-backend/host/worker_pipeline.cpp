@@ -0,0 +1,466 @@
+// openenclave_ml_poc/host/worker_pipeline.cpp
+#include "worker_pipeline.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "reference_index.h"
+#include "worker_metrics.h"
+
+namespace {
+
+// Sealed requests carry a 16-byte header and a 16-byte tag around their
+// int32 tokens (enclave/secure_channel.h).
+constexpr size_t kSealedOverhead = 32;
+
+bool is_sealed(const WireRequest& request) {
+    return request.header.type == kFrameInferSecure;
+}
+
+// Tokens a request costs a batch, for requests the host cannot read too.
+size_t request_tokens(const WireRequest& request) {
+    if (!is_sealed(request)) return request.tokens.size();
+    return request.text.size() > kSealedOverhead ? (request.text.size() - kSealedOverhead) / sizeof(int32_t) : 0;
+}
+
+}  // namespace
+
+WorkerPipeline::WorkerPipeline(WireStream& in, WireStream& out, size_t compute_threads, size_t queue_capacity,
+                               const BatchingOptions& batching, InferFn infer, EmbeddingCache* cache,
+                               const WordPieceTokenizer* tokenizer, StatsFn stats, AttestFn attest,
+                               SecureChannelHandlers secure, ClassifyFn classify, ReferenceIndexHandlers index)
+    : in_(in),
+      out_(out),
+      compute_threads_(compute_threads > 0 ? compute_threads : 1),
+      batching_(batching),
+      infer_(std::move(infer)),
+      cache_(cache),
+      tokenizer_(tokenizer),
+      stats_(std::move(stats)),
+      attest_(std::move(attest)),
+      secure_(std::move(secure)),
+      classify_(std::move(classify)),
+      index_(std::move(index)),
+      requests_(queue_capacity),
+      responses_(queue_capacity),
+      token_buffers_(queue_capacity + compute_threads_ * std::max<size_t>(1, batching.max_batch)),
+      embedding_buffers_(queue_capacity + compute_threads_ * std::max<size_t>(1, batching.max_batch)),
+      worker_embeddings_(compute_threads_) {}
+
+void WorkerPipeline::run() {
+    std::thread writer(&WorkerPipeline::writer_loop, this);
+    std::vector<std::thread> compute;
+    for (size_t i = 0; i < compute_threads_; ++i) {
+        compute.emplace_back(&WorkerPipeline::compute_loop, this, i);
+    }
+
+    // The calling thread is the reader; requests still queued at EOF are
+    // drained by the compute threads before the writer shuts down.
+    reader_loop();
+    requests_.close();
+    for (auto& t : compute) t.join();
+    responses_.close();
+    writer.join();
+
+    if (error_) std::rethrow_exception(error_);
+}
+
+void WorkerPipeline::reader_loop() {
+    try {
+        WireRequest request;
+        request.tokens = token_buffers_.take();
+        while (read_request_frame(in_, request)) {
+            worker_metrics().requests.fetch_add(1, std::memory_order_relaxed);
+            if (request.status != OE_OK) {
+                fail_request(request, request.status);
+                continue;
+            }
+            // Tokenizing costs microseconds next to a forward pass, so the
+            // single reader thread keeps up.
+            if (request.header.type == kFrameInferText && tokenizer_) {
+                StageTimer tokenize_timer(worker_metrics().tokenize);
+                tokenizer_->encode(request.text, request.tokens);
+            }
+            if (!requests_.push(std::move(request))) break;
+            request.tokens = token_buffers_.take();
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        if (!error_) error_ = std::current_exception();
+    }
+}
+
+bool WorkerPipeline::collect_batch(std::vector<WireRequest>& batch, std::vector<WireRequest>& carry) {
+    batch.clear();
+    if (!carry.empty()) {
+        batch.push_back(std::move(carry.back()));
+        carry.clear();
+    } else {
+        WireRequest first;
+        if (!requests_.pop(first)) return false;
+        batch.push_back(std::move(first));
+    }
+
+    size_t max_batch = std::max<size_t>(1, batching_.max_batch);
+    size_t tokens = request_tokens(batch.front());
+    auto deadline = std::chrono::steady_clock::now() + batching_.max_delay;
+    while (batch.size() < max_batch && tokens < batching_.max_batch_tokens) {
+        WireRequest next;
+        if (!requests_.pop_until(next, deadline)) break;
+        size_t next_tokens = request_tokens(next);
+        if (tokens + next_tokens > batching_.max_batch_tokens) {
+            carry.push_back(std::move(next));
+            break;
+        }
+        tokens += next_tokens;
+        batch.push_back(std::move(next));
+    }
+    return true;
+}
+
+void WorkerPipeline::fail_request(const WireRequest& request, uint32_t status) {
+    worker_metrics().failures.fetch_add(1, std::memory_order_relaxed);
+    responses_.push(PipelineResponse{request.header, status, {}, {}});
+}
+
+void WorkerPipeline::run_batched_group(std::vector<WireRequest*>& group, const char* kind, const GroupCall& call,
+                                       const GroupFill& fill) {
+    std::vector<const std::vector<int32_t>*> sequences;
+    sequences.reserve(group.size());
+    for (WireRequest* request : group) sequences.push_back(&request->tokens);
+
+    oe_result_t result = call(group, sequences);
+    WorkerMetrics& metrics = worker_metrics();
+    if (result == OE_OK || group.size() == 1) {
+        size_t tokens = 0;
+        for (const std::vector<int32_t>* sequence : sequences) tokens += sequence->size();
+        metrics.sequences.fetch_add(group.size(), std::memory_order_relaxed);
+        metrics.tokens.fetch_add(tokens, std::memory_order_relaxed);
+    }
+    if (result != OE_OK && group.size() > 1) {
+        // One bad sequence fails the whole batched call; retry one by one
+        // so only the offending request gets the error.
+        for (WireRequest* request : group) {
+            std::vector<WireRequest*> single{request};
+            run_batched_group(single, kind, call, fill);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < group.size(); ++i) {
+        PipelineResponse response{group[i]->header, static_cast<uint32_t>(result), {}, {}, group[i]->output};
+        if (result == OE_OK) {
+            fill(i, *group[i], response);
+        } else {
+            metrics.failures.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "[Host] " << kind << " " << group[i]->header.request_id << " failed with "
+                      << oe_result_str(result) << std::endl;
+        }
+        responses_.push(std::move(response));
+    }
+}
+
+void WorkerPipeline::run_group(size_t worker_index, std::vector<WireRequest*>& group) {
+    std::vector<float>& embeddings = worker_embeddings_[worker_index];
+    size_t n_embd = 0;
+    run_batched_group(
+        group, "Request",
+        [&](const std::vector<WireRequest*>&, const std::vector<const std::vector<int32_t>*>& sequences) {
+            return infer_(worker_index, sequences, embeddings, n_embd);
+        },
+        [&](size_t i, const WireRequest& request, PipelineResponse& response) {
+            response.embedding = embedding_buffers_.take();
+            response.embedding.assign(embeddings.begin() + i * n_embd, embeddings.begin() + (i + 1) * n_embd);
+            if (cache_) cache_->insert(request.tokens.data(), request.tokens.size(), response.embedding.data(), n_embd);
+        });
+}
+
+void WorkerPipeline::run_classify_group(size_t worker_index, std::vector<WireRequest*>& group) {
+    std::vector<uint32_t> labels;
+    std::vector<float> scores;
+    size_t n_labels = 0;
+    run_batched_group(
+        group, "Classify request",
+        [&](const std::vector<WireRequest*>&, const std::vector<const std::vector<int32_t>*>& sequences) {
+            return classify_(worker_index, sequences, labels, scores, n_labels);
+        },
+        [&](size_t i, const WireRequest&, PipelineResponse& response) {
+            response.label = labels[i];
+            response.embedding = embedding_buffers_.take();
+            response.embedding.assign(scores.begin() + i * n_labels, scores.begin() + (i + 1) * n_labels);
+        });
+}
+
+void WorkerPipeline::run_search_group(size_t worker_index, std::vector<WireRequest*>& group) {
+    std::vector<uint64_t> ids;
+    std::vector<float> scores;
+    size_t n_results = 0;
+    uint32_t k = 0;
+    run_batched_group(
+        group, "Top-k request",
+        [&](const std::vector<WireRequest*>& searched, const std::vector<const std::vector<int32_t>*>& sequences) {
+            // One call searches for the largest k in the group; the best
+            // matches for a smaller k are a prefix of those.
+            k = 0;
+            for (const WireRequest* request : searched) k = std::max(k, request->top_k);
+            return index_.search(worker_index, sequences, k, ids, scores, n_results);
+        },
+        [&](size_t i, const WireRequest& request, PipelineResponse& response) {
+            size_t take = std::min<size_t>(request.top_k, n_results);
+            response.ids.assign(ids.begin() + i * k, ids.begin() + i * k + take);
+            response.embedding = embedding_buffers_.take();
+            response.embedding.assign(scores.begin() + i * k, scores.begin() + i * k + take);
+        });
+}
+
+void WorkerPipeline::run_secure_group(size_t worker_index, std::vector<WireRequest*>& group) {
+    std::vector<const std::string*> messages;
+    messages.reserve(group.size());
+    for (WireRequest* request : group) messages.push_back(&request->text);
+
+    // Unlike run_group, a failed call is not retried one by one: the
+    // enclave has already consumed the sequence numbers of the messages it
+    // opened, so a retry would be rejected as a replay. It reports bad
+    // messages per request instead.
+    std::vector<std::string> sealed;
+    std::vector<uint32_t> statuses;
+    oe_result_t result = secure_.infer(worker_index, messages, sealed, statuses);
+    WorkerMetrics& metrics = worker_metrics();
+    size_t tokens = 0;
+    for (WireRequest* request : group) tokens += request_tokens(*request);
+    metrics.sequences.fetch_add(group.size(), std::memory_order_relaxed);
+    metrics.tokens.fetch_add(tokens, std::memory_order_relaxed);
+
+    for (size_t i = 0; i < group.size(); ++i) {
+        uint32_t status = result == OE_OK ? statuses[i] : static_cast<uint32_t>(result);
+        PipelineResponse response{group[i]->header, status, {}, {}};
+        if (status == OE_OK) {
+            response.text = std::move(sealed[i]);
+        } else {
+            metrics.failures.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "[Host] Secure request " << group[i]->header.request_id << " failed with "
+                      << oe_result_str(static_cast<oe_result_t>(status)) << std::endl;
+        }
+        responses_.push(std::move(response));
+    }
+}
+
+PipelineResponse WorkerPipeline::run_channel_control(const WireRequest& request) {
+    PipelineResponse response{request.header, OE_UNSUPPORTED, {}, {}};
+    if (request.header.type == kFrameChannelOpen) {
+        if (secure_.open) response.status = secure_.open(request.text, response.text);
+    } else if (secure_.close) {
+        uint64_t channel_id = 0;
+        if (request.text.size() != sizeof(channel_id)) {
+            response.status = OE_INVALID_PARAMETER;
+        } else {
+            std::memcpy(&channel_id, request.text.data(), sizeof(channel_id));
+            response.status = secure_.close(channel_id);
+        }
+    }
+    return response;
+}
+
+void WorkerPipeline::compute_loop(size_t worker_index) {
+    std::vector<WireRequest> batch;
+    std::vector<WireRequest> carry;
+    std::vector<WireRequest*> valid;
+    std::vector<WireRequest*> classified;
+    std::vector<WireRequest*> searched;
+    std::vector<WireRequest*> sealed;
+    std::vector<WireRequest*> group;
+    // Sort by length, then cut wherever the length spread of a group would
+    // exceed max_length_ratio, so similar lengths share a forward pass and
+    // little work is spent on padding. Sealed requests are measured by
+    // their message size.
+    auto run_by_length = [&](std::vector<WireRequest*>& requests,
+                             void (WorkerPipeline::*run)(size_t, std::vector<WireRequest*>&)) {
+        std::sort(requests.begin(), requests.end(), [](const WireRequest* a, const WireRequest* b) {
+            return request_tokens(*a) < request_tokens(*b);
+        });
+        // A group that throws (an allocation sized from a request, say) is
+        // answered with OE_FAILURE instead of taking the worker down.
+        auto run_group_guarded = [&] {
+            try {
+                (this->*run)(worker_index, group);
+            } catch (const std::exception& e) {
+                std::cerr << "[Host] Group of " << group.size() << " requests failed: " << e.what() << std::endl;
+                for (WireRequest* failed : group) fail_request(*failed, OE_FAILURE);
+            }
+        };
+        group.clear();
+        for (WireRequest* request : requests) {
+            if (!group.empty() &&
+                request_tokens(*request) > request_tokens(*group.front()) * batching_.max_length_ratio) {
+                run_group_guarded();
+                group.clear();
+            }
+            group.push_back(request);
+        }
+        if (!group.empty()) run_group_guarded();
+    };
+    while (collect_batch(batch, carry)) {
+        valid.clear();
+        classified.clear();
+        searched.clear();
+        sealed.clear();
+        for (WireRequest& request : batch) {
+            try {
+                if (request.header.type == kFrameStats) {
+                    PipelineResponse response{request.header, stats_ ? OE_OK : OE_UNSUPPORTED, {}, {}};
+                    if (stats_) {
+                        render_gauge(response.text, "ml_worker_queue_depth", "Requests waiting for a compute thread.",
+                                     requests_.size());
+                        render_gauge(response.text, "ml_worker_response_queue_depth", "Responses waiting to be written.",
+                                     responses_.size());
+                        stats_(worker_index, response.text);
+                    }
+                    responses_.push(std::move(response));
+                    continue;
+                }
+                if (request.header.type == kFrameAttest) {
+                    PipelineResponse response{request.header, OE_UNSUPPORTED, {}, {}};
+                    if (attest_) response.status = attest_(response.text);
+                    responses_.push(std::move(response));
+                    continue;
+                }
+                if (request.header.type == kFrameReady) {
+                    // Sessions are open before the reader starts, so a compute
+                    // thread that gets this far can serve requests.
+                    responses_.push(PipelineResponse{request.header, OE_OK, {}, {}});
+                    continue;
+                }
+                if (request.header.type == kFrameChannelOpen || request.header.type == kFrameChannelClose) {
+                    responses_.push(run_channel_control(request));
+                    continue;
+                }
+                if (request.header.type == kFrameIndexUpdate) {
+                    PipelineResponse response{request.header, OE_UNSUPPORTED, {}, {}};
+                    uint64_t rows = 0;
+                    if (index_.update) response.status = index_.update(request.text, rows);
+                    if (response.status == OE_OK) {
+                        response.text.assign(reinterpret_cast<const char*>(&rows), sizeof(rows));
+                        std::cerr << "[Host] Reference index updated (" << rows << " rows)" << std::endl;
+                    }
+                    responses_.push(std::move(response));
+                    continue;
+                }
+                if (is_sealed(request)) {
+                    if (!secure_.infer) {
+                        worker_metrics().failures.fetch_add(1, std::memory_order_relaxed);
+                        responses_.push(PipelineResponse{request.header, OE_UNSUPPORTED, {}, {}});
+                    } else if (request_tokens(request) == 0) {
+                        worker_metrics().failures.fetch_add(1, std::memory_order_relaxed);
+                        responses_.push(PipelineResponse{request.header, OE_INVALID_PARAMETER, {}, {}});
+                    } else {
+                        sealed.push_back(&request);
+                    }
+                    continue;
+                }
+                if (request.header.type == kFrameInferText && !tokenizer_) {
+                    worker_metrics().failures.fetch_add(1, std::memory_order_relaxed);
+                    responses_.push(PipelineResponse{request.header, OE_UNSUPPORTED, {}, {}});
+                    continue;
+                }
+                bool known_type = request.header.type == kFrameInferTokens || request.header.type == kFrameInferText;
+                if (!known_type || request.tokens.empty()) {
+                    worker_metrics().failures.fetch_add(1, std::memory_order_relaxed);
+                    responses_.push(PipelineResponse{request.header, OE_INVALID_PARAMETER, {}, {}});
+                    continue;
+                }
+                if (request.header.flags & kFlagTopK) {
+                    if (!index_.search) {
+                        worker_metrics().failures.fetch_add(1, std::memory_order_relaxed);
+                        responses_.push(PipelineResponse{request.header, OE_UNSUPPORTED, {}, {}});
+                    } else if (request.top_k == 0 || request.top_k > kMaxIndexTopK ||
+                               (request.header.flags & kFlagClassify)) {
+                        // k is checked here, before the search group sizes
+                        // its outputs from the largest k in it.
+                        worker_metrics().failures.fetch_add(1, std::memory_order_relaxed);
+                        responses_.push(PipelineResponse{request.header, OE_INVALID_PARAMETER, {}, {}});
+                    } else {
+                        searched.push_back(&request);
+                    }
+                    continue;
+                }
+                if (request.header.flags & kFlagClassify) {
+                    if (classify_) {
+                        classified.push_back(&request);
+                    } else {
+                        worker_metrics().failures.fetch_add(1, std::memory_order_relaxed);
+                        responses_.push(PipelineResponse{request.header, OE_UNSUPPORTED, {}, {}});
+                    }
+                    continue;
+                }
+                uint32_t output_status = check_output_options(request.output);
+                if (output_status != OE_OK) {
+                    worker_metrics().failures.fetch_add(1, std::memory_order_relaxed);
+                    responses_.push(PipelineResponse{request.header, output_status, {}, {}});
+                    continue;
+                }
+                if (cache_) {
+                    PipelineResponse response{request.header, OE_OK, embedding_buffers_.take(), {}, request.output};
+                    if (cache_->lookup(request.tokens.data(), request.tokens.size(), response.embedding)) {
+                        responses_.push(std::move(response));
+                        continue;
+                    }
+                    embedding_buffers_.give(std::move(response.embedding));
+                }
+                valid.push_back(&request);
+            } catch (const std::exception& e) {
+                std::cerr << "[Host] Request " << request.header.request_id << " failed: " << e.what() << std::endl;
+                fail_request(request, OE_FAILURE);
+            }
+        }
+
+        run_by_length(valid, &WorkerPipeline::run_group);
+        run_by_length(classified, &WorkerPipeline::run_classify_group);
+        run_by_length(searched, &WorkerPipeline::run_search_group);
+        run_by_length(sealed, &WorkerPipeline::run_secure_group);
+
+        for (WireRequest& request : batch) token_buffers_.give(std::move(request.tokens));
+    }
+}
+
+void WorkerPipeline::writer_loop() {
+    try {
+        PipelineResponse response;
+        while (responses_.pop(response)) {
+            if (response.status == OE_OK && response.request.type == kFrameStats) {
+                write_text_response(out_, response.request, response.text);
+            } else if (response.status == OE_OK &&
+                       (response.request.type == kFrameAttest || response.request.type == kFrameChannelOpen ||
+                        response.request.type == kFrameInferSecure || response.request.type == kFrameIndexUpdate)) {
+                write_bytes_response(out_, response.request, response.text.data(), response.text.size());
+            } else if (response.status == OE_OK && response.request.type == kFrameReady) {
+                write_ready_response(out_, response.request, 1);
+            } else if (response.status == OE_OK && response.request.type == kFrameChannelClose) {
+                write_error_response(out_, response.request, OE_OK);
+            } else if (response.status == OE_OK && (response.request.flags & kFlagTopK)) {
+                write_matches_response(out_, response.request, response.ids.data(), response.embedding.data(),
+                                       response.ids.size());
+                embedding_buffers_.give(std::move(response.embedding));
+            } else if (response.status == OE_OK && (response.request.flags & kFlagClassify)) {
+                write_scores_response(out_, response.request, response.label, response.embedding.data(),
+                                      response.embedding.size());
+                embedding_buffers_.give(std::move(response.embedding));
+            } else if (response.status == OE_OK) {
+                write_embedding_response(out_, response.request, response.output, response.embedding.data(),
+                                         response.embedding.size());
+                embedding_buffers_.give(std::move(response.embedding));
+            } else {
+                write_error_response(out_, response.request, response.status);
+            }
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex_);
+            if (!error_) error_ = std::current_exception();
+        }
+        // Nobody is reading responses any more; unblock the other stages.
+        requests_.close();
+        responses_.close();
+    }
+}
@@ -0,0 +1,269 @@
+// openenclave_ml_poc/host/worker_pipeline.h
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <openenclave/bits/result.h>
+
+#include "embedding_cache.h"
+#include "wordpiece_tokenizer.h"
+#include "worker_protocol.h"
+
+// Bounded multi-producer/multi-consumer queue. pop() blocks until an item is
+// available or the queue is closed and drained.
+template <typename T>
+class BlockingQueue {
+public:
+    explicit BlockingQueue(size_t capacity) : capacity_(capacity) {}
+
+    // Returns false if the queue was closed.
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [&] { return closed_ || items_.size() < capacity_; });
+        if (closed_) return false;
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [&] { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    // Like pop(), but gives up at deadline. Returns false on timeout or when
+    // the queue is closed and drained.
+    bool pop_until(T& item, std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!not_empty_.wait_until(lock, deadline, [&] { return closed_ || !items_.empty(); })) return false;
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return items_.size();
+    }
+
+private:
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<T> items_;
+    bool closed_ = false;
+};
+
+// Free list of vectors handed back by a later pipeline stage, so steady-state
+// requests reuse the capacity of earlier ones instead of allocating. Keeps at
+// most `limit` spares.
+template <typename T>
+class BufferPool {
+public:
+    explicit BufferPool(size_t limit) : limit_(limit) {}
+
+    // An empty vector, with spare capacity when one is available.
+    std::vector<T> take() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (spare_.empty()) return {};
+        std::vector<T> buffer = std::move(spare_.back());
+        spare_.pop_back();
+        buffer.clear();
+        return buffer;
+    }
+
+    void give(std::vector<T>&& buffer) {
+        if (buffer.capacity() == 0) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (spare_.size() < limit_) spare_.push_back(std::move(buffer));
+    }
+
+private:
+    const size_t limit_;
+    std::mutex mutex_;
+    std::vector<std::vector<T>> spare_;
+};
+
+struct PipelineResponse {
+    WireRequestHeader request;
+    uint32_t status;
+    std::vector<float> embedding;
+    // Payload of kFrameStats, kFrameAttest and secure channel responses.
+    std::string text;
+    // How the embedding is encoded; applied by the writer, so the cache
+    // keeps full vectors whatever each request asked for.
+    WireOutputOptions output;
+    // Best label of a kFlagClassify request, whose scores are in embedding.
+    uint32_t label = 0;
+    // Row IDs of a kFlagTopK request's matches, whose similarities are in
+    // embedding.
+    std::vector<uint64_t> ids;
+};
+
+// Handlers for the secure channel frames. Payloads and responses are
+// opaque to the pipeline; it only batches sealed requests like plaintext
+// ones, since the host never sees their tokens.
+struct SecureChannelHandlers {
+    // Writes the kFrameChannelOpen payload for client_public_key into out.
+    std::function<oe_result_t(const std::string& client_public_key, std::string& out)> open;
+    std::function<oe_result_t(uint64_t channel_id)> close;
+    // Runs sealed requests as one batched call on compute thread
+    // worker_index, filling responses with one sealed embedding each and
+    // statuses with each request's own result. The returned status fails
+    // every request of the call.
+    std::function<oe_result_t(size_t worker_index, const std::vector<const std::string*>& messages,
+                              std::vector<std::string>& responses, std::vector<uint32_t>& statuses)>
+        infer;
+};
+
+// Handlers for the reference index (common/reference_index.h).
+struct ReferenceIndexHandlers {
+    // Searches the index with a batch of sequences' embeddings on compute
+    // thread worker_index, writing row-major sequences x k matrices of
+    // match IDs and similarities into ids and scores, of which the first
+    // n_results columns are filled.
+    std::function<oe_result_t(size_t worker_index, const std::vector<const std::vector<int32_t>*>& sequences,
+                              uint32_t k, std::vector<uint64_t>& ids, std::vector<float>& scores,
+                              size_t& n_results)>
+        search;
+    // Applies a kFrameIndexUpdate payload, setting rows to the row count
+    // it left.
+    std::function<oe_result_t(const std::string& update, uint64_t& rows)> update;
+};
+
+// How compute threads group queued requests into one batched call.
+struct BatchingOptions {
+    // Most sequences per batched call.
+    size_t max_batch = 1;
+    // Most real (unpadded) tokens per batched call.
+    size_t max_batch_tokens = 4096;
+    // How long to wait for more requests after the first one arrives. Zero
+    // still batches whatever is already queued, without waiting.
+    std::chrono::microseconds max_delay{0};
+    // Sequences share a call only while the longest is at most this many
+    // times the shortest, bounding padding waste within a batch.
+    double max_length_ratio = 2.0;
+};
+
+// Runs the binary worker protocol with requests in flight concurrently: a
+// reader thread decodes frames into a queue, compute threads drain it, and a
+// writer thread emits each response as soon as it is ready. Responses are
+// therefore in completion order and matched to requests by request ID.
+//
+// Each compute thread is a micro-batching scheduler: it collects requests
+// until the batch is full or the batching delay expires, sorts them by
+// length and issues one batched call per group of similar lengths. With a
+// cache, requests whose tokens were seen before are answered from it and
+// never reach a batch. With a tokenizer, text frames are tokenized by the
+// reader, so batching sees their real token counts. Stats frames are
+// answered by a compute thread, since rendering them may need an ECALL, and
+// so are readiness frames, which prove a compute thread is serving, and
+// attestation and secure channel frames. Classification requests are
+// batched like embedding requests but bypass the cache, whose entries are
+// embeddings the enclave no longer hands out for them, and so are top-k
+// requests, whose answers change with the index; index updates are
+// applied by a compute thread.
+class WorkerPipeline {
+public:
+    // Computes embeddings for a batch of sequences on compute thread
+    // worker_index, writing them row-major into embeddings and the row width
+    // into n_embd. Each index is only ever used by one thread at a time, and
+    // embeddings is that thread's staging buffer, reused across calls.
+    using InferFn = std::function<oe_result_t(size_t worker_index,
+                                              const std::vector<const std::vector<int32_t>*>& sequences,
+                                              std::vector<float>& embeddings, size_t& n_embd)>;
+    // Appends Prometheus text for a stats frame, on compute thread
+    // worker_index; the pipeline adds its own queue gauges.
+    using StatsFn = std::function<void(size_t worker_index, std::string& out)>;
+    // Writes the kFrameAttest payload into out; the status answers the frame.
+    using AttestFn = std::function<oe_result_t(std::string& out)>;
+    // Like InferFn for kFlagClassify requests: one label per sequence into
+    // labels and a row-major sequences x n_labels matrix into scores.
+    using ClassifyFn = std::function<oe_result_t(size_t worker_index,
+                                                 const std::vector<const std::vector<int32_t>*>& sequences,
+                                                 std::vector<uint32_t>& labels, std::vector<float>& scores,
+                                                 size_t& n_labels)>;
+
+    WorkerPipeline(WireStream& in, WireStream& out, size_t compute_threads, size_t queue_capacity,
+                   const BatchingOptions& batching, InferFn infer, EmbeddingCache* cache = nullptr,
+                   const WordPieceTokenizer* tokenizer = nullptr, StatsFn stats = nullptr,
+                   AttestFn attest = nullptr, SecureChannelHandlers secure = {}, ClassifyFn classify = nullptr,
+                   ReferenceIndexHandlers index = {});
+
+    // Blocks until the input reaches EOF and every accepted request has been
+    // answered. Rethrows a fatal reader or writer error.
+    void run();
+
+private:
+    void reader_loop();
+    void compute_loop(size_t worker_index);
+    void writer_loop();
+    // Collects the next batch for one compute thread. carry holds a request
+    // that did not fit into the previous batch. Returns false once the
+    // input is exhausted.
+    bool collect_batch(std::vector<WireRequest>& batch, std::vector<WireRequest>& carry);
+    // Runs one batched ECALL for group and answers its requests. call runs it
+    // for the group it is given; fill completes the response of the i-th
+    // request of that group from the call's output. A failed call over
+    // several requests is retried one request at a time, so only the one
+    // the enclave refused gets the error; kind names the requests in the
+    // failure log.
+    using GroupCall = std::function<oe_result_t(const std::vector<WireRequest*>& group,
+                                                const std::vector<const std::vector<int32_t>*>& sequences)>;
+    using GroupFill = std::function<void(size_t i, const WireRequest& request, PipelineResponse& response)>;
+    void run_batched_group(std::vector<WireRequest*>& group, const char* kind, const GroupCall& call,
+                           const GroupFill& fill);
+    void run_group(size_t worker_index, std::vector<WireRequest*>& group);
+    void run_classify_group(size_t worker_index, std::vector<WireRequest*>& group);
+    void run_search_group(size_t worker_index, std::vector<WireRequest*>& group);
+    void run_secure_group(size_t worker_index, std::vector<WireRequest*>& group);
+    // Answers channel open and close frames.
+    PipelineResponse run_channel_control(const WireRequest& request);
+    // Counts request as failed and answers it with status.
+    void fail_request(const WireRequest& request, uint32_t status);
+
+    WireStream& in_;
+    WireStream& out_;
+    const size_t compute_threads_;
+    const BatchingOptions batching_;
+    InferFn infer_;
+    EmbeddingCache* const cache_;
+    const WordPieceTokenizer* const tokenizer_;
+    StatsFn stats_;
+    AttestFn attest_;
+    SecureChannelHandlers secure_;
+    ClassifyFn classify_;
+    ReferenceIndexHandlers index_;
+    BlockingQueue<WireRequest> requests_;
+    BlockingQueue<PipelineResponse> responses_;
+    // Token buffers go reader -> compute -> back to the reader, embedding
+    // buffers compute -> writer -> back to compute.
+    BufferPool<int32_t> token_buffers_;
+    BufferPool<float> embedding_buffers_;
+    std::vector<std::vector<float>> worker_embeddings_;
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+};
@@ -0,0 +1,255 @@
+// openenclave_ml_poc/host/worker_protocol.cpp
+#include "worker_protocol.h"
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <openenclave/bits/result.h>
+
+#include "ggml.h"
+
+size_t FdStream::read(void* buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::read(fd_, static_cast<char*>(buf) + done, len - done);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("[Host] read failed: ") + strerror(errno));
+        }
+        done += static_cast<size_t>(n);
+    }
+    return done;
+}
+
+void FdStream::write(struct iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd_, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("[Host] write failed: ") + strerror(errno));
+        }
+        size_t left = static_cast<size_t>(n);
+        while (iovcnt > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+}
+
+namespace {
+
+// Reads and drops bytes of a frame the worker will not decode.
+void skip_frame_bytes(WireStream& stream, size_t bytes) {
+    char chunk[4096];
+    while (bytes > 0) {
+        size_t n = std::min(bytes, sizeof(chunk));
+        if (stream.read(chunk, n) != n) throw std::runtime_error("[Host] Truncated frame payload");
+        bytes -= n;
+    }
+}
+
+}  // namespace
+
+bool read_request_frame(WireStream& stream, WireRequest& request) {
+    uint32_t length = 0;
+    size_t got = stream.read(&length, sizeof(length));
+    if (got == 0) return false;
+    if (got != sizeof(length)) throw std::runtime_error("[Host] Truncated frame length");
+    if (length < sizeof(WireRequestHeader) || length > kMaxWireFrameBytes) {
+        throw std::runtime_error("[Host] Invalid frame length " + std::to_string(length));
+    }
+    if (stream.read(&request.header, sizeof(request.header)) != sizeof(request.header)) {
+        throw std::runtime_error("[Host] Truncated frame header");
+    }
+    size_t payload_bytes = length - sizeof(WireRequestHeader);
+    bool inference = request.header.type == kFrameInferTokens || request.header.type == kFrameInferText;
+    request.status = OE_OK;
+    request.text.clear();
+    request.tokens.clear();
+    // The length says where the next frame starts, so a frame that does not
+    // add up is skipped and answered rather than ending the stream.
+    auto reject = [&](size_t left) {
+        skip_frame_bytes(stream, left);
+        request.status = OE_INVALID_PARAMETER;
+        return true;
+    };
+    request.output = WireOutputOptions();
+    if (inference && (request.header.flags & kFlagOutputOptions)) {
+        if (payload_bytes < sizeof(WireOutputOptions)) return reject(payload_bytes);
+        if (stream.read(&request.output, sizeof(request.output)) != sizeof(request.output)) {
+            throw std::runtime_error("[Host] Truncated output options");
+        }
+        payload_bytes -= sizeof(WireOutputOptions);
+    } else if (request.header.flags & kFlagOutputF16) {
+        request.output.dtype = kDtypeF16;
+    }
+    request.top_k = 0;
+    if (inference && (request.header.flags & kFlagTopK)) {
+        if (payload_bytes < sizeof(request.top_k)) return reject(payload_bytes);
+        if (stream.read(&request.top_k, sizeof(request.top_k)) != sizeof(request.top_k)) {
+            throw std::runtime_error("[Host] Truncated top-k count");
+        }
+        payload_bytes -= sizeof(request.top_k);
+    }
+    bool text = request.header.type != kFrameInferTokens;
+    size_t element_size = text ? 1 : sizeof(int32_t);
+    if (payload_bytes != static_cast<size_t>(request.header.count) * element_size) return reject(payload_bytes);
+    void* payload;
+    if (text) {
+        request.text.resize(payload_bytes);
+        payload = &request.text[0];
+    } else {
+        request.tokens.resize(request.header.count);
+        payload = request.tokens.data();
+    }
+    if (stream.read(payload, payload_bytes) != payload_bytes) {
+        throw std::runtime_error("[Host] Truncated frame payload");
+    }
+    return true;
+}
+
+bool read_raw_frame(WireStream& stream, std::vector<char>& frame) {
+    uint32_t length = 0;
+    size_t got = stream.read(&length, sizeof(length));
+    if (got == 0) return false;
+    if (got != sizeof(length)) throw std::runtime_error("[Host] Truncated frame length");
+    if (length < sizeof(uint64_t) || length > kMaxWireFrameBytes) {
+        throw std::runtime_error("[Host] Invalid frame length " + std::to_string(length));
+    }
+    frame.resize(sizeof(length) + length);
+    std::memcpy(frame.data(), &length, sizeof(length));
+    if (stream.read(frame.data() + sizeof(length), length) != length) {
+        throw std::runtime_error("[Host] Truncated frame");
+    }
+    return true;
+}
+
+void write_raw_frame(WireStream& stream, const std::vector<char>& frame) {
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(frame.data());
+    iov.iov_len = frame.size();
+    stream.write(&iov, 1);
+}
+
+void write_response_frame(WireStream& stream, const WireResponseHeader& header, const void* payload, size_t payload_bytes) {
+    uint32_t length = static_cast<uint32_t>(sizeof(header) + payload_bytes);
+    struct iovec iov[3];
+    iov[0].iov_base = &length;
+    iov[0].iov_len = sizeof(length);
+    iov[1].iov_base = const_cast<WireResponseHeader*>(&header);
+    iov[1].iov_len = sizeof(header);
+    iov[2].iov_base = const_cast<void*>(payload);
+    iov[2].iov_len = payload_bytes;
+    stream.write(iov, payload_bytes > 0 ? 3 : 2);
+}
+
+uint32_t check_output_options(const WireOutputOptions& options) {
+    if (options.dtype != kDtypeF32 && options.dtype != kDtypeF16 && options.dtype != kDtypeI8) {
+        return OE_INVALID_PARAMETER;
+    }
+    if (options.pooling == kPoolingCls) return OE_UNSUPPORTED;
+    return options.pooling == kPoolingMean ? OE_OK : OE_INVALID_PARAMETER;
+}
+
+void write_embedding_response(WireStream& stream, const WireRequestHeader& request_header, const WireOutputOptions& options,
+                              const float* values, size_t count) {
+    size_t dims = options.dims ? options.dims : count;
+    if (dims > count) {
+        write_error_response(stream, request_header, OE_INVALID_PARAMETER);
+        return;
+    }
+    // Reused across frames written by the same thread.
+    static thread_local std::vector<float> normalized;
+    static thread_local std::vector<char> encoded;
+    if (options.normalize) {
+        float sum = 0;
+        for (size_t i = 0; i < dims; ++i) sum += values[i] * values[i];
+        float inv = sum > 0 ? 1.0f / std::sqrt(sum) : 0.0f;
+        normalized.resize(dims);
+        for (size_t i = 0; i < dims; ++i) normalized[i] = values[i] * inv;
+        values = normalized.data();
+    }
+
+    WireResponseHeader header = {request_header.request_id, request_header.type, options.dtype, 0,
+                                 static_cast<uint32_t>(dims)};
+    if (options.dtype == kDtypeF16) {
+        encoded.resize(dims * sizeof(ggml_fp16_t));
+        ggml_fp32_to_fp16_row(values, reinterpret_cast<ggml_fp16_t*>(encoded.data()), static_cast<int64_t>(dims));
+        write_response_frame(stream, header, encoded.data(), encoded.size());
+    } else if (options.dtype == kDtypeI8) {
+        float max_abs = 0;
+        for (size_t i = 0; i < dims; ++i) max_abs = std::max(max_abs, std::fabs(values[i]));
+        float scale = max_abs > 0 ? max_abs / 127.0f : 1.0f;
+        encoded.resize(sizeof(scale) + dims);
+        std::memcpy(encoded.data(), &scale, sizeof(scale));
+        for (size_t i = 0; i < dims; ++i) {
+            encoded[sizeof(scale) + i] = static_cast<char>(static_cast<int8_t>(std::lrint(values[i] / scale)));
+        }
+        write_response_frame(stream, header, encoded.data(), encoded.size());
+    } else {
+        write_response_frame(stream, header, values, dims * sizeof(float));
+    }
+}
+
+void write_scores_response(WireStream& stream, const WireRequestHeader& request_header, uint32_t label, const float* scores,
+                           size_t count) {
+    WireResponseHeader header = {request_header.request_id, request_header.type, kDtypeScores, 0,
+                                 static_cast<uint32_t>(count)};
+    uint32_t length = static_cast<uint32_t>(sizeof(header) + sizeof(label) + count * sizeof(float));
+    struct iovec iov[4];
+    iov[0].iov_base = &length;
+    iov[0].iov_len = sizeof(length);
+    iov[1].iov_base = &header;
+    iov[1].iov_len = sizeof(header);
+    iov[2].iov_base = &label;
+    iov[2].iov_len = sizeof(label);
+    iov[3].iov_base = const_cast<float*>(scores);
+    iov[3].iov_len = count * sizeof(float);
+    stream.write(iov, 4);
+}
+
+void write_matches_response(WireStream& stream, const WireRequestHeader& request_header, const uint64_t* ids,
+                            const float* scores, size_t count) {
+    std::vector<WireMatch> matches(count);
+    for (size_t i = 0; i < count; ++i) matches[i] = WireMatch{ids[i], scores[i]};
+    WireResponseHeader header = {request_header.request_id, request_header.type, kDtypeMatches, 0,
+                                 static_cast<uint32_t>(count)};
+    write_response_frame(stream, header, matches.data(), count * sizeof(WireMatch));
+}
+
+void write_text_response(WireStream& stream, const WireRequestHeader& request_header, const std::string& text) {
+    WireResponseHeader header = {request_header.request_id, request_header.type, kDtypeText, 0,
+                                 static_cast<uint32_t>(text.size())};
+    write_response_frame(stream, header, text.data(), text.size());
+}
+
+void write_bytes_response(WireStream& stream, const WireRequestHeader& request_header, const void* data, size_t bytes) {
+    WireResponseHeader header = {request_header.request_id, request_header.type, kDtypeBytes, 0,
+                                 static_cast<uint32_t>(bytes)};
+    write_response_frame(stream, header, data, bytes);
+}
+
+void write_ready_response(WireStream& stream, const WireRequestHeader& request_header, uint32_t ready_instances) {
+    WireResponseHeader header = {request_header.request_id, request_header.type, kDtypeF32,
+                                 ready_instances > 0 ? static_cast<uint32_t>(OE_OK) : static_cast<uint32_t>(OE_FAILURE),
+                                 ready_instances};
+    write_response_frame(stream, header, nullptr, 0);
+}
+
+void write_error_response(WireStream& stream, const WireRequestHeader& request_header, uint32_t status) {
+    WireResponseHeader header = {request_header.request_id, request_header.type, kDtypeF32, status, 0};
+    write_response_frame(stream, header, nullptr, 0);
+}
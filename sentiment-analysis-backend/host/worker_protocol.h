@@ -0,0 +1,238 @@
+// openenclave_ml_poc/host/worker_protocol.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct iovec;
+
+// Binary framing used by the --use-stdin worker with --protocol=binary.
+//
+// Every frame is a little-endian uint32 byte length followed by that many
+// bytes: a fixed header, then the payload. Requests carry int32 token IDs or
+// raw UTF-8 text for the worker to tokenize; responses carry the embedding
+// as float32, float16 or int8 values, optionally truncated and normalised
+// per request (WireOutputOptions).
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "the worker protocol is defined as little-endian");
+
+enum WireFrameType : uint16_t {
+    kFrameInferTokens = 1,
+    // UTF-8 text tokenized by the worker (--tokenizer-dir).
+    kFrameInferText = 2,
+    // Metrics scrape: no payload in, Prometheus text exposition out.
+    kFrameStats = 3,
+    // Readiness check: no payload in; the response status is OE_OK and its
+    // count the number of warm enclave instances once at least one can
+    // serve requests.
+    kFrameReady = 4,
+    // Attestation evidence: no payload in; out a WireAttestationHeader, the
+    // claims bound into the quote, then the evidence, as raw bytes.
+    kFrameAttest = 5,
+    // Secure channel (enclave/secure_channel.h). Open: the client's 65-byte
+    // P-256 public key in; out a WireChannelHeader, the enclave's public key,
+    // then evidence whose claims are the two keys, as raw bytes.
+    kFrameChannelOpen = 6,
+    // A sealed request in, the sealed embedding out as raw bytes. The
+    // channel ID leads the payload, so the supervisor can route it to the
+    // enclave that holds the channel.
+    kFrameInferSecure = 7,
+    // The 8-byte channel ID in; the response carries only a status.
+    kFrameChannelClose = 8,
+    // A reference index update (common/reference_index.h) in; out the
+    // uint64 row count it left, as raw bytes.
+    kFrameIndexUpdate = 9,
+};
+
+enum WireFlags : uint16_t {
+    // Return the embedding as IEEE float16 instead of float32.
+    kFlagOutputF16 = 1u << 0,
+    // A WireOutputOptions block leads the payload of an inference frame;
+    // count does not include it. It overrides kFlagOutputF16.
+    kFlagOutputOptions = 1u << 1,
+    // Run the session's classifier head (--head) in the enclave and return
+    // its label and scores (kDtypeScores) instead of the embedding.
+    kFlagClassify = 1u << 2,
+    // Search the reference index (--index) with the embedding in the
+    // enclave and return the nearest rows (kDtypeMatches) instead. A uint32
+    // k leads the payload, after any options block; count does not
+    // include it.
+    kFlagTopK = 1u << 3,
+};
+
+enum WireDtype : uint16_t {
+    kDtypeF32 = 0,
+    kDtypeF16 = 1,
+    // UTF-8 text; count is its length in bytes.
+    kDtypeText = 2,
+    // Opaque bytes; count is their length.
+    kDtypeBytes = 3,
+    // Symmetric int8: a float32 scale, then count int8 values; value i is
+    // scale * q[i].
+    kDtypeI8 = 4,
+    // A uint32 label, then count float32 scores, one per head label.
+    kDtypeScores = 5,
+    // count WireMatch entries, most similar first.
+    kDtypeMatches = 6,
+};
+
+enum WirePooling : uint16_t {
+    // Mean over the sequence's tokens, which bert.cpp computes inside its
+    // graph.
+    kPoolingMean = 0,
+    // The [CLS] token's hidden state. Reserved: bert.cpp only returns the
+    // pooled vector, so requests for it fail with OE_UNSUPPORTED.
+    kPoolingCls = 1,
+};
+
+#pragma pack(push, 1)
+struct WireRequestHeader {
+    uint64_t request_id;
+    uint16_t type;
+    uint16_t flags;
+    // Number of payload elements: int32 token IDs for kFrameInferTokens,
+    // bytes for every other frame type.
+    uint32_t count;
+};
+
+struct WireResponseHeader {
+    uint64_t request_id;
+    uint16_t type;
+    uint16_t dtype;
+    // oe_result_t of the request; the payload is empty unless it is OE_OK.
+    uint32_t status;
+    // Number of payload elements of the given dtype.
+    uint32_t count;
+};
+
+// What an inference response carries. The worker keeps the first dims
+// values (0 keeps all; Matryoshka-trained models stay usable truncated),
+// then L2-normalises them if normalize is set, then encodes them as dtype.
+// bert.cpp's vectors arrive normalised, so normalize only matters with
+// truncation.
+struct WireOutputOptions {
+    uint16_t dtype = kDtypeF32;
+    uint16_t pooling = kPoolingMean;
+    uint16_t dims = 0;
+    uint16_t normalize = 0;
+};
+
+// One kDtypeMatches entry: a reference row's ID and its cosine similarity.
+struct WireMatch {
+    uint64_t id;
+    float score;
+};
+
+// Leads the payload of a kFrameAttest response.
+struct WireAttestationHeader {
+    // When the evidence was generated and when the worker stops serving
+    // it, in Unix milliseconds.
+    uint64_t generated_unix_ms;
+    uint64_t expires_unix_ms;
+    uint32_t claims_bytes;
+    uint32_t evidence_bytes;
+};
+
+// Leads the payload of a kFrameChannelOpen response.
+struct WireChannelHeader {
+    uint64_t channel_id;
+    uint32_t public_key_bytes;
+    uint32_t evidence_bytes;
+};
+#pragma pack(pop)
+
+// Where frames are read from and written to: a pipe (FdStream) or a
+// shared-memory ring (host/shm_ring.h). Every frame goes out in a single
+// write() call, so a transport can keep frames whole.
+class WireStream {
+public:
+    virtual ~WireStream() = default;
+    // Reads len bytes, or fewer only at end of input. Throws
+    // std::runtime_error on a failed read.
+    virtual size_t read(void* buf, size_t len) = 0;
+    // Writes iovcnt buffers back to back as one frame, and may modify iov.
+    // Throws std::runtime_error if the peer is gone.
+    virtual void write(struct iovec* iov, int iovcnt) = 0;
+};
+
+// A file descriptor the stream does not own.
+class FdStream : public WireStream {
+public:
+    explicit FdStream(int fd) : fd_(fd) {}
+    size_t read(void* buf, size_t len) override;
+    void write(struct iovec* iov, int iovcnt) override;
+
+private:
+    const int fd_;
+};
+
+// Upper bound on an incoming frame, so a corrupt length can't make the
+// worker allocate unbounded memory.
+constexpr uint32_t kMaxWireFrameBytes = 16u << 20;
+
+struct WireRequest {
+    WireRequestHeader header;
+    // Filled from the payload of token frames, or by tokenizing text.
+    std::vector<int32_t> tokens;
+    std::string text;
+    // From the frame's options block or kFlagOutputF16.
+    WireOutputOptions output;
+    // Neighbours asked for by a kFlagTopK request.
+    uint32_t top_k = 0;
+    // OE_OK, or the status to answer a frame with: its length was valid but
+    // its contents were not, and the rest of it was skipped undecoded.
+    uint32_t status = 0;
+};
+
+// Reads one request frame from stream. Returns false at end of input; throws
+// std::runtime_error on a truncated frame or an invalid length, after which
+// the stream is out of step. A frame whose contents are malformed comes back
+// with request.status set instead, so one bad request does not end the rest.
+bool read_request_frame(WireStream& stream, WireRequest& request);
+
+// Reads one frame, length prefix included, without decoding it; used to
+// relay frames between processes. Returns false at end of input; throws
+// std::runtime_error on a truncated frame or an invalid length.
+bool read_raw_frame(WireStream& stream, std::vector<char>& frame);
+
+// Writes bytes previously read with read_raw_frame.
+void write_raw_frame(WireStream& stream, const std::vector<char>& frame);
+
+// Writes one response frame to stream with a single write.
+// Throws std::runtime_error if the peer is gone.
+void write_response_frame(WireStream& stream, const WireResponseHeader& header, const void* payload, size_t payload_bytes);
+
+// Whether the worker can honour options: OE_OK, OE_UNSUPPORTED for CLS
+// pooling, or OE_INVALID_PARAMETER for an unknown dtype or pooling mode.
+uint32_t check_output_options(const WireOutputOptions& options);
+
+// Truncates, normalises and encodes a float32 embedding as options ask and
+// writes it as the response to request_header. Answers OE_INVALID_PARAMETER
+// instead if options.dims exceeds count.
+void write_embedding_response(WireStream& stream, const WireRequestHeader& request_header, const WireOutputOptions& options,
+                              const float* values, size_t count);
+
+// Writes a classification (kDtypeScores) as the response to request_header.
+void write_scores_response(WireStream& stream, const WireRequestHeader& request_header, uint32_t label, const float* scores,
+                           size_t count);
+
+// Writes count reference matches (kDtypeMatches) as the response to
+// request_header.
+void write_matches_response(WireStream& stream, const WireRequestHeader& request_header, const uint64_t* ids,
+                            const float* scores, size_t count);
+
+// Writes text (kDtypeText) as the response to request_header.
+void write_text_response(WireStream& stream, const WireRequestHeader& request_header, const std::string& text);
+
+// Writes bytes (kDtypeBytes) as the response to request_header.
+void write_bytes_response(WireStream& stream, const WireRequestHeader& request_header, const void* data, size_t bytes);
+
+// Answers a kFrameReady request: OE_OK with count ready_instances, or
+// OE_FAILURE while none is ready.
+void write_ready_response(WireStream& stream, const WireRequestHeader& request_header, uint32_t ready_instances);
+
+// Writes an error response (no payload) for request_header.
+void write_error_response(WireStream& stream, const WireRequestHeader& request_header, uint32_t status);